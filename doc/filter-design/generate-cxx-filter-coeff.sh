@@ -11,3 +11,7 @@
 ./generate-cxx-coeff-list.py jj1bdx_nbfm_48khz_wide 48kHz-nbfm-20kHz-127taps-coeff.txt
 ./generate-cxx-coeff-list.py jj1bdx_fm_384kHz_narrow 384kHz-242kHz-127taps-coeff.txt
 ./generate-cxx-coeff-list.py jj1bdx_fm_384kHz_medium 384kHz-312kHz-127taps-coeff.txt
+./generate-cxx-coeff-list.py jj1bdx_mpx_384khz_halfband 384kHz-mpx-96kHz-127taps-coeff.txt
+./generate-cxx-coeff-list.py jj1bdx_384khz_fmaudio_halfband 384kHz-fmaudio-halfband-19taps-coeff.txt
+./generate-cxx-coeff-list.py jj1bdx_192khz_fmaudio_halfband 192kHz-fmaudio-halfband-23taps-coeff.txt
+./generate-cxx-coeff-list.py jj1bdx_96khz_fmaudio_2to1 96kHz-fmaudio-2to1-127taps-coeff.txt
@@ -39,6 +39,9 @@ public:
   // Process audio samples.
   void process(const SampleVector &samples_in, SampleVector &samples_out);
 
+  // Allocate the buffer for blocks of up to n samples in advance.
+  void reserve(std::size_t n);
+
   // Return AF AGC current gain.
   double get_current_gain() const { return std::exp(m_log_current_gain); }
 
@@ -47,6 +50,8 @@ private:
   double m_log_max_gain;
   double m_log_reference;
   double m_rate;
+  // Gain buffer reused for every block.
+  volk::vector<double> m_gain;
 };
 
 #endif
@@ -24,6 +24,7 @@
 #include <string>
 #include <vector>
 
+#include "RealConverterIQ.h"
 #include "Source.h"
 
 #define AIRSPY_MAX_DEVICE (32)
@@ -72,14 +73,16 @@ private:
    * vga_gain        :: desired VGA gain: 0 to 15 dB
    * lna_agc         :: LNA AGC
    * mix_agc         :: Mixer AGC
+   * int16           :: receive INT16_REAL samples and convert in-house
    *
    * Return true for success, false if an error occurred.
    */
   bool configure(int sampleRateIndex, uint32_t frequency, bool bias_ant,
                  int lna_gain, int mix_gain, int vga_gain, bool lna_agc,
-                 bool mix_agc);
+                 bool mix_agc, bool int16);
 
   void callback(const float *buf, int len);
+  void callback_int16(const int16_t *buf, int len);
   static int rx_callback(airspy_transfer_t *transfer);
   static void run(airspy_device *dev, std::atomic_bool *stop_flag);
 
@@ -92,6 +95,7 @@ private:
   bool m_biasAnt;
   bool m_lnaAGC;
   bool m_mixAGC;
+  bool m_int16;
   bool m_running;
   static AirspySource *m_this;
   static const std::vector<int> m_lgains;
@@ -107,6 +111,9 @@ private:
   int m_ndev;
   std::vector<uint64_t> m_serials;
 
+  // Fs/4 conversion and half-band decimation for INT16_REAL samples.
+  RealConverterIQ m_realConverter;
+
   std::thread *m_thread;
 };
 
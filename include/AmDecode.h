@@ -29,6 +29,7 @@
 #include "FourthConverterIQ.h"
 #include "IfAgc.h"
 #include "IfResampler.h"
+#include "LevelMeter.h"
 #include "SoftFM.h"
 
 // Fine tuner which shifts the frequency of an IQ signal by a fixed offset.
@@ -76,9 +77,15 @@ public:
   // Process IQ samples and return audio samples.
   void process(const IQSampleVector &samples_in, SampleVector &audio);
 
+  // Allocate the buffers for input blocks of up to n samples in advance.
+  void reserve(std::size_t n);
+
   // Return RMS baseband signal level (where nominal level is 0.707).
   double get_baseband_level() const { return m_baseband_level; }
 
+  // Return the mean, RMS, and peak levels of the last baseband block.
+  const LevelMeter &get_baseband_meter() const { return m_baseband_meter; }
+
   // Return AF AGC current gain.
   float get_af_agc_current_gain() const { return m_afagc.get_current_gain(); }
 
@@ -88,6 +95,10 @@ public:
   // Return RMS IF level.
   float get_if_rms() const { return m_if_rms; }
 
+  // Return the processing cost of the FIR filter stages
+  // used for the mode.
+  std::vector<FilterStageCost> get_filter_costs() const;
+
 private:
   // Demodulate AM signal.
   inline void demodulate_am(const IQSampleVector &samples_in,
@@ -102,6 +113,7 @@ private:
   float m_baseband_mean;
   float m_baseband_level;
   float m_if_rms;
+  LevelMeter m_baseband_meter;
 
   IQSampleVector m_buf_filtered;
   IQSampleVector m_buf_filtered2;
@@ -19,6 +19,8 @@
 #ifndef SOFTFM_AUDIOOUTPUT_H
 #define SOFTFM_AUDIOOUTPUT_H
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
 #include <string>
@@ -26,6 +28,7 @@
 #include "SoftFM.h"
 
 #include "portaudio.h"
+#include <sndfile.h>
 
 /** Base class for writing audio data to file or playback. */
 class AudioOutput {
@@ -145,6 +148,134 @@ private:
   std::vector<std::uint8_t> m_bytebuf;
 };
 
+/**
+ * Encode audio data to FLAC or Ogg/Opus file by libsndfile.
+ *
+ * libsndfile buffers the samples and chooses the codec frame size itself.
+ */
+class EncoderAudioOutput : public AudioOutput {
+public:
+  enum class Codec { FLAC, Opus };
+
+  /**
+   * Construct encoder writer.
+   *
+   * filename     :: file name (including path)
+   * codec        :: FLAC (24-bit lossless) or Opus
+   * samplerate   :: audio sample rate in Hz (48kHz only for Opus)
+   * stereo       :: true if the output stream contains stereo data
+   */
+  EncoderAudioOutput(const std::string &filename, Codec codec,
+                     unsigned int samplerate, bool stereo);
+
+  virtual ~EncoderAudioOutput() override;
+  virtual bool write(const SampleVector &samples) override;
+
+  /**
+   * Choose codec from the file name extension:
+   * .flac for FLAC, .opus or .ogg for Opus.
+   *
+   * Return true if the extension is known.
+   */
+  static bool parse_codec(const std::string &filename, Codec &codec);
+
+  /** Return the codec name. */
+  static const char *codec_name(Codec codec);
+
+  /** Return the number of encoded frames. */
+  std::uint64_t get_encoded_frames() const { return m_encoded_frames; }
+
+  /** Return the thread CPU time spent for encoding in seconds. */
+  double get_cpu_time() const { return m_cpu_time; }
+
+private:
+  /** Encode the given interleaved samples. */
+  bool encode(const Sample *samples, unsigned int nframes);
+
+  unsigned int m_nchannels;
+  SNDFILE *m_sndfile;
+  std::uint64_t m_encoded_frames;
+  double m_cpu_time;
+};
+
+/**
+ * Stream audio data as RTP packets over UDP or a Unix datagram socket.
+ *
+ * The samples are cut into packets of a fixed number of frames,
+ * with sequence numbers and timestamps counted by the sample clock,
+ * and sent at the pace of the sample rate.
+ */
+class NetAudioOutput : public AudioOutput {
+public:
+  /** Maximum RTP payload size in bytes to fit in an Ethernet MTU. */
+  static constexpr unsigned int max_payload_size = 1152;
+
+  /** RTP header size in bytes. */
+  static constexpr unsigned int rtp_header_size = 12;
+
+  /** RTP dynamic payload type. */
+  static constexpr unsigned int rtp_payload_type = 96;
+
+  /** Maximum delay behind the packet schedule in seconds before resync. */
+  static constexpr double max_schedule_delay = 0.2;
+
+  //
+  // Construct network audio output stream.
+  //
+  // destination  :: "host:port" for UDP,
+  //                 or "unix:path" for a Unix datagram socket
+  // samplerate   :: audio sample rate in Hz
+  // stereo       :: true if the output stream contains stereo data
+  // float32      :: true for 32-bit float payload instead of 16-bit integer
+  //                 (both in network byte order)
+  NetAudioOutput(const std::string &destination, unsigned int samplerate,
+                 bool stereo, bool float32);
+
+  virtual ~NetAudioOutput() override;
+  virtual bool write(const SampleVector &samples) override;
+
+  /** Return the number of frames per packet. */
+  unsigned int get_packet_frames() const { return m_packet_frames; }
+
+  /** Return the number of packets sent. */
+  std::uint64_t get_sent_packets() const { return m_sent_packets; }
+
+  /** Return the number of packets not accepted by the socket. */
+  std::uint64_t get_dropped_packets() const { return m_dropped_packets; }
+
+  /** Return the number of times the packet schedule was reset. */
+  std::uint64_t get_resyncs() const { return m_resyncs; }
+
+private:
+  /** Build and send a packet from the given interleaved samples. */
+  bool send_packet(const Sample *samples, unsigned int nframes);
+
+  unsigned int m_nchannels;
+  unsigned int m_samplerate;
+  bool m_float32;
+  unsigned int m_packet_frames;
+  int m_fd;
+  std::vector<std::uint8_t> m_addr;
+
+  // Samples not yet sent, less than a packet.
+  SampleVector m_pending;
+  std::vector<std::uint8_t> m_packet;
+
+  // RTP header fields.
+  std::uint16_t m_sequence;
+  std::uint32_t m_timestamp;
+  std::uint32_t m_ssrc;
+  bool m_marker;
+
+  // Packet schedule by the sample clock.
+  std::chrono::steady_clock::time_point m_schedule_start;
+  std::uint64_t m_schedule_frames;
+
+  std::uint64_t m_sent_packets;
+  std::uint64_t m_dropped_packets;
+  std::uint64_t m_resyncs;
+};
+
 class PortAudioOutput : public AudioOutput {
 public:
   //
@@ -171,4 +302,108 @@ private:
   std::vector<std::uint8_t> m_bytebuf;
 };
 
+/**
+ * Low-latency PortAudio output by the callback API.
+ *
+ * The output thread resamples the audio by a ratio close to 1
+ * and puts it into a lock-free ring buffer read by the PortAudio callback.
+ * The ratio is adjusted to keep the ring buffer level at the target,
+ * so that the clock drift between the SDR and the sound card
+ * neither grows the buffer nor causes underruns.
+ */
+class PortAudioCallbackOutput : public AudioOutput {
+public:
+  /** Target ring buffer level in seconds. */
+  static constexpr double target_latency = 0.1;
+
+  /** Ring buffer capacity in seconds (rounded up to a power of 2). */
+  static constexpr double ring_capacity = 1.0;
+
+  /** Maximum resampling ratio deviation from 1. */
+  static constexpr double max_ratio_deviation = 1.0e-3;
+
+  /** Smoothing factor of the ring buffer level sampled at each write. */
+  static constexpr double level_smoothing = 0.05;
+
+  /** Proportional gain of the level control (per second). */
+  static constexpr double control_kp = 1.0e-2;
+
+  /** Integral gain of the level control (per second squared). */
+  static constexpr double control_ki = 1.0e-4;
+
+  //
+  // Construct PortAudio callback output stream.
+  //
+  // device_index :: device index number
+  // samplerate   :: audio sample rate in Hz
+  // stereo       :: true if the output stream contains stereo data
+  PortAudioCallbackOutput(const PaDeviceIndex device_index,
+                          unsigned int samplerate, bool stereo);
+
+  virtual ~PortAudioCallbackOutput() override;
+  virtual bool write(const SampleVector &samples) override;
+
+  /** Return the number of callbacks with insufficient samples. */
+  std::uint64_t get_underruns() const { return m_underruns.load(); }
+
+  /** Return the number of writes not fit in the ring buffer. */
+  std::uint64_t get_overruns() const { return m_overruns; }
+
+  /** Return the number of frames dropped by overruns. */
+  std::uint64_t get_dropped_frames() const { return m_dropped_frames; }
+
+  /** Return the current resampling ratio deviation in ppm. */
+  double get_ratio_ppm() const { return m_ratio_deviation * 1.0e6; }
+
+private:
+  /** PortAudio stream callback. */
+  static int callback(const void *input, void *output,
+                      unsigned long frame_count,
+                      const PaStreamCallbackTimeInfo *time_info,
+                      PaStreamCallbackFlags status_flags, void *user_data);
+
+  /** Update the resampling ratio from the ring buffer level. */
+  void update_ratio(std::uint64_t level, std::size_t nframes);
+
+  /** Resample the input into m_resampled. */
+  void resample(const SampleVector &samples);
+
+  // Terminate PortAudio
+  // then add PortAudio error string to m_error and set m_zombie flag.
+  void add_paerror(const std::string &msg);
+
+  unsigned int m_nchannels;
+  unsigned int m_samplerate;
+  PaStreamParameters m_outputparams;
+  PaStream *m_stream;
+  PaError m_paerror;
+
+  // Single-producer single-consumer ring buffer of interleaved samples,
+  // positions counted in frames.
+  std::vector<float> m_ring;
+  std::uint64_t m_ring_frames;
+  std::atomic<std::uint64_t> m_write_pos;
+  std::atomic<std::uint64_t> m_read_pos;
+  std::uint64_t m_target_frames;
+
+  // Written by the callback only.
+  std::atomic_bool m_playing;
+  std::atomic<std::uint64_t> m_underruns;
+
+  // Written by the output thread only.
+  std::uint64_t m_overruns;
+  std::uint64_t m_dropped_frames;
+
+  // Ring buffer level control.
+  double m_level_average;
+  double m_level_integral;
+  double m_ratio_deviation;
+
+  // Resampler state: last 3 input frames followed by the new input,
+  // and the read position in input frames.
+  std::vector<float> m_history;
+  double m_position;
+  std::vector<float> m_resampled;
+};
+
 #endif
@@ -19,15 +19,31 @@
 #ifndef _INCLUDE_DATABUFFER_H_
 #define _INCLUDE_DATABUFFER_H_
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
-#include <queue>
+#include <vector>
+
+// Wakeup latency of the thread pulling from DataBuffer,
+// from the push which first satisfies the wait
+// to the return from the wait.
+struct DataBufferWakeupStats {
+  // Number of the waits.
+  std::uint64_t count;
+  // Total and maximum latency in seconds.
+  double total;
+  double max;
+};
 
 /** Buffer to move sample data between threads. */
 template <class Element> class DataBuffer {
 public:
   /** Constructor. */
-  DataBuffer() : m_qlen(0), m_end_marked(false) {}
+  DataBuffer()
+      : m_qlen(0), m_end_marked(false), m_waiting(false), m_wait_minfill(0),
+        m_push_marked(false), m_wakeup{0, 0, 0}, m_head(0), m_count(0) {}
 
   /** Add samples to the queue. */
   void push(std::vector<Element> &&samples) {
@@ -35,7 +51,12 @@ public:
       {
         std::lock_guard<std::mutex> lock(m_mutex);
         m_qlen += samples.size();
-        m_queue.push(std::move(samples));
+        if (m_count == m_queue.size()) {
+          grow_queue(m_count + 1);
+        }
+        m_queue[(m_head + m_count) % m_queue.size()] = std::move(samples);
+        m_count++;
+        mark_push_time();
         // unlock m_mutex here by getting out of scope
       }
       m_cond.notify_all();
@@ -47,6 +68,7 @@ public:
     {
       std::lock_guard<std::mutex> lock(m_mutex);
       m_end_marked = true;
+      mark_push_time();
       // unlock m_mutex here by getting out of scope
     }
     m_cond.notify_all();
@@ -67,11 +89,13 @@ public:
   std::vector<Element> pull() {
     std::vector<Element> ret;
     std::unique_lock<std::mutex> lock(m_mutex);
-    m_cond.wait(lock, [&] { return !(m_queue.empty() && !m_end_marked); });
-    if (!m_queue.empty()) {
-      m_qlen -= m_queue.front().size();
-      std::swap(ret, m_queue.front());
-      m_queue.pop();
+    // Blocks are never empty, so one sample means a block in the queue.
+    wait(lock, 1);
+    if (m_count > 0) {
+      m_qlen -= m_queue[m_head].size();
+      std::swap(ret, m_queue[m_head]);
+      m_head = (m_head + 1) % m_queue.size();
+      m_count--;
     }
     return ret;
   }
@@ -85,13 +109,122 @@ public:
   /** Wait until the buffer contains minfill samples or an end marker. */
   void wait_buffer_fill(std::size_t minfill) {
     std::unique_lock<std::mutex> lock(m_mutex);
-    m_cond.wait(lock, [&] { return !(m_qlen < minfill && !m_end_marked); });
+    wait(lock, minfill);
+  }
+
+  /**
+   * Return a block of size elements to fill and push,
+   * reusing a block returned by recycle() if available,
+   * so that no memory is allocated once enough blocks are recycled.
+   */
+  std::vector<Element> get_block(std::size_t size) {
+    std::vector<Element> block;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_pool.empty()) {
+        std::swap(block, m_pool.back());
+        m_pool.pop_back();
+      }
+      // unlock m_mutex here by getting out of scope
+    }
+    block.resize(size);
+    return block;
+  }
+
+  /**
+   * Allocate count blocks of size elements for get_block(),
+   * and the queue to hold them, in advance,
+   * so that no memory is allocated while processing unless the blocks
+   * run out or a larger block is requested.
+   */
+  void reserve_blocks(std::size_t count, std::size_t size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    grow_queue(m_queue.size() + count);
+    m_pool.reserve(m_pool.size() + count);
+    for (std::size_t i = 0; i < count; i++) {
+      std::vector<Element> block;
+      block.reserve(size);
+      m_pool.push_back(std::move(block));
+    }
+  }
+
+  /** Return a pulled block for reuse by get_block(). */
+  void recycle(std::vector<Element> &&block) {
+    if (block.capacity() > 0) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pool.push_back(std::move(block));
+    }
+  }
+
+  /** Return the wakeup latency statistics of the pulling thread. */
+  DataBufferWakeupStats get_wakeup_stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_wakeup;
   }
 
 private:
+  using clock_type = std::chrono::steady_clock;
+
+  // Return true if the wait for minfill samples or the end is satisfied.
+  bool filled(std::size_t minfill) const {
+    return m_qlen >= minfill || m_end_marked;
+  }
+
+  // Enlarge the queue to hold at least size blocks.
+  void grow_queue(std::size_t size) {
+    if (size <= m_queue.size()) {
+      return;
+    }
+    // Move the queued blocks to the beginning.
+    std::rotate(m_queue.begin(), m_queue.begin() + m_head, m_queue.end());
+    m_head = 0;
+    m_queue.resize(std::max(size, 2 * m_queue.size()));
+  }
+
+  // Record the time of the push which first satisfies the waiting thread.
+  // The later pushes before the wakeup do not move the time.
+  void mark_push_time() {
+    if (m_waiting && !m_push_marked && filled(m_wait_minfill)) {
+      m_push_time = clock_type::now();
+      m_push_marked = true;
+    }
+  }
+
+  // Wait for minfill samples or the end marker,
+  // and measure the wakeup latency if waited.
+  // Only one thread is expected to pull from the buffer.
+  void wait(std::unique_lock<std::mutex> &lock, std::size_t minfill) {
+    if (filled(minfill)) {
+      return;
+    }
+    m_waiting = true;
+    m_wait_minfill = minfill;
+    m_push_marked = false;
+    m_cond.wait(lock, [&] { return filled(minfill); });
+    m_waiting = false;
+    m_push_marked = false;
+    double latency =
+        std::chrono::duration<double>(clock_type::now() - m_push_time).count();
+    m_wakeup.count++;
+    m_wakeup.total += latency;
+    if (latency > m_wakeup.max) {
+      m_wakeup.max = latency;
+    }
+  }
+
   std::size_t m_qlen;
   bool m_end_marked;
-  std::queue<std::vector<Element>> m_queue;
+  bool m_waiting;
+  std::size_t m_wait_minfill;
+  bool m_push_marked;
+  clock_type::time_point m_push_time;
+  DataBufferWakeupStats m_wakeup;
+  // Queued blocks in a ring of m_count blocks from m_head.
+  std::vector<std::vector<Element>> m_queue;
+  std::size_t m_head;
+  std::size_t m_count;
+  // Blocks returned by recycle().
+  std::vector<std::vector<Element>> m_pool;
   std::mutex m_mutex;
   std::condition_variable m_cond;
 };
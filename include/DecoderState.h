@@ -0,0 +1,110 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SOFTFM_DECODERSTATE_H
+#define SOFTFM_DECODERSTATE_H
+
+#include <complex>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checkpoint of the FM decoder state for a warm start.
+//
+// The adaptive states which take long to settle are saved:
+// the multipath filter coefficients, the IF AGC gain,
+// the pilot PLL frequency, and the tuning offset in ppm.
+// The filter histories and the PLL phase are not saved,
+// since they have no continuity with the samples after a restart.
+// The state is restored only for the same frequency and modulation type.
+
+class DecoderState {
+public:
+  DecoderState();
+
+  // Read the state from a file.
+  // Return false if the file is missing or invalid.
+  bool load(const std::string &filename);
+
+  // Write the state to a file.
+  // Return false on errors.
+  bool save(const std::string &filename) const;
+
+  // Return true if the state applies to the frequency and modulation type.
+  bool matches(double frequency, const std::string &modtype) const;
+
+  // Tuned frequency in Hz.
+  double frequency;
+  // Modulation type name.
+  std::string modtype;
+  // Tuning offset in ppm.
+  double ppm;
+  // IF AGC gain.
+  float if_agc_gain;
+  // True if the pilot PLL state is valid.
+  bool pilot_valid;
+  // Pilot PLL frequency in radian per sample and loop filter state.
+  double pilot_freq;
+  double pilot_loopfilter_x1;
+  // Multipath filter coefficients (empty if not used).
+  std::vector<std::complex<float>> multipath_coeff;
+};
+
+// Background writer of the periodic decoder state checkpoints.
+//
+// The state is copied into a preallocated slot,
+// and formatted and written to the file by a writer thread,
+// so that the DSP thread never allocates memory or waits for the file I/O.
+
+class DecoderStateWriter {
+public:
+  // Construct the writer.
+  //
+  // filename       :: state file name
+  // multipath_size :: number of the multipath filter coefficients
+  DecoderStateWriter(const std::string &filename, std::size_t multipath_size);
+
+  // Finish the write in progress and stop the writer thread.
+  ~DecoderStateWriter();
+
+  // Write the state to the file in the background.
+  // Return false if the previous write is still in progress.
+  // Errors of the file I/O are shown by the writer thread.
+  bool save(const DecoderState &state);
+
+private:
+  // Writer thread.
+  void run();
+
+  const std::string m_filename;
+
+  // State being written, accessed only by the writer thread
+  // while m_writing is true.
+  DecoderState m_state;
+  bool m_writing;
+  bool m_stop;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::thread m_thread;
+};
+
+#endif
@@ -55,6 +55,11 @@ public:
   /** Return if device is using Low-IF. */
   virtual bool is_low_if() override;
 
+  /** Return the block length. */
+  virtual std::size_t get_max_block_length() const override {
+    return m_block_length;
+  }
+
   /** Print current parameters specific to device type */
   virtual void print_specific_parms() override;
 
@@ -129,6 +134,8 @@ private:
   double m_sample_rate_per_us;
 
   bool (*m_fmt_fn)(IQSampleVector *samples);
+  // Buffer of the samples read from the file.
+  std::vector<float> m_floatbuf;
   static FileSource *m_this;
 
   std::thread *m_thread;
@@ -20,8 +20,27 @@
 #ifndef SOFTFM_FILTER_H
 #define SOFTFM_FILTER_H
 
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "FirKernel.h"
 #include "SoftFM.h"
 
+// Processing cost of a filter stage, reported at startup.
+struct FilterStageCost {
+  // Name of the stage.
+  std::string name;
+  // Output sample rate in Hz.
+  double sample_rate;
+  // Real multiply-accumulate operations per output sample.
+  unsigned int macs_per_sample;
+  // Delay in samples if the filter is a pure delay, otherwise 0.
+  unsigned int delay;
+  // True if the stage is not processed at all.
+  bool elided;
+};
+
 // Low-pass filter for IQ samples.
 class LowPassFilterFirIQ {
 public:
@@ -36,12 +55,27 @@ public:
   // Process samples.
   void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
 
+  // Return the delay in samples if the coefficients are a pure delay,
+  // processed by copying instead of convolution, otherwise 0.
+  unsigned int get_delay() const { return m_delay; }
+
+  // Return true if the filter is a pure delay of unity gain,
+  // which the caller may elide as a constant timing offset.
+  bool is_unity_delay() const { return m_delay > 0 && m_delay_gain == 1; }
+
+  // Return the processing cost of the filter.
+  FilterStageCost get_cost(const std::string &name,
+                           const double sample_rate) const;
+
 private:
   const IQSampleCoeff m_coeff;
+  std::unique_ptr<FirKernelBase<IQSample, IQSample::value_type>> m_kernel;
   IQSampleVector m_state;
   unsigned int m_order;
   unsigned int m_downsample;
   unsigned int m_pos;
+  unsigned int m_delay;
+  IQSample::value_type m_delay_gain;
 };
 
 // Low-pass filter for mono audio signal.
@@ -57,11 +91,87 @@ public:
   // Process samples.
   void process(const SampleVector &samples_in, SampleVector &samples_out);
 
+  // Advance the filter as if n zero samples were input.
+  void fast_forward(const std::uint64_t n);
+
+  // Return the delay in samples if the coefficients are a pure delay,
+  // processed by copying instead of convolution, otherwise 0.
+  unsigned int get_delay() const { return m_delay; }
+
+  // Return the processing cost of the filter.
+  FilterStageCost get_cost(const std::string &name,
+                           const double sample_rate) const;
+
 private:
   SampleCoeff m_coeff;
+  std::unique_ptr<FirKernelBase<Sample, Sample>> m_kernel;
   SampleVector m_state;
   unsigned int m_order;
   unsigned int m_pos;
+  unsigned int m_delay;
+  Sample m_delay_gain;
+};
+
+// Decimating low-pass filter for real-valued signals.
+// Zero coefficients (e.g., of half-band filters) are skipped,
+// and a filter without zero coefficients uses the FIR kernel.
+class DecimatingFilterFirAudio {
+public:
+  //
+  // Construct decimating low-pass filter.
+  //
+  // coeff        :: FIR filter coefficients (must be symmetric).
+  // downsample   :: Integer downsampling rate (>= 1)
+  //
+  DecimatingFilterFirAudio(const SampleCoeff &coeff,
+                           const unsigned int downsample);
+
+  // Process samples.
+  void process(const SampleVector &samples_in, SampleVector &samples_out);
+
+  // Allocate the buffer for input blocks of up to n samples in advance.
+  void reserve(std::size_t n) { m_buf.reserve(m_order + n); }
+
+  // Advance the filter as if n zero samples were input,
+  // and return the number of the output samples skipped.
+  std::uint64_t fast_forward(const std::uint64_t n);
+
+  // Return the processing cost of the filter.
+  FilterStageCost get_cost(const std::string &name,
+                           const double sample_rate) const;
+
+private:
+  // Non-zero coefficients of the first half and their indexes.
+  std::vector<unsigned int> m_tap_index;
+  SampleCoeff m_tap_coeff;
+  // Center coefficient (zero if the order is odd).
+  Sample m_center_coeff;
+  // Kernel for a filter without zero coefficients, otherwise nullptr.
+  std::unique_ptr<FirKernelBase<Sample, Sample>> m_kernel;
+  // Last m_order input samples, followed by the current input block.
+  SampleVector m_buf;
+  unsigned int m_order;
+  unsigned int m_downsample;
+  unsigned int m_pos;
+};
+
+// Coefficients of a 2nd order IIR filter section (biquad):
+//   H(z) = (b0 + b1/z + b2/z**2) / (1 + a1/z + a2/z**2)
+// A 1st order section has zero b2 and a2.
+struct IirBiquad {
+  Sample b0, b1, b2, a1, a2;
+
+  // Return the section which passes the signal as is.
+  static IirBiquad identity();
+
+  // Return the 1st order low-pass section of LowPassFilterRC.
+  // timeconst :: RC time constant in samples
+  static IirBiquad lowpass_rc(const double timeconst);
+
+  // Return the 2nd order Butterworth high-pass section
+  // of HighPassFilterIir.
+  // cutoff :: high-pass cutoff relative to the sample frequency
+  static IirBiquad highpass_butterworth(const double cutoff);
 };
 
 // First order low-pass IIR filter for real-valued signals.
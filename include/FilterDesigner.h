@@ -0,0 +1,111 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SOFTFM_FILTERDESIGNER_H
+#define SOFTFM_FILTERDESIGNER_H
+
+#include <string>
+
+#include "SoftFM.h"
+
+// Runtime designer of linear-phase low-pass FIR filters
+// by the Kaiser window method.
+//
+// The number of taps is the minimum odd number which meets the given
+// passband ripple and stopband attenuation, searched from the Kaiser
+// estimate by doubling the step then by bisection,
+// and verified by evaluating the frequency response.
+// The window is designed for design_margin more attenuation than
+// the specification, which keeps the passband ripple peak within
+// the deviation, so that meeting the specification is monotonic
+// in the number of taps and the bisection finds the minimum.
+// The designed coefficients are cached in a directory on disk,
+// keyed by the specification.
+
+class FilterDesigner {
+public:
+  // Maximum number of taps to design.
+  static constexpr unsigned int max_taps = 4095;
+  // Default stopband attenuation in dB.
+  static constexpr double default_attenuation = 60;
+  // Extra attenuation of the window design in dB.
+  static constexpr double design_margin = 3;
+
+  // Low-pass filter specification.
+  struct Spec {
+    // Sample rate in Hz.
+    double sample_rate;
+    // Passband edge in Hz.
+    double passband;
+    // Stopband edge in Hz.
+    double stopband;
+    // Stopband attenuation in dB,
+    // which also sets the passband ripple by the same deviation.
+    double attenuation;
+  };
+
+  // Parse a specification string "passband,stopband[,attenuation]"
+  // in kHz and dB for the given sample rate.
+  // Return false if the string is invalid.
+  static bool parse_spec(const std::string &str, double sample_rate,
+                         Spec &spec);
+
+  // Return true if the specification is valid.
+  static bool valid(const Spec &spec);
+
+  // Design a low-pass filter for the specification.
+  // Return false with the error message if no filter up to max_taps
+  // meets the specification.
+  static bool design_lowpass(const Spec &spec, SampleCoeff &coeff,
+                             std::string &error);
+
+  // Get the coefficients for the specification from the cache,
+  // or design and store them into the cache.
+  // A failed design is not stored.
+  // cached :: set to true if read from the cache
+  // Return false with the error message if the design fails.
+  static bool lowpass(const Spec &spec, SampleCoeff &coeff, bool &cached,
+                      std::string &error);
+
+  // Return the cache directory name.
+  static std::string cache_directory();
+
+  // Return the cache file name for the specification.
+  static std::string cache_filename(const Spec &spec);
+
+private:
+  // Return the Kaiser window beta parameter for the attenuation.
+  static double kaiser_beta(double attenuation);
+
+  // Return the zeroth order modified Bessel function of the first kind.
+  static double bessel_i0(double x);
+
+  // Return the windowed sinc coefficients for the given number of taps.
+  static SampleCoeff windowed_sinc(const Spec &spec, unsigned int taps);
+
+  // Return true if the coefficients meet the specification.
+  static bool meets(const Spec &spec, const SampleCoeff &coeff);
+
+  // Read and write the cache file.
+  static bool load(const std::string &filename, SampleCoeff &coeff);
+  static bool save(const std::string &filename, const Spec &spec,
+                   const SampleCoeff &coeff);
+};
+
+#endif
@@ -33,6 +33,10 @@ public:
   static const SampleCoeff jj1bdx_48khz_fmaudio;
   static const SampleCoeff jj1bdx_48khz_nbfmaudio;
   static const SampleCoeff delay_3taps_only_audio;
+  static const SampleCoeff jj1bdx_mpx_384khz_halfband;
+  static const SampleCoeff jj1bdx_384khz_fmaudio_halfband;
+  static const SampleCoeff jj1bdx_192khz_fmaudio_halfband;
+  static const SampleCoeff jj1bdx_96khz_fmaudio_2to1;
 
   static const IQSampleCoeff jj1bdx_ssb_48khz_12to24khz;
   static const IQSampleCoeff jj1bdx_am_48khz_narrow;
@@ -0,0 +1,170 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SOFTFM_FIRKERNEL_H
+#define SOFTFM_FIRKERNEL_H
+
+#include <cassert>
+#include <memory>
+#include <vector>
+
+// Symmetric FIR filter kernels specialized by the number of taps.
+//
+// The coefficients of a linear-phase FIR filter are symmetric,
+// so the input samples of each coefficient pair are added first
+// and multiplied once (folding).
+// FirKernel<Taps> has the loop counts as compile-time constants,
+// so that the compiler can unroll and vectorize the loops freely.
+// The sum is split into independent partial sums,
+// which allows vectorization without reassociating
+// the floating-point additions.
+// make_fir_kernel() selects the specialized kernel
+// for the tap counts of the shipped filters,
+// or a generic kernel with the runtime tap count otherwise.
+
+// Interface of the kernels.
+// T :: sample type, C :: coefficient type
+template <typename T, typename C> class FirKernelBase {
+public:
+  virtual ~FirKernelBase() {}
+
+  // Compute n output samples.
+  // x    :: input samples, where x[0] is the oldest sample
+  //         of the first output sample
+  // step :: input samples advanced per output sample (downsampling)
+  // out  :: output samples
+  virtual void process(const T *x, unsigned int n, unsigned int step,
+                       T *out) const = 0;
+
+  // Return the number of taps.
+  virtual unsigned int taps() const = 0;
+};
+
+// Number of partial sums of the kernels.
+static constexpr unsigned int fir_kernel_lanes = 4;
+
+// Compute an output sample of a symmetric FIR filter.
+// x     :: input samples, the oldest first
+// taps  :: number of taps
+// coeff :: first half of the coefficients, including the center
+template <typename T, typename C>
+static inline T fir_symmetric(const T *x, unsigned int taps,
+                              const C *coeff) {
+  const unsigned int pairs = taps / 2;
+  const unsigned int blocks = pairs / fir_kernel_lanes;
+  T acc[fir_kernel_lanes] = {};
+  for (unsigned int b = 0; b < blocks; b++) {
+    for (unsigned int l = 0; l < fir_kernel_lanes; l++) {
+      unsigned int k = b * fir_kernel_lanes + l;
+      acc[l] += (x[k] + x[taps - 1 - k]) * coeff[k];
+    }
+  }
+  for (unsigned int k = blocks * fir_kernel_lanes; k < pairs; k++) {
+    acc[0] += (x[k] + x[taps - 1 - k]) * coeff[k];
+  }
+  if (taps % 2) {
+    acc[1] += x[pairs] * coeff[pairs];
+  }
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+// Kernel for a fixed number of taps.
+template <unsigned int Taps, typename T, typename C>
+class FirKernel final : public FirKernelBase<T, C> {
+public:
+  static_assert(Taps >= 1, "FirKernel needs one or more taps");
+  static_assert(fir_kernel_lanes == 4, "fir_symmetric sums four lanes");
+
+  // Number of coefficients in the first half, including the center.
+  static constexpr unsigned int half_taps = (Taps + 1) / 2;
+
+  // Construct the kernel from the full set of symmetric coefficients.
+  explicit FirKernel(const std::vector<C> &coeff) {
+    assert(coeff.size() == Taps);
+    for (unsigned int k = 0; k < half_taps; k++) {
+      m_coeff[k] = coeff[k];
+    }
+  }
+
+  void process(const T *x, unsigned int n, unsigned int step,
+               T *out) const override {
+    for (unsigned int i = 0; i < n; i++, x += step) {
+      out[i] = fir_symmetric<T, C>(x, Taps, m_coeff);
+    }
+  }
+
+  unsigned int taps() const override { return Taps; }
+
+private:
+  // 16-byte alignment is the most guaranteed by operator new in C++11.
+  alignas(16) C m_coeff[half_taps];
+};
+
+// Kernel for a number of taps given at runtime.
+template <typename T, typename C>
+class FirKernelGeneric final : public FirKernelBase<T, C> {
+public:
+  explicit FirKernelGeneric(const std::vector<C> &coeff)
+      : m_taps(coeff.size()),
+        m_coeff(coeff.begin(), coeff.begin() + (coeff.size() + 1) / 2) {
+    assert(!coeff.empty());
+  }
+
+  void process(const T *x, unsigned int n, unsigned int step,
+               T *out) const override {
+    for (unsigned int i = 0; i < n; i++, x += step) {
+      out[i] = fir_symmetric<T, C>(x, m_taps, m_coeff.data());
+    }
+  }
+
+  unsigned int taps() const override { return m_taps; }
+
+private:
+  const unsigned int m_taps;
+  const std::vector<C> m_coeff;
+};
+
+// Registry of the specialized kernels.
+// Return the kernel for the coefficients,
+// specialized if the number of taps is one of the shipped filters.
+template <typename T, typename C>
+std::unique_ptr<FirKernelBase<T, C>>
+make_fir_kernel(const std::vector<C> &coeff) {
+  FirKernelBase<T, C> *kernel;
+  switch (coeff.size()) {
+  case 63:
+    kernel = new FirKernel<63, T, C>(coeff);
+    break;
+  case 127:
+    kernel = new FirKernel<127, T, C>(coeff);
+    break;
+  case 255:
+    kernel = new FirKernel<255, T, C>(coeff);
+    break;
+  case 511:
+    kernel = new FirKernel<511, T, C>(coeff);
+    break;
+  default:
+    kernel = new FirKernelGeneric<T, C>(coeff);
+    break;
+  }
+  return std::unique_ptr<FirKernelBase<T, C>>(kernel);
+}
+
+#endif
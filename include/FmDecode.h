@@ -22,12 +22,15 @@
 
 #include <cstdint>
 
-#include "AudioResampler.h"
+#include "DecoderState.h"
 #include "Filter.h"
 #include "FilterParameters.h"
 #include "IfAgc.h"
+#include "LevelMeter.h"
+#include "MultiChannelIir.h"
 #include "MultipathFilter.h"
 #include "PhaseDiscriminator.h"
+#include "RdsDecode.h"
 #include "SoftFM.h"
 
 /** Phase-locked loop for stereo pilot. */
@@ -59,9 +62,11 @@ public:
    * pilot_shift :: true to shift pilot phase by
    *             :: using cos(2*x) instead of sin (2*x)
    *             :: (for multipath distortion detection)
+   * rds_carrier :: if not nullptr, also generate phase-locked
+   *             :: exp(-j * 3 * x) as the 57kHz RDS carrier
    */
   void process(const SampleVector &samples_in, SampleVector &samples_out,
-               bool pilot_shift);
+               bool pilot_shift, IQSampleVector *rds_carrier = nullptr);
 
   /** Return true if the phase-locked loop is locked. */
   bool locked() const { return m_lock_cnt >= m_lock_delay; }
@@ -69,6 +74,22 @@ public:
   /** Return detected amplitude of pilot signal. */
   double get_pilot_level() const { return 2 * m_pilot_level; }
 
+  /**
+   * Return mean frequency of the locked tone in the last block,
+   * relative to sample frequency.
+   */
+  double get_frequency() const { return m_block_freq; }
+
+  /** Return the loop state: frequency in radian per sample
+   *  and loop filter state. */
+  void get_loop_state(double &freq, double &loopfilter_x1) const {
+    freq = m_freq;
+    loopfilter_x1 = m_loopfilter_x1;
+  }
+
+  /** Restore the loop state saved by get_loop_state(). */
+  void set_loop_state(double freq, double loopfilter_x1);
+
   /** Return PPS events from the most recently processed block. */
   std::vector<PpsEvent> get_pps_events() const { return m_pps_events; }
 
@@ -82,6 +103,7 @@ private:
   Sample m_loopfilter_b0, m_loopfilter_b1;
   Sample m_loopfilter_x1;
   Sample m_freq, m_phase;
+  Sample m_block_freq;
   Sample m_minsignal;
   Sample m_pilot_level;
   int m_lock_delay;
@@ -92,6 +114,37 @@ private:
   std::vector<PpsEvent> m_pps_events;
 };
 
+// 8:1 audio decimator from 384kHz to 48kHz for FM, in three 2:1 stages
+// of two half-band filters and a 15kHz low-pass filter,
+// which also cuts the 19kHz pilot signal.
+// Only the output samples of each stage are computed.
+class FmAudioDecimator {
+public:
+  // Construct the decimator.
+  FmAudioDecimator();
+
+  // Process samples.
+  void process(const SampleVector &samples_in, SampleVector &samples_out);
+
+  // Allocate the buffers for input blocks of up to n samples in advance.
+  void reserve(std::size_t n);
+
+  // Advance the decimator as if n zero samples were input.
+  void fast_forward(const std::uint64_t n);
+
+  // Append the processing cost of the stages to costs.
+  // sample_rate :: input sample rate in Hz
+  void get_costs(const std::string &name, const double sample_rate,
+                 std::vector<FilterStageCost> &costs) const;
+
+private:
+  DecimatingFilterFirAudio m_stage1;
+  DecimatingFilterFirAudio m_stage2;
+  DecimatingFilterFirAudio m_stage3;
+  SampleVector m_buf1;
+  SampleVector m_buf2;
+};
+
 /** Complete decoder for FM broadcast signal. */
 class FmDecoder {
 public:
@@ -114,6 +167,8 @@ public:
    *
    * fmfilter_coeff    :: IQSample filter coefficients.
    * stereo            :: True to enable stereo decoding.
+   * stereo_gating     :: True to skip stereo decoding and output mono
+   *                      while the pilot is not locked.
    * deemphasis        :: Time constant of de-emphasis filter in microseconds
    *                      (50 us for broadcast FM, 0 to disable de-emphasis).
    * pilot_shift       :: True to shift pilot signal phase
@@ -121,9 +176,12 @@ public:
    *                   :: (for multipath distortion detection)
    * multipath_stages  :: Set >0 to enable multipath filter
    *                   :: (LMS adaptive filter stage number)
+   * multipath_algorithm :: Multipath filter coefficient adaptation algorithm
+   * rds               :: True to enable RDS/RBDS decoding.
    */
-  FmDecoder(IQSampleCoeff &fmfilter_coeff, bool stereo, double deemphasis,
-            bool pilot_shift, unsigned int multipath_stages);
+  FmDecoder(IQSampleCoeff &fmfilter_coeff, bool stereo, bool stereo_gating,
+            double deemphasis, bool pilot_shift, unsigned int multipath_stages,
+            MultipathFilter::Algorithm multipath_algorithm, bool rds);
   /**
    * Process IQ samples and return audio samples.
    *
@@ -134,18 +192,43 @@ public:
    */
   void process(const IQSampleVector &samples_in, SampleVector &audio);
 
+  /**
+   * Allocate the buffers for input blocks of up to n samples in advance,
+   * so that process() allocates no memory.
+   */
+  void reserve(std::size_t n);
+
   /** Return true if a stereo signal is detected. */
   bool stereo_detected() const { return m_stereo_detected; }
 
+  // Return the number of IF samples for which the stereo decoding
+  // was skipped by the stereo gating.
+  std::uint64_t get_stereo_skipped_samples() const {
+    return m_stereo_skipped_samples;
+  }
+
   /** Return actual frequency offset in Hz with respect to receiver LO. */
   float get_tuning_offset() const { return m_baseband_mean * freq_dev; }
 
   /** Return RMS baseband signal level (where nominal level is 0.707). */
   float get_baseband_level() const { return m_baseband_level; }
 
+  // Return the mean, RMS, and peak levels of the last baseband block.
+  const LevelMeter &get_baseband_meter() const { return m_baseband_meter; }
+
   /** Return amplitude of stereo pilot (nominal level is 0.1). */
   double get_pilot_level() const { return m_pilotpll.get_pilot_level(); }
 
+  /** Return true if the pilot PLL is running and locked. */
+  bool pilot_locked() const {
+    return (m_stereo_enabled || m_rds_enabled) && m_pilotpll.locked();
+  }
+
+  /** Return mean pilot frequency in Hz of the last block. */
+  double get_pilot_frequency() const {
+    return m_pilotpll.get_frequency() * sample_rate_if;
+  }
+
   // Return RMS IF level.
   float get_if_rms() const { return m_if_rms; }
 
@@ -160,11 +243,41 @@ public:
   // Get error value of the multipath filter.
   double get_multipath_error() { return m_multipathfilter.get_error(); }
 
+  // Get the number of multipath filter resets due to invalid output.
+  unsigned int get_multipath_reset_count() const {
+    return m_multipath_reset_count;
+  }
+
   // Get multipath filter coefficients.
   const MfCoeffVector &get_multipath_coefficients() {
     return m_multipathfilter.get_coefficients();
   }
 
+  // Get multipath filter (for the update interval statistics).
+  const MultipathFilter &get_multipath_filter() const {
+    return m_multipathfilter;
+  }
+
+  // Get MPX baseband signal of the most recently processed block
+  // at sample_rate_if, before deemphasis.
+  // The contents are valid until the next process() call.
+  const SampleVector &get_baseband() const { return m_buf_baseband; }
+
+  // Get RDS decoder.
+  const RdsDecoder &get_rds_decoder() const { return m_rdsdecoder; }
+
+  // Return the processing cost of the FIR filter stages.
+  std::vector<FilterStageCost> get_filter_costs() const;
+
+  // Save the adaptive states to the checkpoint.
+  // (frequency, modtype, and ppm are set by the caller)
+  void get_state(DecoderState &state) const;
+
+  // Restore the adaptive states from the checkpoint.
+  // The multipath filter starts adapting immediately
+  // if its coefficients are restored.
+  void set_state(const DecoderState &state);
+
 private:
   /** Demodulate stereo L-R signal. */
   inline void demod_stereo(const SampleVector &samples_baseband,
@@ -190,11 +303,21 @@ private:
   const bool m_enable_multipath_filter;
   unsigned int m_wait_multipath_blocks;
   const unsigned int m_multipath_stages;
+  unsigned int m_multipath_reset_count;
   const bool m_stereo_enabled;
+  const bool m_stereo_gating;
+  const bool m_rds_enabled;
   bool m_stereo_detected;
+  // True if the stereo chain processed the previous block.
+  bool m_stereo_running;
+  // Number of samples not input to the stereo audio decimator
+  // since the stereo decoding was skipped.
+  std::uint64_t m_stereo_gap_samples;
+  std::uint64_t m_stereo_skipped_samples;
   float m_baseband_mean;
   float m_baseband_level;
   float m_if_rms;
+  LevelMeter m_baseband_meter;
 
   IQSampleVector m_samples_in_iffiltered;
   IQSampleVector m_samples_in_after_agc;
@@ -202,25 +325,23 @@ private:
   IQSampleDecodedVector m_buf_decoded;
   SampleVector m_buf_baseband;
   SampleVector m_buf_baseband_raw;
-  SampleVector m_buf_mono_firstout;
+  SampleVector m_buf_baseband_deemph;
   SampleVector m_buf_mono;
   SampleVector m_buf_rawstereo;
-  SampleVector m_buf_stereo_firstout;
   SampleVector m_buf_stereo;
+  IQSampleVector m_buf_rds_carrier;
 
   LowPassFilterFirIQ m_fmfilter;
-  AudioResampler m_audioresampler_mono;
-  AudioResampler m_audioresampler_stereo;
-  LowPassFilterFirAudio m_pilotcut_mono;
-  LowPassFilterFirAudio m_pilotcut_stereo;
+  FmAudioDecimator m_audiodecimator_mono;
+  FmAudioDecimator m_audiodecimator_stereo;
   PhaseDiscriminator m_phasedisc;
   PilotPhaseLock m_pilotpll;
-  HighPassFilterIir m_dcblock_mono;
-  HighPassFilterIir m_dcblock_stereo;
-  LowPassFilterRC m_deemph_mono;
-  LowPassFilterRC m_deemph_stereo;
+  // Channel 0: mono (L+R), channel 1: stereo (L-R).
+  MultiChannelIir<2> m_dcblock;
+  MultiChannelIir<2> m_deemph;
   IfAgc m_ifagc;
   MultipathFilter m_multipathfilter;
+  RdsDecoder m_rdsdecoder;
 };
 
 #endif
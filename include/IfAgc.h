@@ -40,14 +40,25 @@ public:
   // Process IQ samples.
   void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
 
+  // Allocate the buffers for blocks of up to n samples in advance.
+  void reserve(std::size_t n);
+
   // Return IF AGC current gain.
   float get_current_gain() const { return std::exp(m_log_current_gain); }
 
+  // Set IF AGC current gain (limited to the maximum gain).
+  void set_current_gain(const float gain) {
+    m_log_current_gain = std::fmin(std::log(gain), m_log_max_gain);
+  }
+
 private:
   float m_log_current_gain;
   float m_log_max_gain;
   float m_log_reference;
   float m_rate;
+  // Gain buffers reused for every block.
+  volk::vector<float> m_log_gain;
+  volk::vector<float> m_gain;
 };
 
 #endif
@@ -0,0 +1,91 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_IFRATECALIBRATOR_H
+#define SOFTFM_IFRATECALIBRATOR_H
+
+#include <cstdint>
+#include <string>
+
+// Estimator of the IF sample rate error from the 19kHz stereo pilot.
+//
+// The mean pilot frequency measured by the PLL is averaged over
+// the locked periods, weighted by the block length,
+// which equals the total phase advance divided by the number of samples.
+// If the device clock is fast by e, the pilot is measured at
+// 19kHz / (1 + e) with the nominal sample rate.
+
+class IfRateCalibrator {
+public:
+  // Minimum locked duration in seconds before an estimate is made.
+  static constexpr double min_duration = 60.0;
+  // Minimum difference in ppm from the applied value to update it.
+  static constexpr double min_update_ppm = 0.5;
+  // Nominal pilot frequency in Hz.
+  static constexpr double pilot_frequency = 19000;
+
+  // Construct calibrator.
+  //
+  // sample_rate :: sample rate of the pilot measurement in Hz
+  // ppm         :: IF sample rate correction currently applied
+  IfRateCalibrator(double sample_rate, double ppm);
+
+  // Feed the mean pilot frequency in Hz of a block of n samples.
+  // Blocks without the pilot lock are ignored.
+  void feed(double pilot_freq, std::size_t n, bool locked);
+
+  // Return true if a new correction should be applied.
+  // The correction is updated when it differs from the applied one
+  // by min_update_ppm or more after min_duration of locked pilot,
+  // and the averaging restarts for the new correction.
+  bool update();
+
+  // Return the IF sample rate correction in ppm.
+  double get_ppm() const { return m_ppm; }
+
+  // Return true if an estimate has been made.
+  bool calibrated() const { return m_calibrated; }
+
+  // Return the locked duration in seconds averaged for the estimate.
+  double get_duration() const { return m_samples / m_sample_rate; }
+
+  // Return the default calibration file name.
+  static std::string default_filename();
+
+  // Load the correction for the device from the calibration file.
+  // Return false if not found.
+  static bool load(const std::string &filename, const std::string &device,
+                   double &ppm);
+
+  // Store the correction for the device into the calibration file.
+  // Return false if the file can not be written.
+  static bool save(const std::string &filename, const std::string &device,
+                   double ppm);
+
+private:
+  // Return the correction estimated from the current average.
+  double estimate() const;
+
+  const double m_sample_rate;
+  double m_ppm;
+  bool m_calibrated;
+  double m_freq_sum;
+  std::uint64_t m_samples;
+};
+
+#endif
@@ -33,14 +33,22 @@ public:
   // input_rate : input sampling rate.
   // output_rate: input sampling rate.
   IfResampler(const double input_rate, const double output_rate);
+  // Destructor.
+  ~IfResampler();
   // Process IQ samples.
   // converting input_rate to output_rate.
   void process(const IQSampleVector &samples_in, IQSampleVector &samples_out);
+  // Change input_rate.
+  // The resampler is recreated, so the filter state is reset.
+  void set_input_rate(const double input_rate);
 
 private:
-  const double m_irate;
+  // Create the resampler for the current rates.
+  void create();
+
+  double m_irate;
   const double m_orate;
-  const double m_ratio;
+  double m_ratio;
   soxr_t m_soxr;
 };
 
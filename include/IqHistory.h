@@ -0,0 +1,102 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_IQHISTORY_H
+#define SOFTFM_IQHISTORY_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "IqRecorder.h"
+#include "SoftFM.h"
+
+// In-memory history ("time machine") of the last N seconds of IF samples.
+//
+// The samples are stored into a preallocated ring buffer,
+// which costs only a copy of each block.
+// On a trigger event the ring buffer is swapped with a preallocated spare
+// one, and the history is written to a file in the chronological order
+// by a background writer thread, so that the caller never allocates
+// memory, copies the history, or waits for the file I/O.
+// The history restarts empty after each dump.
+
+class IqHistory {
+public:
+  // Construct IQ history buffer.
+  //
+  // seconds     :: history length in seconds
+  // sample_rate :: sample rate in Hz
+  // frequency   :: center frequency in Hz (for the dump metadata)
+  // format      :: sample format of the dump files
+  IqHistory(double seconds, double sample_rate, double frequency,
+            IqRecorder::Format format);
+
+  // Finish the dump in progress and stop the writer thread.
+  ~IqHistory();
+
+  // Store samples into the history, overwriting the oldest ones.
+  void push(const IQSampleVector &samples);
+
+  // Dump the history to the file in the background.
+  // Return false if the previous dump is still in progress,
+  // or if no samples are stored.
+  // Errors of the file I/O are shown as warnings by the writer thread.
+  bool dump(const std::string &filename);
+
+  // Return the last error, or return an empty string if there is no error.
+  std::string error() {
+    std::string ret(m_error);
+    m_error.clear();
+    return ret;
+  }
+
+  // Return the number of samples stored in the history.
+  std::size_t size() const { return m_fill; }
+
+private:
+  // Writer thread.
+  void run();
+
+  // Write the swapped out history to the file.
+  void write_dump(const std::string &filename);
+
+  IQSampleVector m_ring;
+  std::size_t m_pos;
+  std::size_t m_fill;
+  const double m_sample_rate;
+  const double m_frequency;
+  const IqRecorder::Format m_format;
+  std::string m_error;
+
+  // History being dumped, accessed only by the writer thread
+  // while m_dumping is true.
+  IQSampleVector m_dump_ring;
+  std::size_t m_dump_pos;
+  std::size_t m_dump_fill;
+  std::string m_dump_filename;
+  bool m_dumping;
+  bool m_stop;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,138 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_IQRECORDER_H
+#define SOFTFM_IQRECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SoftFM.h"
+
+// IQ sample recorder for the IF signal.
+//
+// Samples are copied into a preallocated bounded ring buffer
+// and written to the file by a background writer thread.
+// When the ring buffer is full, the incoming block is dropped and counted
+// so that a slow disk never blocks the DSP thread.
+
+class IqRecorder {
+public:
+  // Sample formats of the IQ file.
+  enum class Format {
+    CF32, // 32-bit float little-endian I/Q pairs
+    CS16  // 16-bit signed integer little-endian I/Q pairs
+  };
+
+  // Construct IQ recorder and start the writer thread.
+  //
+  // filename       :: output file name
+  //                   (SigMF metadata is also written to
+  //                    <basename>.sigmf-meta if it ends with .sigmf-data)
+  // format         :: sample format
+  // sample_rate    :: sample rate in Hz
+  // frequency      :: center frequency in Hz
+  // buffer_samples :: ring buffer capacity in samples
+  IqRecorder(const std::string &filename, Format format, double sample_rate,
+             double frequency, std::size_t buffer_samples);
+
+  // Close the recorder.
+  ~IqRecorder();
+
+  // Write the remaining samples, stop the writer thread, and close the file.
+  void close();
+
+  // Copy samples into the ring buffer, or drop all of them
+  // if the ring buffer does not have enough space.
+  // This function never waits for the file I/O.
+  void push(const IQSampleVector &samples);
+
+  // Same as above, for n samples from the pointer.
+  void push(const IQSample *samples, std::size_t n);
+
+  // Copy n samples into the ring buffer, waiting for the space.
+  // Only for the producers which may wait for the file I/O.
+  // Return false if the samples can not be written.
+  bool push_wait(const IQSample *samples, std::size_t n);
+
+  // Return the number of samples waiting to be written.
+  std::size_t queued_samples();
+
+  // Return the last error, or return an empty string if there is no error.
+  std::string error() const;
+
+  // Return true if the recorder is OK, return false if there is an error.
+  operator bool() const { return m_error.empty() && !m_write_error.load(); }
+
+  // Return the number of dropped blocks.
+  std::uint64_t get_dropped_blocks() const { return m_dropped_blocks; }
+
+  // Return the number of dropped samples.
+  std::uint64_t get_dropped_samples() const { return m_dropped_samples; }
+
+  // Return the number of samples written to the file.
+  std::uint64_t get_written_samples() const { return m_written_samples; }
+
+  // Parse format name ("cf32" or "cs16").
+  // Return true if successful.
+  static bool parse_format(const std::string &name, Format &format);
+
+  // Return format name.
+  static const char *format_name(Format format);
+
+private:
+  // Write SigMF metadata file.
+  bool write_sigmf_meta(const std::string &filename, double sample_rate,
+                        double frequency);
+
+  // Encode samples into m_bytebuf as little-endian data.
+  void encode_samples(const IQSample *samples, std::size_t n);
+
+  // Writer thread.
+  void run();
+
+  const Format m_format;
+  std::FILE *m_file;
+  std::string m_error;
+  std::atomic_bool m_write_error;
+
+  // Ring buffer.
+  IQSampleVector m_ring;
+  std::size_t m_read_pos;
+  std::size_t m_fill;
+  bool m_stop;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::thread m_thread;
+
+  // Used by the writer thread only.
+  std::vector<std::uint8_t> m_bytebuf;
+
+  // Statistics.
+  std::uint64_t m_dropped_blocks;
+  std::uint64_t m_dropped_samples;
+  std::atomic<std::uint64_t> m_written_samples;
+};
+
+#endif
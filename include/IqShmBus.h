@@ -0,0 +1,108 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_IQSHMBUS_H
+#define SOFTFM_IQSHMBUS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "SoftFM.h"
+
+// Shared-memory IQ bus for sharing one SDR between processes.
+//
+// The publisher process owns the Source and copies every received block
+// into a ring buffer in a POSIX shared memory object.
+// The consumer processes read the ring buffer through ShmSource.
+//
+// The total number of the written samples works as the sequence number.
+// The publisher advances write_reserve before overwriting the ring buffer,
+// and advances write_count after the samples are written.
+// A consumer detects overwritten (lost) samples by comparing
+// its read position with write_reserve after the copy.
+
+// Layout of the shared memory object; the ring buffer of IQSample follows.
+struct IqShmHeader {
+  static constexpr std::uint32_t magic_value = 0x51534d46; // "FMSQ"
+  static constexpr std::uint32_t version_value = 1;
+
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t sample_rate;
+  std::uint32_t frequency;
+  std::uint32_t configured_frequency;
+  std::uint32_t low_if;
+  std::uint64_t capacity;
+  // Total number of samples being written.
+  std::atomic<std::uint64_t> write_reserve;
+  // Total number of samples written.
+  std::atomic<std::uint64_t> write_count;
+  // Nonzero when the publisher has stopped.
+  std::atomic<std::uint32_t> closed;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "IqShmHeader requires lock-free 64-bit atomics");
+
+// Publisher of the shared-memory IQ bus.
+class IqShmPublisher {
+public:
+  // Create the shared memory object.
+  //
+  // name                 :: POSIX shared memory name (e.g., "/fmradion")
+  // sample_rate          :: sample rate of the source in Hz
+  // frequency            :: device center frequency in Hz
+  // configured_frequency :: configured center frequency in Hz
+  // low_if               :: true if the source is Low-IF
+  // capacity             :: ring buffer capacity in samples
+  IqShmPublisher(const std::string &name, std::uint32_t sample_rate,
+                 std::uint32_t frequency, std::uint32_t configured_frequency,
+                 bool low_if, std::size_t capacity);
+
+  // Mark the bus closed and remove the shared memory object.
+  ~IqShmPublisher();
+
+  // Copy samples into the ring buffer and advance the sequence number.
+  // This function never blocks.
+  void publish(const IQSampleVector &samples);
+
+  // Return the last error, or return an empty string if there is no error.
+  std::string error() {
+    std::string ret(m_error);
+    m_error.clear();
+    return ret;
+  }
+
+  // Return true if the bus is OK, return false if there is an error.
+  operator bool() const { return m_header != nullptr && m_error.empty(); }
+
+  // Return the size of the shared memory object in bytes.
+  static std::size_t shm_size(std::size_t capacity) {
+    return sizeof(IqShmHeader) + capacity * sizeof(IQSample);
+  }
+
+private:
+  std::string m_name;
+  std::string m_error;
+  std::size_t m_size;
+  IqShmHeader *m_header;
+  IQSample *m_ring;
+};
+
+#endif
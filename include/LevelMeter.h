@@ -0,0 +1,138 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SOFTFM_LEVELMETER_H
+#define SOFTFM_LEVELMETER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "SoftFM.h"
+
+// Streaming level meter of mean, RMS, and peak values.
+//
+// The values are accumulated inside the loop of an existing stage,
+// such as a type conversion or a gain adjustment,
+// so that no extra pass over the block and no allocation is needed.
+// The block functions accumulate into four partial sums in turn,
+// as the FIR kernels do, so that the additions do not wait for
+// each other, and fold them into the members once per block.
+
+class LevelMeter {
+public:
+  // Number of partial sums of the block functions.
+  static constexpr unsigned int lanes = 4;
+
+  LevelMeter() : m_sum(0), m_sum_sq(0), m_peak(0), m_count(0) {}
+
+  // Clear the accumulated values.
+  void reset() { *this = LevelMeter(); }
+
+  // Convert float samples to double and measure them in one pass.
+  inline void convert(const IQSampleDecodedVector &samples_in,
+                      SampleVector &samples_out) {
+    std::size_t n = samples_in.size();
+    samples_out.resize(n);
+    const IQSampleDecoded *x = samples_in.data();
+    Sample *y = samples_out.data();
+    Partial p;
+    std::size_t blocks = n / lanes;
+    for (std::size_t b = 0; b < blocks; b++) {
+      for (unsigned int l = 0; l < lanes; l++) {
+        std::size_t i = b * lanes + l;
+        Sample v = x[i];
+        y[i] = v;
+        p.add(l, v);
+      }
+    }
+    for (std::size_t i = blocks * lanes; i < n; i++) {
+      Sample v = x[i];
+      y[i] = v;
+      p.add(0, v);
+    }
+    fold(p, n);
+  }
+
+  // Measure samples and multiply them by the gain in one pass.
+  // The samples are measured before the gain is applied.
+  inline void adjust_gain(SampleVector &samples, double gain) {
+    std::size_t n = samples.size();
+    Sample *x = samples.data();
+    Partial p;
+    std::size_t blocks = n / lanes;
+    for (std::size_t b = 0; b < blocks; b++) {
+      for (unsigned int l = 0; l < lanes; l++) {
+        std::size_t i = b * lanes + l;
+        Sample v = x[i];
+        p.add(l, v);
+        x[i] = v * gain;
+      }
+    }
+    for (std::size_t i = blocks * lanes; i < n; i++) {
+      Sample v = x[i];
+      p.add(0, v);
+      x[i] = v * gain;
+    }
+    fold(p, n);
+  }
+
+  // Return the number of accumulated samples.
+  std::size_t count() const { return m_count; }
+
+  // Return the mean value.
+  float mean() const { return m_count > 0 ? m_sum / m_count : 0; }
+
+  // Return the RMS value.
+  float rms() const { return m_count > 0 ? std::sqrt(m_sum_sq / m_count) : 0; }
+
+  // Return the peak absolute value.
+  float peak() const { return m_peak; }
+
+private:
+  // Partial sums of a block.
+  struct Partial {
+    double sum[lanes] = {};
+    double sum_sq[lanes] = {};
+    double peak[lanes] = {};
+
+    inline void add(unsigned int l, double v) {
+      sum[l] += v;
+      sum_sq[l] += v * v;
+      peak[l] = std::max(peak[l], std::fabs(v));
+    }
+  };
+
+  // Fold the partial sums of a block of n samples into the members.
+  inline void fold(const Partial &p, std::size_t n) {
+    static_assert(lanes == 4, "fold() sums four lanes");
+    m_sum += (p.sum[0] + p.sum[1]) + (p.sum[2] + p.sum[3]);
+    m_sum_sq += (p.sum_sq[0] + p.sum_sq[1]) + (p.sum_sq[2] + p.sum_sq[3]);
+    m_peak = std::max(m_peak, std::max(std::max(p.peak[0], p.peak[1]),
+                                       std::max(p.peak[2], p.peak[3])));
+    m_count += n;
+  }
+
+  double m_sum;
+  double m_sum_sq;
+  double m_peak;
+  std::size_t m_count;
+};
+
+#endif
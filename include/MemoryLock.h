@@ -0,0 +1,57 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_MEMORYLOCK_H
+#define SOFTFM_MEMORYLOCK_H
+
+#include <cstddef>
+#include <string>
+
+// Memory locking and prefaulting for the real-time processing.
+//
+// The sample blocks passed between the threads are allocated
+// in advance by DataBuffer::reserve_blocks() and reused,
+// and the decoder scratch buffers are kept and reused for every block,
+// so that the main loop allocates no memory once running.
+// Locking all the memory keeps those buffers from being paged out.
+
+class MemoryLock {
+public:
+  // Size of the stack to prefault in bytes.
+  static constexpr std::size_t stack_bytes = 256 * 1024;
+
+  // Page fault counts.
+  struct PageFaults {
+    long minor;
+    long major;
+  };
+
+  // Prefault the stack of the calling thread,
+  // then lock all the current and future memory of the process.
+  // Return false with the error message if locking fails.
+  static bool lock(std::string &error);
+
+  // Return the page faults of the process.
+  static PageFaults process_page_faults();
+
+  // Return the page faults of the calling thread,
+  // or those of the process if not available.
+  static PageFaults thread_page_faults();
+};
+
+#endif
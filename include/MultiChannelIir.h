@@ -0,0 +1,252 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef SOFTFM_MULTICHANNELIIR_H
+#define SOFTFM_MULTICHANNELIIR_H
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "Filter.h"
+#include "SoftFM.h"
+
+// Cascade of IIR filter sections for independent channels
+// processed side by side.
+//
+// Each section processes the whole block before the next one.
+// The innermost loop runs over the channels with no dependency
+// between them, so the recursions of the channels are independent
+// instructions which overlap in the pipeline.
+// Each section is in the transposed direct form II.
+//
+// Channels :: number of channels
+
+template <unsigned int Channels> class MultiChannelIir {
+public:
+  static_assert(Channels >= 1, "MultiChannelIir needs one or more channels");
+
+  // Construct the cascade of the given number of sections,
+  // all of which pass the signal as is until set.
+  explicit MultiChannelIir(unsigned int sections)
+      : m_sections(sections), m_skip_step(4 * sections * sections),
+        m_skip_temp(4 * sections * sections), m_skip_state(2 * sections) {
+    for (auto &s : m_sections) {
+      for (unsigned int c = 0; c < Channels; c++) {
+        s.set(c, IirBiquad::identity());
+        s.z1[c] = 0;
+        s.z2[c] = 0;
+      }
+    }
+  }
+
+  // Set the coefficients of a section for a channel.
+  void set_section(unsigned int section, unsigned int channel,
+                   const IirBiquad &biquad) {
+    assert(section < m_sections.size() && channel < Channels);
+    m_sections[section].set(channel, biquad);
+  }
+
+  // Process interleaved samples in-place.
+  // samples :: frames of Channels samples
+  void process_interleaved_inplace(Sample *samples, unsigned int frames) {
+    for (auto &s : m_sections) {
+      Sample z1[Channels], z2[Channels];
+      for (unsigned int c = 0; c < Channels; c++) {
+        z1[c] = s.z1[c];
+        z2[c] = s.z2[c];
+      }
+      Sample *x = samples;
+      for (unsigned int i = 0; i < frames; i++, x += Channels) {
+        for (unsigned int c = 0; c < Channels; c++) {
+          Sample in = x[c];
+          Sample out = s.b0[c] * in + z1[c];
+          z1[c] = s.b1[c] * in - s.a1[c] * out + z2[c];
+          z2[c] = s.b2[c] * in - s.a2[c] * out;
+          x[c] = out;
+        }
+      }
+      for (unsigned int c = 0; c < Channels; c++) {
+        s.z1[c] = z1[c];
+        s.z2[c] = z2[c];
+      }
+    }
+  }
+
+  // Process interleaved samples in-place.
+  void process_interleaved_inplace(SampleVector &samples) {
+    assert(samples.size() % Channels == 0);
+    process_interleaved_inplace(samples.data(), samples.size() / Channels);
+  }
+
+  // Process separate channel buffers of n samples each,
+  // without copying them into frames.
+  // samples_in  :: input of each channel,
+  //                or nullptr to skip the channel
+  // samples_out :: output of each channel (may be the same as the input),
+  //                or nullptr for a skipped channel
+  // A skipped channel is not processed, and its state is advanced
+  // as if n zero samples were input.
+  void process(const Sample *const samples_in[Channels],
+               Sample *const samples_out[Channels], unsigned int n) {
+    bool all_channels = true;
+    for (unsigned int c = 0; c < Channels; c++) {
+      assert((samples_in[c] == nullptr) == (samples_out[c] == nullptr));
+      if (samples_in[c] == nullptr) {
+        all_channels = false;
+      }
+    }
+    if (all_channels) {
+      process_channels<Channels>(samples_in, samples_out, n);
+      return;
+    }
+    for (unsigned int c = 0; c < Channels; c++) {
+      if (samples_in[c] == nullptr) {
+        skip_channel(c, n);
+      } else {
+        process_channels<1>(&samples_in[c], &samples_out[c], n, c);
+      }
+    }
+  }
+
+private:
+  // Process Count channels from the first channel
+  // in the separate buffers.
+  template <unsigned int Count>
+  void process_channels(const Sample *const samples_in[Count],
+                        Sample *const samples_out[Count], unsigned int n,
+                        unsigned int first = 0) {
+    const Sample *in[Count];
+    for (unsigned int k = 0; k < Count; k++) {
+      in[k] = samples_in[k];
+    }
+    for (auto &s : m_sections) {
+      Sample b0[Count], b1[Count], b2[Count], a1[Count], a2[Count];
+      Sample z1[Count], z2[Count];
+      for (unsigned int k = 0; k < Count; k++) {
+        unsigned int c = first + k;
+        b0[k] = s.b0[c];
+        b1[k] = s.b1[c];
+        b2[k] = s.b2[c];
+        a1[k] = s.a1[c];
+        a2[k] = s.a2[c];
+        z1[k] = s.z1[c];
+        z2[k] = s.z2[c];
+      }
+      for (unsigned int i = 0; i < n; i++) {
+        for (unsigned int k = 0; k < Count; k++) {
+          Sample x = in[k][i];
+          Sample y = b0[k] * x + z1[k];
+          z1[k] = b1[k] * x - a1[k] * y + z2[k];
+          z2[k] = b2[k] * x - a2[k] * y;
+          samples_out[k][i] = y;
+        }
+      }
+      for (unsigned int k = 0; k < Count; k++) {
+        s.z1[first + k] = z1[k];
+        s.z2[first + k] = z2[k];
+      }
+      // The following sections process the output in-place.
+      for (unsigned int k = 0; k < Count; k++) {
+        in[k] = samples_out[k];
+      }
+    }
+  }
+
+  // Coefficients and states of a section, stored per channel.
+  struct Section {
+    Sample b0[Channels], b1[Channels], b2[Channels];
+    Sample a1[Channels], a2[Channels];
+    Sample z1[Channels], z2[Channels];
+
+    void set(unsigned int c, const IirBiquad &biquad) {
+      b0[c] = biquad.b0;
+      b1[c] = biquad.b1;
+      b2[c] = biquad.b2;
+      a1[c] = biquad.a1;
+      a2[c] = biquad.a2;
+    }
+  };
+
+  // Advance the states of a channel by n zero input samples.
+  // With zero input, the states (z1, z2) of all the sections are
+  // multiplied by a constant matrix per sample,
+  // so the n-th power of the matrix is applied by repeated squaring.
+  void skip_channel(unsigned int c, unsigned int n) {
+    const unsigned int dim = 2 * m_sections.size();
+    // Column j is the states after a sample from the j-th unit states.
+    std::vector<Sample> &step = m_skip_step;
+    for (unsigned int j = 0; j < dim; j++) {
+      Sample x = 0;
+      for (unsigned int k = 0; k < m_sections.size(); k++) {
+        const Section &s = m_sections[k];
+        Sample z1 = (j == 2 * k) ? 1 : 0;
+        Sample z2 = (j == 2 * k + 1) ? 1 : 0;
+        Sample y = s.b0[c] * x + z1;
+        step[(2 * k) * dim + j] = s.b1[c] * x - s.a1[c] * y + z2;
+        step[(2 * k + 1) * dim + j] = s.b2[c] * x - s.a2[c] * y;
+        x = y;
+      }
+    }
+    std::vector<Sample> &state = m_skip_state;
+    std::vector<Sample> &temp = m_skip_temp;
+    for (unsigned int k = 0; k < m_sections.size(); k++) {
+      state[2 * k] = m_sections[k].z1[c];
+      state[2 * k + 1] = m_sections[k].z2[c];
+    }
+    while (n > 0) {
+      if (n & 1) {
+        for (unsigned int i = 0; i < dim; i++) {
+          Sample sum = 0;
+          for (unsigned int j = 0; j < dim; j++) {
+            sum += step[i * dim + j] * state[j];
+          }
+          temp[i] = sum;
+        }
+        std::copy(temp.begin(), temp.begin() + dim, state.begin());
+      }
+      n >>= 1;
+      if (n > 0) {
+        for (unsigned int i = 0; i < dim; i++) {
+          for (unsigned int j = 0; j < dim; j++) {
+            Sample sum = 0;
+            for (unsigned int k = 0; k < dim; k++) {
+              sum += step[i * dim + k] * step[k * dim + j];
+            }
+            temp[i * dim + j] = sum;
+          }
+        }
+        step.swap(temp);
+      }
+    }
+    for (unsigned int k = 0; k < m_sections.size(); k++) {
+      m_sections[k].z1[c] = state[2 * k];
+      m_sections[k].z2[c] = state[2 * k + 1];
+    }
+  }
+
+  std::vector<Section> m_sections;
+
+  // Work area of skip_channel(), allocated at construction.
+  std::vector<Sample> m_skip_step;
+  std::vector<Sample> m_skip_temp;
+  std::vector<Sample> m_skip_state;
+};
+
+#endif
@@ -20,6 +20,9 @@
 #ifndef SOFTFM_MULTIPATHFILTER_H
 #define SOFTFM_MULTIPATHFILTER_H
 
+#include <cstdint>
+#include <vector>
+
 #include "SoftFM.h"
 
 // MfCoeff = IQSample
@@ -31,6 +34,15 @@ using MfCoeffVector = volk::vector<MfCoeff>;
 
 class MultipathFilter {
 public:
+  // Coefficient adaptation algorithm.
+  // Nlms         :: Normalized LMS, one step size for all taps.
+  // Ipnlms       :: Improved Proportionate NLMS, the step size of each tap
+  //                 is weighted by its magnitude, which converges faster
+  //                 for sparse echoes.
+  // IpnlmsSparse :: Ipnlms, updating only the taps above prune_threshold
+  //                 between the periodic full updates.
+  enum class Algorithm { Nlms, Ipnlms, IpnlmsSparse };
+
   // IF AGC target level is 1.0
   // Note: this constant is for memorandum use only,
   // and the actual code ASSUMES the reference level is 1.0.
@@ -42,10 +54,36 @@ public:
   // to maintain the filter convergence.
   static constexpr double alpha = 0.1;
 
+  // Coefficient update intervals in samples, from the full rate.
+  // The interval is lengthened while the error is small and stable,
+  // and shortened back to the full rate on an error spike.
+  static constexpr unsigned int update_interval_levels = 4;
+  static constexpr unsigned int update_intervals[update_interval_levels] = {
+      4, 8, 16, 64};
+  // Number of updates with a stable error to lengthen the interval.
+  static constexpr unsigned int stable_updates = 8192;
+  // Maximum slowly averaged error magnitude regarded as stable.
+  static constexpr float stable_error = 0.15;
+  // Fast averaged error magnitude over the slowly averaged one
+  // plus this margin is regarded as a spike.
+  static constexpr float spike_margin = 0.05;
+
+  // IPNLMS proportionality, from -1 (same as NLMS) to 1 (PNLMS).
+  static constexpr float ipnlms_alpha = 0;
+  // IPNLMS regularization of the coefficient L1 norm.
+  static constexpr float ipnlms_epsilon = 1.0e-3;
+  // Taps with the magnitude below this ratio to the largest tap
+  // are not updated between the full updates in IpnlmsSparse.
+  static constexpr float prune_threshold = 0.02;
+  // Number of updates between the full updates in IpnlmsSparse.
+  static constexpr unsigned int prune_refresh = 64;
+
   // Construct multipath filter.
   // Note: the reference level is fixed to 1.0.
-  // stages :: number of filter stages
-  MultipathFilter(unsigned int stages);
+  // stages    :: number of filter stages
+  // algorithm :: coefficient adaptation algorithm
+  MultipathFilter(unsigned int stages,
+                  Algorithm algorithm = Algorithm::Nlms);
 
   // Initialize filter coefficients.
   void initialize_coefficients();
@@ -60,8 +98,32 @@ public:
   // Obtain the latest error value.
   const double get_error() const { return m_error; }
 
+  // Obtain the current coefficient update interval in samples.
+  unsigned int get_update_interval() const {
+    return update_intervals[m_interval_level];
+  }
+
+  // Obtain the number of processed samples
+  // and the thread CPU time in seconds spent for them,
+  // for each update interval level.
+  const std::uint64_t *get_level_samples() const { return m_level_samples; }
+  const double *get_level_cpu_time() const { return m_level_cpu_time; }
+
   // Obtain the internal filter coefficient.
-  const MfCoeffVector &get_coefficients() { return m_coeff; }
+  const MfCoeffVector &get_coefficients() const { return m_coeff; }
+
+  // Obtain the coefficient adaptation algorithm.
+  Algorithm get_algorithm() const { return m_algorithm; }
+
+  // Obtain the number of taps updated between the full updates
+  // (equals to the filter order unless pruned in IpnlmsSparse).
+  unsigned int get_active_taps() const {
+    return m_active_taps.empty() ? m_filter_order : m_active_taps.size();
+  }
+
+  // Set the filter coefficients.
+  // Return false if the number of coefficients does not match.
+  bool set_coefficients(const MfCoeffVector &coeff);
 
   // Obtain the referenct point level value.
   // Initial value is 1.0.
@@ -76,14 +138,52 @@ private:
   // Update coefficient.
   inline void update_coeff(const IQSample result);
 
+  // Update coefficient by IPNLMS.
+  inline void update_coeff_proportionate(const IQSample result);
+
+  // Update the interval level from the latest error.
+  inline void schedule_update(const double error);
+
   // Data members.
   const unsigned int m_stages;
+  const Algorithm m_algorithm;
   const unsigned int m_index_reference_point;
   const unsigned int m_filter_order;
   float m_mu;
   MfCoeffVector m_coeff;
+  // Input state of twice the filter order, where each sample is written
+  // twice so that the last m_filter_order samples are always contiguous
+  // from m_state_window (the oldest first).
   MfCoeffVector m_state;
+  unsigned int m_state_pos;
+  const MfCoeff *m_state_window;
+  // Work buffer of the squared magnitudes of the state.
+  volk::vector<float> m_state_mag_sq;
+  // Running sum of the squared magnitudes of the state window.
+  double m_state_power;
   double m_error;
+
+  // Proportionate update.
+  // Work buffers of the coefficient magnitudes, the tap gains,
+  // and the state multiplied by the tap gains.
+  volk::vector<float> m_coeff_mag;
+  volk::vector<float> m_tap_gain;
+  MfCoeffVector m_weighted_state;
+  // Indexes of the taps to update between the full updates
+  // (empty when all taps are updated).
+  std::vector<unsigned int> m_active_taps;
+  // Sum of the magnitudes of the taps not in m_active_taps.
+  float m_pruned_mag_sum;
+  unsigned int m_prune_countdown;
+
+  // Adaptive update interval.
+  unsigned int m_interval_level;
+  unsigned int m_update_countdown;
+  unsigned int m_stable_count;
+  float m_error_fast;
+  float m_error_slow;
+  std::uint64_t m_level_samples[update_interval_levels];
+  double m_level_cpu_time[update_interval_levels];
 };
 
 #endif
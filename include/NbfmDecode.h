@@ -25,6 +25,7 @@
 #include "Filter.h"
 #include "FilterParameters.h"
 #include "IfAgc.h"
+#include "LevelMeter.h"
 #include "PhaseDiscriminator.h"
 #include "SoftFM.h"
 
@@ -55,15 +56,24 @@ public:
    */
   void process(const IQSampleVector &samples_in, SampleVector &audio);
 
+  /** Allocate the buffers for input blocks of up to n samples in advance. */
+  void reserve(std::size_t n);
+
   /** Return actual frequency offset in Hz with respect to receiver LO. */
   float get_tuning_offset() const { return m_baseband_mean * m_freq_dev; }
 
   /** Return RMS baseband signal level (where nominal level is 0.707). */
   float get_baseband_level() const { return m_baseband_level; }
 
+  // Return the mean, RMS, and peak levels of the last baseband block.
+  const LevelMeter &get_baseband_meter() const { return m_baseband_meter; }
+
   // Return RMS IF level.
   float get_if_rms() const { return m_if_rms; }
 
+  // Return the processing cost of the FIR filter stages.
+  std::vector<FilterStageCost> get_filter_costs() const;
+
 private:
   // Data members.
   const IQSampleCoeff &m_nbfmfilter_coeff;
@@ -71,6 +81,7 @@ private:
   float m_baseband_mean;
   float m_baseband_level;
   float m_if_rms;
+  LevelMeter m_baseband_meter;
 
   IQSampleVector m_buf_filtered;
   IQSampleVector m_samples_in_after_agc;
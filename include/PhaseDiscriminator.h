@@ -25,7 +25,13 @@
 
 #include "SoftFM.h"
 
-/* Detect frequency by phase discrimination between successive samples. */
+/* Detect frequency by phase discrimination between successive samples.
+ *
+ * The phase difference is computed as arg(x[n] * conj(x[n-1]))
+ * in a single pass, without an intermediate phase buffer.
+ * The difference is always within +/- pi, which is the same as
+ * unwrapping the difference of the absolute phases at the boundary.
+ */
 class PhaseDiscriminator {
 public:
   /**
@@ -45,10 +51,15 @@ public:
                IQSampleDecodedVector &samples_out);
 
 private:
+  // Return atan2(y, x) by a polynomial without branches,
+  // with the max error of 1.4e-7 radian.
+  static inline float fast_atan2(float y, float x);
+
   const Sample m_normalize_factor;
-  const float m_boundary;
-  float m_save_value;
-  volk::vector<float> m_phase;
+  // Scaling factor from radian to the output value.
+  const float m_scale;
+  // The last input sample of the previous block.
+  IQSample m_last_sample;
 };
 
 #endif
@@ -0,0 +1,120 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_PIPESOURCE_H
+#define SOFTFM_PIPESOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Source.h"
+
+class PipeSource : public Source {
+public:
+  static constexpr int default_block_length = 16384;
+  static constexpr std::uint32_t default_sample_rate = 384000;
+  static constexpr std::int32_t default_frequency = 82500000;
+
+  /** poll() timeout in milliseconds to check the stop flag */
+  static constexpr int poll_timeout_ms = 100;
+
+  /** Constructor */
+  PipeSource(int dev_index);
+
+  /** Destructor */
+  virtual ~PipeSource() override;
+
+  /** Configure and prepare for streaming from stdin or FIFO. */
+  virtual bool configure(std::string configuration) override;
+
+  /** Return current sample frequency in Hz. */
+  virtual std::uint32_t get_sample_rate() override;
+
+  /** Return device current center frequency in Hz. */
+  virtual std::uint32_t get_frequency() override;
+
+  /** Return if device is using Low-IF. */
+  virtual bool is_low_if() override;
+
+  /** Return the block length. */
+  virtual std::size_t get_max_block_length() const override {
+    return m_block_length;
+  }
+
+  /** Print current parameters specific to device type */
+  virtual void print_specific_parms() override;
+
+  virtual bool start(DataBuffer<IQSample> *samples,
+                     std::atomic_bool *stop_flag) override;
+  virtual bool stop() override;
+
+  /** Return true if the pipe is OK, return false if there is an error. */
+  virtual operator bool() const override { return m_error.empty(); }
+
+  /** Return a list of supported devices. */
+  static void get_device_names(std::vector<std::string> &devices);
+
+private:
+  enum class FormatType { CU8, CS8, CS16, CF32 };
+
+  /**
+   * Configure pipe for streaming.
+   *
+   * fname        :: file name of FIFO, or "-" for stdin.
+   * format_type  :: CU8, CS8, CS16, or CF32 (all little-endian).
+   * sample_rate  :: sample rate in Hz.
+   * frequency    :: center frequency in Hz.
+   * zero_offset  :: true if sample contain zero offset.
+   * block_length :: number of samples per block.
+   *
+   * Return true for success, false if an error occurred.
+   */
+  bool configure(std::string fname, FormatType format_type,
+                 std::uint32_t sample_rate, std::uint32_t frequency,
+                 bool zero_offset, int block_length);
+
+  /**
+   * Read exactly size bytes unless the end of stream is reached.
+   * Return the number of bytes read, or -1 if stopped or an error occurred.
+   */
+  static long read_fully(std::uint8_t *buf, std::size_t size);
+
+  /** Convert n samples in m_bytebuf into samples. */
+  static void convert(IQSampleVector &samples, std::size_t n);
+
+  static void run();
+
+  std::uint32_t m_sample_rate;
+  std::uint32_t m_frequency;
+  bool m_zero_offset;
+  int m_block_length;
+  FormatType m_format_type;
+  std::size_t m_sample_size;
+  std::string m_format_name;
+
+  int m_fd;
+  std::vector<std::uint8_t> m_bytebuf;
+
+  static PipeSource *m_this;
+
+  std::thread *m_thread;
+};
+
+#endif /* SOFTFM_PIPESOURCE_H */
@@ -0,0 +1,150 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_RDSDECODE_H
+#define SOFTFM_RDSDECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SoftFM.h"
+
+// RDS/RBDS decoder for the 57kHz subcarrier of the FM MPX signal.
+//
+// The subcarrier is mixed down to the complex baseband by the
+// 57kHz carrier derived from the locked 19kHz pilot (3rd harmonic),
+// then filtered and decimated by a polyphase FIR filter,
+// then demodulated as biphase-coded differential BPSK at 1187.5bps.
+
+class RdsDecoder {
+public:
+  // Input sampling rate (same as FmDecoder::sample_rate_if).
+  static constexpr double sample_rate_if = 384000;
+  // Decimation ratio of the polyphase filter.
+  static constexpr unsigned int decimation = 16;
+  // Internal sampling rate after decimation.
+  static constexpr double sample_rate_rds = sample_rate_if / decimation;
+  // RDS bit rate (57kHz / 48).
+  static constexpr double bit_rate = 1187.5;
+  // Number of taps of the decimation filter.
+  static constexpr unsigned int filter_taps = 192;
+
+  // A decoded RDS group.
+  struct Group {
+    // Block A, B, C (or C'), and D.
+    std::uint16_t blocks[4];
+    // Index of the input sample where the last bit of the group ends.
+    std::uint64_t sample_index;
+  };
+
+  // Construct RDS decoder.
+  RdsDecoder();
+
+  // Process MPX baseband samples.
+  // samples_in  :: MPX baseband signal at sample_rate_if,
+  //                before deemphasis.
+  // carrier     :: exp(-j * 57kHz phase) generated by PilotPhaseLock,
+  //                of the same length as samples_in.
+  void process(const SampleVector &samples_in, const IQSampleVector &carrier);
+
+  // Allocate the buffers for input blocks of up to n samples in advance.
+  void reserve(std::size_t n);
+
+  // Return true if the block synchronization is established.
+  bool synced() const { return m_synced; }
+
+  // Return the groups decoded in the most recently processed block.
+  const std::vector<Group> &get_groups() const { return m_groups; }
+
+  // Return the last received PI code (0 if not received yet).
+  std::uint16_t get_pi() const { return m_pi; }
+
+  // Return the last fully received Program Service name.
+  const std::string &get_ps() const { return m_ps; }
+
+  // Return the last fully received RadioText.
+  const std::string &get_rt() const { return m_rt; }
+
+private:
+  // Create decimation lowpass filter coefficients.
+  void design_filter();
+
+  // Process a matched filter output and recover the bit clock.
+  inline void recover_bits();
+
+  // Process a differentially decoded bit.
+  inline void process_bit(unsigned int bit);
+
+  // Process a group.
+  inline void process_group();
+
+  // Compute the 10-bit syndrome of a 26-bit block.
+  static inline unsigned int syndrome(std::uint32_t block);
+
+  // Decimation filter.
+  std::vector<float> m_coeff;
+  IQSampleVector m_history;
+  IQSampleVector m_decimated;
+  unsigned int m_decim_pos;
+
+  // Carrier phase estimation by squaring.
+  IQSample m_sq_average;
+
+  // Matched filter of the biphase symbol.
+  std::vector<float> m_mf_delay;
+  unsigned int m_mf_index;
+  float m_mf_sum_first;
+  float m_mf_sum_second;
+  std::vector<float> m_mf_out;
+
+  // Bit clock recovery.
+  double m_bit_phase;
+  float m_energy_ontime;
+  float m_energy_halfway;
+  unsigned int m_prev_symbol;
+
+  // Block synchronization.
+  std::uint32_t m_shift_reg;
+  unsigned int m_bit_count;
+  bool m_synced;
+  unsigned int m_sync_candidate_offset;
+  unsigned int m_sync_candidate_bit;
+  bool m_sync_candidate;
+  unsigned int m_block_index;
+  unsigned int m_bad_blocks;
+  std::uint16_t m_group_blocks[4];
+  unsigned int m_group_valid;
+
+  // Sample counters.
+  std::uint64_t m_sample_cnt;
+  std::uint64_t m_decimated_cnt;
+
+  // Decoded data.
+  std::vector<Group> m_groups;
+  std::uint16_t m_pi;
+  std::string m_ps_buf;
+  unsigned int m_ps_mask;
+  std::string m_ps;
+  std::string m_rt_buf;
+  unsigned int m_rt_mask;
+  int m_rt_ab_flag;
+  std::string m_rt;
+};
+
+#endif
@@ -0,0 +1,117 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_REALCONVERTERIQ_H
+#define SOFTFM_REALCONVERTERIQ_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "SoftFM.h"
+
+// Converting real samples at Fs to IQ samples at Fs/2.
+//
+// The Fs/4 downconversion by (+1, +j, -1, -j) is fused with
+// the 7-tap half-band decimation filter of
+// {tap3, 0, tap1, 0.5, tap1, 0, tap3}.
+// The mixed signal is real at even samples and imaginary at odd samples,
+// so I is the center tap times an even sample,
+// and Q is the other taps applied to the odd samples,
+// both with the sign of (-1)^m for the output index m.
+//
+// The DC offset of the ADC is removed as libairspy does for FLOAT32_IQ.
+// Instead of the per-sample one-pole filter of libairspy, which is
+// a serial dependency chain over all the input samples, the offset is
+// estimated by the integer sum of each block, smoothed over the blocks.
+// The Q taps are antisymmetric and have no DC gain,
+// so only I needs the correction.
+class RealConverterIQ {
+public:
+  // Same kernel as the libairspy float conversion filter in AirspySource.
+  static constexpr float tap1 = 0.281533904166905770;
+  static constexpr float tap3 = -0.031534955091398462;
+
+  // Number of preceding input samples kept for the filter.
+  static constexpr unsigned int history_length = 6;
+
+  // Smoothing factor of the DC offset per block.
+  static constexpr float dc_alpha = 0.05f;
+
+  // Construct real to IQ converter.
+  // scale : input sample scaling factor
+  RealConverterIQ(float scale)
+      : m_scale(scale), m_sign(1.0f), m_dc(0.0f), m_dc_valid(false),
+        m_buf(history_length, 0.0f) {
+    // do nothing
+  }
+
+  // Process signed 16-bit real samples.
+  // count must be even; count / 2 IQ samples are produced.
+  inline void process(const std::int16_t *samples_in, unsigned int count,
+                      IQSampleVector &samples_out) {
+    // Keep the last history_length samples at the front of the buffer,
+    // then append the new samples converted to float.
+    m_buf.resize(history_length + count);
+    volk_16i_s32f_convert_32f(m_buf.data() + history_length, samples_in,
+                              1.0f / m_scale, count);
+
+    // Estimate the DC offset from the block average.
+    if (count > 0) {
+      std::int64_t sum = 0;
+      for (unsigned int n = 0; n < count; n++) {
+        sum += samples_in[n];
+      }
+      float average = m_scale * static_cast<float>(sum) / count;
+      if (m_dc_valid) {
+        m_dc += dc_alpha * (average - m_dc);
+      } else {
+        m_dc = average;
+        m_dc_valid = true;
+      }
+    }
+    const float dc = m_dc;
+
+    const float *z = m_buf.data();
+    const unsigned int nout = count / 2;
+    float sign = m_sign;
+    samples_out.resize(nout);
+
+    // Output m is centered at z[4 + 2 * m],
+    // which needs z[1 + 2 * m] to z[7 + 2 * m].
+    for (unsigned int m = 0; m < nout; m++) {
+      const float *x = z + 4 + 2 * m;
+      float i = 0.5f * (x[0] - dc);
+      float q = tap1 * (x[1] - x[-1]) + tap3 * (x[-3] - x[3]);
+      samples_out[m] = IQSample(sign * i, sign * q);
+      sign = -sign;
+    }
+
+    m_sign = sign;
+    std::copy(m_buf.end() - history_length, m_buf.end(), m_buf.begin());
+  }
+
+private:
+  const float m_scale;
+  float m_sign;
+  float m_dc;
+  bool m_dc_valid;
+  std::vector<float> m_buf;
+};
+
+#endif
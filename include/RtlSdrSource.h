@@ -46,6 +46,11 @@ public:
   /** Return if device is using Low-IF. */
   virtual bool is_low_if() override;
 
+  /** Return the block length. */
+  virtual std::size_t get_max_block_length() const override {
+    return m_block_length;
+  }
+
   /** Print current parameters specific to device type */
   virtual void print_specific_parms() override;
 
@@ -97,6 +102,8 @@ private:
   std::vector<int> m_gains;
   std::string m_gainsStr;
   bool m_confAgc;
+  // Buffer of the samples read from the device.
+  std::vector<uint8_t> m_bytebuf;
   static RtlSdrSource *m_this;
 
   std::thread *m_thread;
@@ -0,0 +1,140 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_RTLTCPSOURCE_H
+#define SOFTFM_RTLTCPSOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Source.h"
+
+// Source for the rtl_tcp protocol over TCP or a Unix domain socket.
+class RtlTcpSource : public Source {
+public:
+  static constexpr int default_block_length = 65536;
+  static constexpr const char *default_host = "127.0.0.1";
+  static constexpr int default_port = 1234;
+  static constexpr std::uint32_t default_sample_rate = 1200000;
+  static constexpr std::uint32_t default_frequency = 100000000;
+
+  /** Socket receive buffer size in bytes. */
+  static constexpr int socket_buffer_size = 4 * 1024 * 1024;
+
+  /** poll() timeout in milliseconds to check the stop flag */
+  static constexpr int poll_timeout_ms = 100;
+
+  /** Constructor */
+  RtlTcpSource(int dev_index);
+
+  /** Destructor */
+  virtual ~RtlTcpSource() override;
+
+  /** Connect to the rtl_tcp server and prepare for streaming. */
+  virtual bool configure(std::string configuration) override;
+
+  /** Return current sample frequency in Hz. */
+  virtual std::uint32_t get_sample_rate() override;
+
+  /** Return device current center frequency in Hz. */
+  virtual std::uint32_t get_frequency() override;
+
+  /** Return if device is using Low-IF. */
+  virtual bool is_low_if() override;
+
+  /** Return the block length. */
+  virtual std::size_t get_max_block_length() const override {
+    return m_block_length;
+  }
+
+  /** Print current parameters specific to device type */
+  virtual void print_specific_parms() override;
+
+  virtual bool start(DataBuffer<IQSample> *samples,
+                     std::atomic_bool *stop_flag) override;
+  virtual bool stop() override;
+
+  /** Return true if the connection is OK, return false if there is an error. */
+  virtual operator bool() const override {
+    return m_fd >= 0 && m_error.empty();
+  }
+
+  /** Return a list of supported devices. */
+  static void get_device_names(std::vector<std::string> &devices);
+
+private:
+  // rtl_tcp command codes.
+  enum class Command : std::uint8_t {
+    SetFrequency = 0x01,
+    SetSampleRate = 0x02,
+    SetGainMode = 0x03,
+    SetGain = 0x04,
+    SetFreqCorrection = 0x05,
+    SetAgcMode = 0x08,
+    SetBiasTee = 0x0e
+  };
+
+  /**
+   * Connect to the server and configure the tuner.
+   *
+   * host         :: TCP host name or address.
+   * port         :: TCP port number.
+   * unix_path    :: Unix domain socket path (used if not empty).
+   * sample_rate  :: desired sample rate in Hz.
+   * frequency    :: desired center frequency in Hz.
+   * tuner_gain   :: desired tuner gain in 0.1dB, or INT_MIN for auto.
+   * ppm          :: frequency correction in ppm.
+   * block_length :: number of samples per block.
+   * agcmode      :: true to enable RTL AGC.
+   * antbias      :: true to enable antenna bias.
+   *
+   * Return true for success, false if an error occurred.
+   */
+  bool configure(const std::string &host, int port,
+                 const std::string &unix_path, std::uint32_t sample_rate,
+                 std::uint32_t frequency, int tuner_gain, int ppm,
+                 int block_length, bool agcmode, bool antbias);
+
+  /** Send a command. Return true for success. */
+  bool send_command(Command cmd, std::uint32_t param);
+
+  /** Receive exactly size bytes. Return false if stopped or failed. */
+  static bool recv_fully(std::uint8_t *buf, std::size_t size);
+
+  static void run();
+
+  int m_fd;
+  std::uint32_t m_sample_rate;
+  std::uint32_t m_frequency;
+  int m_tuner_gain;
+  int m_ppm;
+  int m_block_length;
+  bool m_agcmode;
+  std::uint32_t m_tuner_type;
+  std::uint32_t m_gain_count;
+
+  std::vector<std::uint8_t> m_bytebuf;
+
+  static RtlTcpSource *m_this;
+
+  std::thread *m_thread;
+};
+
+#endif /* SOFTFM_RTLTCPSOURCE_H */
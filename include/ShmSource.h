@@ -0,0 +1,96 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_SHMSOURCE_H
+#define SOFTFM_SHMSOURCE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IqShmBus.h"
+#include "Source.h"
+
+class ShmSource : public Source {
+public:
+  static constexpr int default_block_length = 65536;
+  static constexpr const char *default_name = "/airspy-fmradion";
+
+  /** Constructor */
+  ShmSource(int dev_index);
+
+  /** Destructor */
+  virtual ~ShmSource() override;
+
+  /** Configure and attach to the shared-memory IQ bus. */
+  virtual bool configure(std::string configuration) override;
+
+  /** Return current sample frequency in Hz. */
+  virtual std::uint32_t get_sample_rate() override;
+
+  /** Return device current center frequency in Hz. */
+  virtual std::uint32_t get_frequency() override;
+
+  /** Return if device is using Low-IF. */
+  virtual bool is_low_if() override;
+
+  /** Return the block length. */
+  virtual std::size_t get_max_block_length() const override {
+    return m_block_length;
+  }
+
+  /** Print current parameters specific to device type */
+  virtual void print_specific_parms() override;
+
+  virtual bool start(DataBuffer<IQSample> *samples,
+                     std::atomic_bool *stop_flag) override;
+  virtual bool stop() override;
+
+  /** Return true if the bus is OK, return false if there is an error. */
+  virtual operator bool() const override { return m_error.empty(); }
+
+  /** Return a list of supported devices. */
+  static void get_device_names(std::vector<std::string> &devices);
+
+private:
+  /**
+   * Attach to the shared-memory IQ bus.
+   *
+   * name         :: POSIX shared memory name of the publisher.
+   * block_length :: maximum number of samples per block.
+   *
+   * Return true for success, false if an error occurred.
+   */
+  bool configure(std::string name, int block_length);
+
+  static void run();
+
+  int m_block_length;
+  std::size_t m_size;
+  const IqShmHeader *m_header;
+  const IQSample *m_ring;
+  std::atomic<std::uint64_t> m_lost_samples;
+
+  static ShmSource *m_this;
+
+  std::thread *m_thread;
+};
+
+#endif /* SOFTFM_SHMSOURCE_H */
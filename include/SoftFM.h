@@ -36,9 +36,24 @@ using SampleVector = std::vector<Sample>;
 using IQSampleCoeff = std::vector<IQSample::value_type>;
 using SampleCoeff = std::vector<SampleVector::value_type>;
 
-enum class FilterType { Default, Medium, Narrow, Wide };
-enum class DevType { Airspy, AirspyHF, RTLSDR, FileSource };
+enum class FilterType { Default, Medium, Narrow, Wide, Designed };
+enum class DevType {
+  Airspy,
+  AirspyHF,
+  RTLSDR,
+  FileSource,
+  Shm,
+  Pipe,
+  RtlTcp
+};
 enum class ModType { FM, AM, DSB, USB, LSB, CW, NBFM };
-enum class OutputMode { RAW_INT16, RAW_FLOAT32, WAV, PORTAUDIO };
+enum class OutputMode {
+  RAW_INT16,
+  RAW_FLOAT32,
+  WAV,
+  ENCODER,
+  PORTAUDIO,
+  NETWORK
+};
 
 #endif
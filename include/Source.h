@@ -20,6 +20,7 @@
 #define INCLUDE_SOURCE_H_
 
 #include <atomic>
+#include <cstddef>
 #include <memory>
 #include <string>
 
@@ -45,6 +46,13 @@ public:
   /** Return if device is using Low-IF. */
   virtual bool is_low_if() = 0;
 
+  /**
+   * Return the maximum number of samples in a block pushed to the buffer,
+   * used to allocate the blocks in advance.
+   * The default is the block length of the Airspy devices.
+   */
+  virtual std::size_t get_max_block_length() const { return 65536; }
+
   /** Return current configured center frequency in Hz. */
   std::uint32_t get_configured_frequency() const { return m_confFreq; }
 
@@ -0,0 +1,81 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SOFTFM_THREADPOLICY_H
+#define SOFTFM_THREADPOLICY_H
+
+#include <string>
+#include <vector>
+
+// CPU affinity and scheduling policy of the threads by the role.
+//
+// The policy is configured once before the threads start,
+// and each thread applies the policy of its role to itself.
+// Threads created by a thread inherit its placement,
+// e.g., the USB transfer threads of the device libraries
+// created from the source thread.
+
+class ThreadPolicy {
+public:
+  // Thread roles.
+  enum class Role {
+    Source, // Device or stream reading thread
+    Dsp,    // Main loop of the IF processing and decoding
+    Output  // Audio output writing thread
+  };
+  static constexpr unsigned int roles = 3;
+
+  // Placement of a thread role.
+  struct Setting {
+    // CPU numbers to run on, no affinity if empty.
+    std::vector<int> cpus;
+    // SCHED_OTHER, SCHED_FIFO, or SCHED_RR.
+    int policy;
+    // Static priority for SCHED_FIFO and SCHED_RR, 0 for SCHED_OTHER.
+    int priority;
+    // True if set by configure().
+    bool configured;
+  };
+
+  // Parse "source=2:fifo:80,dsp=3:rr:70,output=1" style configuration
+  // and set the placement of the roles.
+  // Each value is cpus[:policy[:priority]], where
+  // cpus is CPU numbers joined by '+' or ranges by '-', or "any".
+  // Return false with the error message if the configuration is invalid.
+  static bool configure(const std::string &text, std::string &error);
+
+  // Apply the placement of the role to the calling thread.
+  // Nothing is done if the role is not configured.
+  // Return false with a warning printed if the placement fails.
+  static bool apply(Role role);
+
+  // Return the placement of the role.
+  static const Setting &get_setting(Role role);
+
+  // Return the name of the role.
+  static const char *role_name(Role role);
+
+  // Return the description of the placement of the role.
+  static std::string describe(Role role);
+
+  // Return the number of involuntary context switches
+  // of the calling thread, or -1 if not available.
+  static long involuntary_switches();
+};
+
+#endif
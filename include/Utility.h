@@ -77,35 +77,22 @@ inline bool parse_dbl(const char *s, double &v) {
 }
 
 // Compute RMS over a small prefix of the specified IQSample vector.
+// No temporary buffer is allocated.
 inline float rms_level_approx(const IQSampleVector &samples) {
   unsigned int n = samples.size();
   n = (n + 63) / 64;
-  volk::vector<float> magnitude_sq;
-  magnitude_sq.resize(n);
+  if (n == 0) {
+    return 0;
+  }
 
   IQSample::value_type level = 0;
-
-  volk_32fc_magnitude_squared_32f(magnitude_sq.data(), samples.data(), n);
-  volk_32f_accumulator_s32f(&level, magnitude_sq.data(), n);
+  for (unsigned int i = 0; i < n; i++) {
+    level += std::norm(samples[i]);
+  }
   // Return RMS level
   return std::sqrt(level / n);
 }
 
-// Compute mean value and RMS over a small prefix of the specified Sample
-// vector.
-inline void samples_mean_rms(const IQSampleDecodedVector &samples, float &mean,
-                             float &rms) {
-  float vsum = 0;
-  float vsumsq = 0;
-  unsigned int n = samples.size();
-
-  volk_32f_accumulator_s32f(&vsum, samples.data(), n);
-  volk_32f_x2_dot_prod_32f(&vsumsq, samples.data(), samples.data(), n);
-
-  mean = vsum / n;
-  rms = std::sqrt(vsumsq / n);
-}
-
 // fast_atan2f()
 
 /***************************************************************************/
@@ -25,6 +25,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <getopt.h>
 #include <memory>
 #include <sys/time.h>
@@ -36,14 +37,27 @@
 #include "AmDecode.h"
 #include "AudioOutput.h"
 #include "DataBuffer.h"
+#include "DecoderState.h"
 #include "FileSource.h"
+#include "Filter.h"
+#include "FilterDesigner.h"
 #include "FilterParameters.h"
 #include "FmDecode.h"
 #include "FourthConverterIQ.h"
+#include "IfRateCalibrator.h"
+#include "IqHistory.h"
+#include "IqRecorder.h"
+#include "IqShmBus.h"
+#include "LevelMeter.h"
+#include "MemoryLock.h"
 #include "MovingAverage.h"
 #include "NbfmDecode.h"
+#include "PipeSource.h"
 #include "RtlSdrSource.h"
+#include "RtlTcpSource.h"
+#include "ShmSource.h"
 #include "SoftFM.h"
+#include "ThreadPolicy.h"
 #include "Utility.h"
 
 // define this for enabling coefficient monitor functions
@@ -54,6 +68,12 @@
 /** Flag is set on SIGINT / SIGTERM. */
 static std::atomic_bool stop_flag(false);
 
+// Flag is set on SIGUSR2.
+static std::atomic_bool dump_flag(false);
+
+// Involuntary context switches of the output thread, set at its end.
+static std::atomic_long output_thread_switches(-1);
+
 /**
  * Get data from output buffer and write to output stream.
  *
@@ -61,6 +81,8 @@ static std::atomic_bool stop_flag(false);
  */
 void write_output_data(AudioOutput *output, DataBuffer<Sample> *buf,
                        unsigned int buf_minfill) {
+  ThreadPolicy::apply(ThreadPolicy::Role::Output);
+
   while (!stop_flag.load()) {
 
     if (buf->queued_samples() == 0) {
@@ -84,6 +106,45 @@ void write_output_data(AudioOutput *output, DataBuffer<Sample> *buf,
       // Setting stop_flag to true, suggested by GitHub @montgomeryb
       stop_flag.store(true);
     }
+    // Return the block for reuse by the main loop.
+    buf->recycle(std::move(samples));
+  }
+
+  output_thread_switches.store(ThreadPolicy::involuntary_switches());
+}
+
+// Get data from MPX output buffer and write to MPX output stream.
+//
+// This code runs in a separate thread.
+// Write errors stop the MPX output only, not the audio output;
+// the buffer is kept drained until the end of stream.
+void write_mpx_data(AudioOutput *output, DataBuffer<Sample> *buf,
+                    bool decimate) {
+  DecimatingFilterFirAudio decimator(
+      FilterParameters::jj1bdx_mpx_384khz_halfband, 2);
+  SampleVector decimated;
+  bool output_ok = true;
+
+  while (true) {
+    // An empty block means the end of stream.
+    SampleVector samples = buf->pull();
+    if (samples.empty()) {
+      break;
+    }
+    if (output_ok) {
+      if (decimate) {
+        decimator.process(samples, decimated);
+        output->write(decimated);
+      } else {
+        output->write(samples);
+      }
+      if (!(*output)) {
+        fprintf(stderr, "ERROR: MPX output: %s\n", output->error().c_str());
+        output_ok = false;
+      }
+    }
+    // Return the block for reuse by the main loop.
+    buf->recycle(std::move(samples));
   }
 }
 
@@ -100,6 +161,27 @@ static void handle_sigterm(int sig) {
   size++; // dummy
 }
 
+// Handle SIGUSR2.
+static void handle_sigusr2(int sig) {
+  (void)sig;
+  dump_flag.store(true);
+}
+
+// Return the number of blocks of block_length samples to hold samples,
+// with two spare blocks.
+static std::size_t pool_blocks(std::size_t samples, std::size_t block_length) {
+  return (samples + block_length - 1) / block_length + 2;
+}
+
+// Return IQ history dump file name for the reason string.
+static std::string iq_history_filename(const char *reason) {
+  char datetime[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(datetime, sizeof(datetime), "%Y%m%dT%H%M%SZ",
+                std::gmtime(&now));
+  return std::string("iqdump-") + datetime + "-" + reason + ".sigmf-data";
+}
+
 void usage() {
   fprintf(
       stderr,
@@ -117,6 +199,9 @@ void usage() {
       "                   - airspy: Airspy R2\n"
       "                   - airspyhf: Airspy HF+\n"
       "                   - filesource: File Source\n"
+      "                   - shm: Shared-memory IQ bus (see -S)\n"
+      "                   - pipe: Raw IQ stream from stdin or FIFO\n"
+      "                   - rtltcp: rtl_tcp compatible server\n"
       "  -q             Quiet mode\n"
       "  -c config      Comma separated key=value configuration pairs or just "
       "key for switches\n"
@@ -128,14 +213,44 @@ void usage() {
       "  -F filename    Write audio data as raw FLOAT_LE samples\n"
       "                 use filename '-' to write to stdout\n"
       "  -W filename    Write audio data to .WAV file\n"
+      "  -e filename    Encode audio data to file by the extension:\n"
+      "                   - .flac: FLAC (24-bit lossless)\n"
+      "                   - .opus or .ogg: Ogg/Opus\n"
       "  -P device_num  Play audio via PortAudio device index number\n"
       "                 use string '-' to specify the default PortAudio "
       "device\n"
+      "  -L             Play audio by the low-latency PortAudio callback\n"
+      "                 with clock drift compensation (with -P)\n"
+      "  -N destination Stream audio data as RTP packets\n"
+      "                 to UDP host:port, or Unix datagram socket unix:path\n"
+      "  -n             Send 32-bit float payload instead of 16-bit integer\n"
+      "                 for -N (both in network byte order)\n"
       "  -T filename    Write pulse-per-second timestamps\n"
       "                 use filename '-' to write to stdout\n"
+      "  -D filename    Write decoded RDS/RBDS data (FM only)\n"
+      "                 use filename '-' to write to stdout\n"
+      "  -x filename    Write MPX baseband signal as raw FLOAT_LE samples\n"
+      "                 (384kHz mono, before deemphasis, FM only)\n"
+      "                 use filename '-' to write to stdout\n"
+      "  -y             Decimate MPX output to 192kHz\n"
+      "  -I filename    Record IF IQ samples at the demodulator input rate\n"
+      "                 (SigMF metadata is also written\n"
+      "                  if filename ends with .sigmf-data)\n"
+      "  -i format      IQ recording format:\n"
+      "                   - cf32: 32-bit float little-endian (default)\n"
+      "                   - cs16: 16-bit integer little-endian\n"
+      "  -S name        Publish source IQ samples to the shared-memory\n"
+      "                 IQ bus with the given POSIX shared memory name\n"
+      "                 (e.g., /airspy-fmradion) for -t shm consumers\n"
+      "  -H seconds     Keep the last given seconds of IF IQ samples\n"
+      "                 in memory and dump them in the IQ recording format\n"
+      "                 on SIGUSR2, squelch opening,\n"
+      "                 or multipath filter reset\n"
       "  -b seconds     Set audio buffer size in seconds (default: 1 second)\n"
       "  -X             Shift pilot phase (for Quadrature Multipath Monitor)\n"
       "                 (-X is ignored under mono mode (-M))\n"
+      "  -G             Output mono and skip the stereo decoding\n"
+      "                 while the stereo pilot is not locked\n"
       "  -U             Set deemphasis to 75 microseconds (default: 50)\n"
       "  -f filtername  Filter type:\n"
       "                 For FM:\n"
@@ -153,13 +268,39 @@ void usage() {
       "                   - default: +-10kHz\n"
       "                   - medium:  +-8kHz\n"
       "                   - narrow:  +-6.25kHz\n"
+      "                 For all modulation types:\n"
+      "                   - design:pass,stop[,dB]: design a filter with\n"
+      "                     the passband and stopband edges in +-kHz\n"
+      "                     and the stopband attenuation in dB\n"
+      "                     (default: 60dB)\n"
       "  -l dB          Set IF squelch level to minus given value of dB\n"
-      "  -E stages      Enable multipath filter for FM\n"
+      "  -E stages[,algorithm]\n"
+      "                 Enable multipath filter for FM\n"
       "                 (For stable reception only:\n"
       "                  turn off if reception becomes unstable)\n"
+      "                 algorithm: coefficient adaptation\n"
+      "                   - nlms:   normalized LMS (default)\n"
+      "                   - ipnlms: proportionate NLMS,\n"
+      "                             faster for sparse echoes\n"
+      "                   - sparse: ipnlms, updating only\n"
+      "                             the significant taps when stable\n"
       "  -r ppm         Set IF offset in ppm (range: +-1000000ppm)\n"
       "                 (This option affects output pitch and timing:\n"
       "                  use for the output timing compensation only!)\n"
+      "  -r auto        Calibrate IF sample rate from the stereo pilot (FM)\n"
+      "                 and apply the value stored for the device\n"
+      "  -k filename    Save FM decoder state to the file every minute\n"
+      "                 and at exit, and restore it at start\n"
+      "                 for the same frequency (warm start)\n"
+      "  -A role=cpus[:policy[:priority]],...\n"
+      "                 Set CPU affinity and scheduling of the threads\n"
+      "                 role: source, dsp, output\n"
+      "                 cpus: CPU numbers joined by '+' or ranges by '-'\n"
+      "                       (e.g., 2, 0+2, 2-3), or 'any'\n"
+      "                 policy: other (default), fifo, rr\n"
+      "                 priority: 1 to 99 for fifo and rr (default 1)\n"
+      "  -K             Preallocate the sample blocks and lock the memory\n"
+      "                 for real-time processing\n"
       "\n"
       "Configuration options for RTL-SDR devices\n"
       "  freq=<int>     Frequency of radio station in Hz (default 100000000)\n"
@@ -191,6 +332,8 @@ void usage() {
       "  antbias        Enable antenna bias (default disabled)\n"
       "  lagc           Enable LNA AGC (default disabled)\n"
       "  magc           Enable mixer AGC (default disabled)\n"
+      "  int16          Receive INT16_REAL samples and convert to IQ\n"
+      "                 in-house instead of libairspy (default disabled)\n"
       "\n"
       "Configuration options for Airspy HF devices:\n"
       "  freq=<int>     Frequency of radio station in Hz (default 100000000)\n"
@@ -214,6 +357,32 @@ void usage() {
       "  raw               Set if the file is raw binary.\n"
       "  format=<string>   Set the file format for the raw binary file.\n"
       "                    (formats: U8_LE, S8_LE, S16_LE, S24_LE, FLOAT)\n"
+      "\n"
+      "Configuration options for shared-memory IQ bus (shm) consumers:\n"
+      "  name=<string>     Shared memory name given to -S of the publisher\n"
+      "                    (default /airspy-fmradion)\n"
+      "  blklen=<int>      Set maximum block length in samples.\n"
+      "\n"
+      "Configuration options for pipe sources:\n"
+      "  freq=<int>        Frequency of radio station in Hz\n"
+      "  srate=<int>       IF sample rate in Hz (default 384000)\n"
+      "  filename=<string> FIFO file name, or '-' for stdin (default)\n"
+      "  format=<string>   Sample format: cu8 (default), cs8, cs16, cf32\n"
+      "  zero_offset       Set if the stream is in zero offset,\n"
+      "                    which requires Fs/4 IF shifting.\n"
+      "  blklen=<int>      Set block length in samples.\n"
+      "\n"
+      "Configuration options for rtl_tcp compatible servers:\n"
+      "  host=<string>     Server host name or address (default 127.0.0.1)\n"
+      "  port=<int>        Server TCP port (default 1234)\n"
+      "  unix=<string>     Connect to the Unix domain socket path instead\n"
+      "  freq=<int>        Frequency of radio station in Hz\n"
+      "  srate=<int>       IF sample rate in Hz (default 1200000)\n"
+      "  gain=<float>      Set LNA gain in dB, or 'auto'\n"
+      "  ppm=<int>         Set frequency correction in ppm\n"
+      "  blklen=<int>      Set block length in samples (default 65536)\n"
+      "  agc               Enable RTL AGC mode (default disabled)\n"
+      "  antbias           Enable antenna bias (default disabled)\n"
       "\n");
 }
 
@@ -263,6 +432,15 @@ static bool get_device(std::vector<std::string> &devnames, DevType devtype,
   case DevType::FileSource:
     FileSource::get_device_names(devnames);
     break;
+  case DevType::Shm:
+    ShmSource::get_device_names(devnames);
+    break;
+  case DevType::Pipe:
+    PipeSource::get_device_names(devnames);
+    break;
+  case DevType::RtlTcp:
+    RtlTcpSource::get_device_names(devnames);
+    break;
   }
 
   if (devidx < 0 || (unsigned int)devidx >= devnames.size()) {
@@ -295,6 +473,15 @@ static bool get_device(std::vector<std::string> &devnames, DevType devtype,
   case DevType::FileSource:
     *srcsdr = new FileSource(devidx);
     break;
+  case DevType::Shm:
+    *srcsdr = new ShmSource(devidx);
+    break;
+  case DevType::Pipe:
+    *srcsdr = new PipeSource(devidx);
+    break;
+  case DevType::RtlTcp:
+    *srcsdr = new RtlTcpSource(devidx);
+    break;
   }
 
   return true;
@@ -307,18 +494,39 @@ int main(int argc, char **argv) {
   bool stereo = true;
   OutputMode outmode = OutputMode::RAW_INT16;
   std::string filename("-");
+  EncoderAudioOutput::Codec codec = EncoderAudioOutput::Codec::FLAC;
   int portaudiodev = -1;
+  bool portaudio_callback = false;
+  std::string netdest;
+  bool net_float32 = false;
   bool quietmode = false;
   std::string ppsfilename;
   FILE *ppsfile = nullptr;
+  std::string rdsfilename;
+  std::string statefilename;
+  std::string threads_str;
+  bool memory_lock = false;
+  FILE *rdsfile = nullptr;
+  std::string mpxfilename;
+  bool mpx_decimate = false;
+  std::string iqfilename;
+  IqRecorder::Format iqformat = IqRecorder::Format::CF32;
+  double iq_history_seconds = 0;
+  std::string shmname;
   double bufsecs = -1;
   bool enable_squelch = false;
   double squelch_level_db = 150.0;
   bool pilot_shift = false;
+  bool stereo_gating = false;
   bool deemphasis_na = false;
   int multipathfilter_stages = 0;
+  MultipathFilter::Algorithm multipathfilter_algorithm =
+      MultipathFilter::Algorithm::Nlms;
+  std::string multipathfilter_str;
+  std::string multipathfilter_algorithm_str("nlms");
   bool ifrate_offset_enable = false;
   double ifrate_offset_ppm = 0;
+  bool ifrate_calibration = false;
   std::string config_str;
   std::string devtype_str;
   DevType devtype;
@@ -326,6 +534,7 @@ int main(int argc, char **argv) {
   ModType modtype = ModType::FM;
   std::string filtertype_str("default");
   FilterType filtertype = FilterType::Default;
+  std::string filter_design_str;
   std::vector<std::string> devnames;
   Source *srcsdr = 0;
 
@@ -343,19 +552,36 @@ int main(int argc, char **argv) {
       {"raw", required_argument, nullptr, 'R'},
       {"float", required_argument, nullptr, 'F'},
       {"wav", required_argument, nullptr, 'W'},
+      {"encode", required_argument, nullptr, 'e'},
       {"play", optional_argument, nullptr, 'P'},
+      {"lowlatency", no_argument, nullptr, 'L'},
+      {"net", required_argument, nullptr, 'N'},
+      {"netfloat", no_argument, nullptr, 'n'},
       {"pps", required_argument, nullptr, 'T'},
+      {"rds", required_argument, nullptr, 'D'},
+      {"mpx", required_argument, nullptr, 'x'},
+      {"mpx192", no_argument, nullptr, 'y'},
+      {"iqrecord", required_argument, nullptr, 'I'},
+      {"iqformat", required_argument, nullptr, 'i'},
+      {"iqhistory", required_argument, nullptr, 'H'},
+      {"shmpublish", required_argument, nullptr, 'S'},
       {"buffer", required_argument, nullptr, 'b'},
       {"pilotshift", no_argument, nullptr, 'X'},
+      {"stereogate", no_argument, nullptr, 'G'},
       {"usa", no_argument, nullptr, 'U'},
       {"filtertype", optional_argument, nullptr, 'f'},
       {"squelch", required_argument, nullptr, 'l'},
       {"multipathfilter", required_argument, nullptr, 'E'},
       {"ifrateppm", optional_argument, nullptr, 'r'},
+      {"state", required_argument, nullptr, 'k'},
+      {"threads", required_argument, nullptr, 'A'},
+      {"memlock", no_argument, nullptr, 'K'},
       {nullptr, no_argument, nullptr, 0}};
 
   int c, longindex;
-  while ((c = getopt_long(argc, argv, "m:t:c:d:MR:F:W:f:l:P:T:b:qXUE:r:",
+  while ((c = getopt_long(argc, argv,
+                          "m:t:c:d:MR:F:W:e:f:l:P:LN:nT:D:x:yI:i:H:S:b:qXUE:r:"
+                          "k:GA:K",
                           longopts, &longindex)) >= 0) {
     switch (c) {
     case 'm':
@@ -387,6 +613,13 @@ int main(int argc, char **argv) {
       outmode = OutputMode::WAV;
       filename = optarg;
       break;
+    case 'e':
+      outmode = OutputMode::ENCODER;
+      filename = optarg;
+      if (!EncoderAudioOutput::parse_codec(filename, codec)) {
+        badarg("-e");
+      }
+      break;
     case 'f':
       filtertype_str.assign(optarg);
       break;
@@ -405,9 +638,45 @@ int main(int argc, char **argv) {
         badarg("-P");
       }
       break;
+    case 'L':
+      portaudio_callback = true;
+      break;
+    case 'N':
+      outmode = OutputMode::NETWORK;
+      netdest = optarg;
+      break;
+    case 'n':
+      net_float32 = true;
+      break;
     case 'T':
       ppsfilename = optarg;
       break;
+    case 'D':
+      rdsfilename = optarg;
+      break;
+    case 'x':
+      mpxfilename = optarg;
+      break;
+    case 'y':
+      mpx_decimate = true;
+      break;
+    case 'I':
+      iqfilename = optarg;
+      break;
+    case 'i':
+      if (!IqRecorder::parse_format(optarg, iqformat)) {
+        badarg("-i");
+      }
+      break;
+    case 'S':
+      shmname = optarg;
+      break;
+    case 'H':
+      if (!Utility::parse_dbl(optarg, iq_history_seconds) ||
+          iq_history_seconds <= 0) {
+        badarg("-H");
+      }
+      break;
     case 'b':
       if (!Utility::parse_dbl(optarg, bufsecs) || bufsecs < 0) {
         badarg("-b");
@@ -419,22 +688,33 @@ int main(int argc, char **argv) {
     case 'X':
       pilot_shift = true;
       break;
+    case 'G':
+      stereo_gating = true;
+      break;
     case 'U':
       deemphasis_na = true;
       break;
     case 'E':
-      if (!parse_int(optarg, multipathfilter_stages) ||
-          multipathfilter_stages < 1) {
-        badarg("-E");
-      }
+      multipathfilter_str.assign(optarg);
       break;
     case 'r':
       ifrate_offset_enable = true;
-      if (!Utility::parse_dbl(optarg, ifrate_offset_ppm) ||
-          std::fabs(ifrate_offset_ppm) > 1000000.0) {
+      if (strcasecmp(optarg, "auto") == 0) {
+        ifrate_calibration = true;
+      } else if (!Utility::parse_dbl(optarg, ifrate_offset_ppm) ||
+                 std::fabs(ifrate_offset_ppm) > 1000000.0) {
         badarg("-r");
       }
       break;
+    case 'k':
+      statefilename.assign(optarg);
+      break;
+    case 'A':
+      threads_str.assign(optarg);
+      break;
+    case 'K':
+      memory_lock = true;
+      break;
     default:
       usage();
       fprintf(stderr, "ERROR: Invalid command line options\n");
@@ -463,11 +743,19 @@ int main(int argc, char **argv) {
     devtype = DevType::AirspyHF;
   } else if (strcasecmp(devtype_str.c_str(), "filesource") == 0) {
     devtype = DevType::FileSource;
+  } else if (strcasecmp(devtype_str.c_str(), "shm") == 0) {
+    devtype = DevType::Shm;
+  } else if (strcasecmp(devtype_str.c_str(), "pipe") == 0) {
+    devtype = DevType::Pipe;
+  } else if (strcasecmp(devtype_str.c_str(), "rtltcp") == 0) {
+    devtype = DevType::RtlTcp;
   } else {
     fprintf(
         stderr,
         "ERROR: wrong device type (-t option) must be one of the following:\n");
-    fprintf(stderr, "        rtlsdr, airspy, airspyhf, filesource\n");
+    fprintf(stderr,
+            "        rtlsdr, airspy, airspyhf, filesource, shm, pipe, "
+            "rtltcp\n");
     exit(1);
   }
 
@@ -504,11 +792,51 @@ int main(int argc, char **argv) {
     filtertype = FilterType::Narrow;
   } else if (strcasecmp(filtertype_str.c_str(), "wide") == 0) {
     filtertype = FilterType::Wide;
+  } else if (strncasecmp(filtertype_str.c_str(), "design:", 7) == 0) {
+    filtertype = FilterType::Designed;
+    filter_design_str = filtertype_str.substr(7);
   } else {
     fprintf(stderr, "Filter type string unsuppored\n");
     exit(1);
   }
 
+  if (!multipathfilter_str.empty()) {
+    std::string::size_type comma = multipathfilter_str.find(',');
+    if (comma != std::string::npos) {
+      multipathfilter_algorithm_str = multipathfilter_str.substr(comma + 1);
+    }
+    if (!parse_int(multipathfilter_str.substr(0, comma).c_str(),
+                   multipathfilter_stages) ||
+        multipathfilter_stages < 1) {
+      badarg("-E");
+    }
+    if (strcasecmp(multipathfilter_algorithm_str.c_str(), "nlms") == 0) {
+      multipathfilter_algorithm = MultipathFilter::Algorithm::Nlms;
+    } else if (strcasecmp(multipathfilter_algorithm_str.c_str(), "ipnlms") ==
+               0) {
+      multipathfilter_algorithm = MultipathFilter::Algorithm::Ipnlms;
+    } else if (strcasecmp(multipathfilter_algorithm_str.c_str(), "sparse") ==
+               0) {
+      multipathfilter_algorithm = MultipathFilter::Algorithm::IpnlmsSparse;
+    } else {
+      badarg("-E");
+    }
+  }
+
+  if (!threads_str.empty()) {
+    std::string error;
+    if (!ThreadPolicy::configure(threads_str, error)) {
+      usage();
+      fprintf(stderr, "ERROR: Invalid argument for -A: %s\n", error.c_str());
+      exit(1);
+    }
+  }
+
+  // The callback output is only for PortAudio.
+  if (portaudio_callback && outmode != OutputMode::PORTAUDIO) {
+    badarg("-L");
+  }
+
   // Catch Ctrl-C and SIGTERM
   struct sigaction sigact;
   sigact.sa_handler = handle_sigterm;
@@ -525,6 +853,17 @@ int main(int argc, char **argv) {
             strerror(errno));
   }
 
+  // Catch SIGUSR2 for dumping the IQ history.
+  struct sigaction sigact_usr2;
+  sigact_usr2.sa_handler = handle_sigusr2;
+  sigemptyset(&sigact_usr2.sa_mask);
+  sigact_usr2.sa_flags = 0;
+
+  if (sigaction(SIGUSR2, &sigact_usr2, nullptr) < 0) {
+    fprintf(stderr, "WARNING: can not install SIGUSR2 handler (%s)\n",
+            strerror(errno));
+  }
+
   // Open PPS file.
   if (!ppsfilename.empty()) {
     if (ppsfilename == "-") {
@@ -558,6 +897,30 @@ int main(int argc, char **argv) {
     fflush(ppsfile);
   }
 
+  // Open RDS file.
+  if (!rdsfilename.empty()) {
+    if (modtype != ModType::FM) {
+      fprintf(stderr, "RDS decoding is available for FM only, ignored\n");
+    } else if (rdsfilename == "-") {
+      fprintf(stderr, "writing RDS data to stdout\n");
+      rdsfile = stdout;
+    } else {
+      fprintf(stderr, "writing RDS data to '%s'\n", rdsfilename.c_str());
+      rdsfile = fopen(rdsfilename.c_str(), "w");
+
+      if (rdsfile == nullptr) {
+        fprintf(stderr, "ERROR: can not open '%s' (%s)\n", rdsfilename.c_str(),
+                strerror(errno));
+        exit(1);
+      }
+    }
+
+    if (rdsfile != nullptr) {
+      fprintf(rdsfile, "#group   sample_index blkA blkB blkC blkD\n");
+      fflush(rdsfile);
+    }
+  }
+
   // Calculate number of samples in audio buffer.
   // Set default buffer length to 1 second.
   unsigned int outputbuf_samples = pcmrate;
@@ -576,6 +939,9 @@ int main(int argc, char **argv) {
 
   // Prepare output writer.
   std::unique_ptr<AudioOutput> audio_output;
+  EncoderAudioOutput *encoder_output = nullptr;
+  NetAudioOutput *net_output = nullptr;
+  PortAudioCallbackOutput *callback_output = nullptr;
 
   switch (outmode) {
   case OutputMode::RAW_INT16:
@@ -596,15 +962,36 @@ int main(int argc, char **argv) {
     fprintf(stderr, "writing audio samples to '%s'\n", filename.c_str());
     audio_output.reset(new WavAudioOutput(filename, pcmrate, stereo));
     break;
+  case OutputMode::ENCODER:
+    fprintf(stderr, "encoding audio samples as %s to '%s'\n",
+            EncoderAudioOutput::codec_name(codec), filename.c_str());
+    encoder_output = new EncoderAudioOutput(filename, codec, pcmrate, stereo);
+    audio_output.reset(encoder_output);
+    break;
   case OutputMode::PORTAUDIO:
     if (portaudiodev == -1) {
       fprintf(stderr, "playing audio to PortAudio default device: ");
     } else {
       fprintf(stderr, "playing audio to PortAudio device %d: ", portaudiodev);
     }
-    audio_output.reset(new PortAudioOutput(portaudiodev, pcmrate, stereo));
+    if (portaudio_callback) {
+      callback_output =
+          new PortAudioCallbackOutput(portaudiodev, pcmrate, stereo);
+      audio_output.reset(callback_output);
+    } else {
+      audio_output.reset(new PortAudioOutput(portaudiodev, pcmrate, stereo));
+    }
     fprintf(stderr, "name '%s'\n", audio_output->get_device_name().c_str());
     break;
+  case OutputMode::NETWORK:
+    net_output = new NetAudioOutput(netdest, pcmrate, stereo, net_float32);
+    audio_output.reset(net_output);
+    fprintf(stderr,
+            "streaming RTP audio to '%s', %s payload, "
+            "%u frames per packet\n",
+            netdest.c_str(), net_float32 ? "32-bit float" : "16-bit integer",
+            net_output->get_packet_frames());
+    break;
   }
 
   if (!(*audio_output)) {
@@ -612,6 +999,31 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  // Prepare MPX output writer.
+  std::unique_ptr<AudioOutput> mpx_output;
+
+  if (!mpxfilename.empty()) {
+    if (modtype != ModType::FM) {
+      fprintf(stderr, "MPX output is available for FM only, ignored\n");
+    } else if (mpxfilename == "-" && outmode != OutputMode::PORTAUDIO &&
+               outmode != OutputMode::NETWORK && filename == "-") {
+      fprintf(stderr, "ERROR: MPX and audio output can not share stdout\n");
+      exit(1);
+    } else {
+      fprintf(stderr,
+              "writing raw 32-bit float little-endian %dkHz MPX samples to "
+              "'%s'\n",
+              mpx_decimate ? 192 : 384, mpxfilename.c_str());
+      mpx_output.reset(new RawAudioOutput(mpxfilename));
+      mpx_output->SetConvertFunction(AudioOutput::samplesToFloat32);
+      if (!(*mpx_output)) {
+        fprintf(stderr, "ERROR: AudioOutput: %s\n",
+                mpx_output->error().c_str());
+        exit(1);
+      }
+    }
+  }
+
   if (!get_device(devnames, devtype, &srcsdr, devidx)) {
     exit(1);
   }
@@ -664,6 +1076,30 @@ int main(int argc, char **argv) {
   case DevType::FileSource:
     if_blocksize = 2048;
     break;
+  case DevType::Shm:
+    if_blocksize = ShmSource::default_block_length;
+    break;
+  case DevType::Pipe:
+    if_blocksize = PipeSource::default_block_length;
+    break;
+  case DevType::RtlTcp:
+    if_blocksize = RtlTcpSource::default_block_length;
+    break;
+  }
+
+  // Load the IF rate calibration of the device.
+  double nominal_ifrate = ifrate;
+  std::string calibration_filename = IfRateCalibrator::default_filename();
+  std::string calibration_device = devtype_str + " " + devnames[devidx];
+  if (ifrate_calibration) {
+    if (IfRateCalibrator::load(calibration_filename, calibration_device,
+                               ifrate_offset_ppm)) {
+      fprintf(stderr, "IF sample rate calibration loaded from '%s'\n",
+              calibration_filename.c_str());
+    } else {
+      fprintf(stderr, "IF sample rate calibration not found for '%s'\n",
+              calibration_device.c_str());
+    }
   }
 
   // IF rate compensation if requested.
@@ -712,6 +1148,22 @@ int main(int argc, char **argv) {
 
   srcsdr->print_specific_parms();
 
+  // Create the shared-memory IQ bus with ~1 second of source samples.
+  std::unique_ptr<IqShmPublisher> shm_publisher;
+  if (!shmname.empty()) {
+    fprintf(stderr, "publishing source IQ samples to shared memory '%s'\n",
+            shmname.c_str());
+    shm_publisher.reset(new IqShmPublisher(
+        shmname, srcsdr->get_sample_rate(), srcsdr->get_frequency(),
+        srcsdr->get_configured_frequency(), srcsdr->is_low_if(),
+        srcsdr->get_sample_rate()));
+    if (!(*shm_publisher)) {
+      fprintf(stderr, "ERROR: IqShmPublisher: %s\n",
+              shm_publisher->error().c_str());
+      exit(1);
+    }
+  }
+
   // Create source data queue.
   DataBuffer<IQSample> source_buffer;
 
@@ -720,6 +1172,15 @@ int main(int argc, char **argv) {
   // use shared_ptr (and no move) instead
   std::unique_ptr<Source> up_srcsdr(srcsdr);
 
+  // Show the thread placement.
+  for (unsigned int i = 0; i < ThreadPolicy::roles; i++) {
+    ThreadPolicy::Role role = static_cast<ThreadPolicy::Role>(i);
+    if (ThreadPolicy::get_setting(role).configured) {
+      fprintf(stderr, "Thread %s: %s\n", ThreadPolicy::role_name(role),
+              ThreadPolicy::describe(role).c_str());
+    }
+  }
+
   // Start reading from device in separate thread.
   up_srcsdr->start(&source_buffer, &stop_flag);
 
@@ -766,6 +1227,58 @@ int main(int argc, char **argv) {
     fmfilter_coeff = FilterParameters::delay_3taps_only_iq;
     nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_wide;
     break;
+  case FilterType::Designed: {
+    // Design the filter for the selected modulation type only,
+    // and use the default ones for the others.
+    amfilter_coeff = FilterParameters::jj1bdx_am_48khz_default;
+    fmfilter_coeff = FilterParameters::delay_3taps_only_iq;
+    nbfmfilter_coeff = FilterParameters::jj1bdx_nbfm_48khz_default;
+    double design_rate;
+    switch (modtype) {
+    case ModType::FM:
+      design_rate = fm_target_rate;
+      break;
+    case ModType::NBFM:
+      design_rate = nbfm_target_rate;
+      break;
+    default:
+      design_rate = am_target_rate;
+      break;
+    }
+    FilterDesigner::Spec spec;
+    if (!FilterDesigner::parse_spec(filter_design_str, design_rate, spec)) {
+      fprintf(stderr, "Filter design specification invalid: %s\n",
+              filter_design_str.c_str());
+      exit(1);
+    }
+    bool cached;
+    SampleCoeff designed;
+    std::string design_error;
+    if (!FilterDesigner::lowpass(spec, designed, cached, design_error)) {
+      fprintf(stderr, "ERROR: Filter design failed: %s\n",
+              design_error.c_str());
+      exit(1);
+    }
+    fprintf(stderr,
+            "Filter designed: +-%.9g [kHz] passband, "
+            "+-%.9g [kHz] stopband, %.9g [dB], %u taps%s\n",
+            spec.passband / 1000, spec.stopband / 1000, spec.attenuation,
+            static_cast<unsigned int>(designed.size()),
+            cached ? " (cached)" : "");
+    IQSampleCoeff coeff(designed.begin(), designed.end());
+    switch (modtype) {
+    case ModType::FM:
+      fmfilter_coeff = coeff;
+      break;
+    case ModType::NBFM:
+      nbfmfilter_coeff = coeff;
+      break;
+    default:
+      amfilter_coeff = coeff;
+      break;
+    }
+    break;
+  }
   }
 
   // Prepare AM decoder.
@@ -776,10 +1289,13 @@ int main(int argc, char **argv) {
   // Prepare FM decoder.
   FmDecoder fm(fmfilter_coeff, // fmfilter_coeff
                stereo,         // stereo
+               stereo_gating,  // stereo_gating
                deemphasis,     // deemphasis,
                pilot_shift,    // pilot_shift
-               static_cast<unsigned int>(multipathfilter_stages)
+               static_cast<unsigned int>(multipathfilter_stages),
                // multipath_stages
+               multipathfilter_algorithm, // multipath_algorithm
+               rdsfile != nullptr // rds
   );
 
   // Prepare narrow band FM decoder.
@@ -809,12 +1325,59 @@ int main(int argc, char **argv) {
   if (modtype == ModType::FM) {
     fprintf(stderr, "FM demodulator deemphasis: %.9g [µs]\n", deemphasis);
     if (multipathfilter_stages > 0) {
-      fprintf(stderr, "FM IF multipath filter enabled, stages: %d\n",
-              multipathfilter_stages);
+      fprintf(stderr,
+              "FM IF multipath filter enabled, stages: %d, algorithm: %s\n",
+              multipathfilter_stages, multipathfilter_algorithm_str.c_str());
     }
   }
   fprintf(stderr, "Filter type: %s\n", filtertype_str.c_str());
 
+  // Show the processing cost of each FIR filter stage.
+  std::vector<FilterStageCost> filter_costs;
+  switch (modtype) {
+  case ModType::FM:
+    filter_costs = fm.get_filter_costs();
+    break;
+  case ModType::NBFM:
+    filter_costs = nbfm.get_filter_costs();
+    break;
+  default:
+    filter_costs = am.get_filter_costs();
+    break;
+  }
+  for (const FilterStageCost &cost : filter_costs) {
+    if (cost.elided) {
+      fprintf(stderr, "Filter stage %s: delay of %u samples, elided\n",
+              cost.name.c_str(), cost.delay);
+    } else if (cost.delay > 0) {
+      fprintf(stderr,
+              "Filter stage %s: delay of %u samples by copying, "
+              "%.3f [MMAC/s]\n",
+              cost.name.c_str(), cost.delay,
+              cost.macs_per_sample * cost.sample_rate * 1.0e-6);
+    } else {
+      fprintf(stderr,
+              "Filter stage %s: %u MAC/sample at %.0f [Hz], "
+              "%.3f [MMAC/s]\n",
+              cost.name.c_str(), cost.macs_per_sample, cost.sample_rate,
+              cost.macs_per_sample * cost.sample_rate * 1.0e-6);
+    }
+  }
+
+  // Prepare IF sample rate calibration from the pilot.
+  std::unique_ptr<IfRateCalibrator> ifrate_calibrator;
+  if (ifrate_calibration) {
+    if (modtype != ModType::FM) {
+      fprintf(stderr, "IF sample rate calibration is available for FM only\n");
+    } else if (!stereo && rdsfilename.empty()) {
+      fprintf(stderr,
+              "IF sample rate calibration requires stereo or RDS decoding\n");
+    } else {
+      ifrate_calibrator.reset(
+          new IfRateCalibrator(demodulator_rate, ifrate_offset_ppm));
+    }
+  }
+
   // Initialize moving average object for FM ppm monitoring.
   MovingAverage<float> ppm_average(100, 0.0f);
 
@@ -826,7 +1389,48 @@ int main(int argc, char **argv) {
   // Always use output_thread for smooth output.
   output_thread = std::thread(write_output_data, audio_output.get(),
                               &output_buffer, outputbuf_samples * nchannel);
+
+  // The MPX output has its own buffer and thread.
+  // Blocks are dropped instead of blocking the audio path
+  // when the MPX output buffer exceeds mpxbuf_limit samples (~2 seconds).
+  DataBuffer<Sample> mpx_buffer;
+  std::thread mpx_thread;
+  const std::size_t mpxbuf_limit = 2 * FmDecoder::sample_rate_if;
+  std::uint64_t mpx_dropped_blocks = 0;
+  if (mpx_output) {
+    mpx_thread = std::thread(write_mpx_data, mpx_output.get(), &mpx_buffer,
+                             mpx_decimate);
+  }
+
+  // The IQ recorder has its own ring buffer (~2 seconds) and thread.
+  // Blocks are dropped instead of blocking when the ring buffer is full.
+  std::unique_ptr<IqRecorder> iq_recorder;
+  if (!iqfilename.empty()) {
+    fprintf(stderr, "recording %s IQ samples at %.9g [Hz] to '%s'\n",
+            IqRecorder::format_name(iqformat), demodulator_rate,
+            iqfilename.c_str());
+    iq_recorder.reset(new IqRecorder(iqfilename, iqformat, demodulator_rate,
+                                     freq, 2 * demodulator_rate));
+    if (!(*iq_recorder)) {
+      fprintf(stderr, "ERROR: IqRecorder: %s\n", iq_recorder->error().c_str());
+      exit(1);
+    }
+  }
+
+  // The IQ history is preallocated here and fed from the main loop.
+  std::unique_ptr<IqHistory> iq_history;
+  if (iq_history_seconds > 0) {
+    fprintf(stderr, "keeping last %.9g [s] of IQ samples in memory\n",
+            iq_history_seconds);
+    iq_history.reset(new IqHistory(iq_history_seconds, demodulator_rate, freq,
+                                   iqformat));
+  }
+  bool prev_squelch_open = true;
+  unsigned int prev_multipath_reset_count = 0;
+
   SampleVector audiosamples;
+  IQSampleVector if_shifted_samples;
+  IQSampleVector if_downsampled_samples;
   bool inbuf_length_warning = false;
   float audio_level = 0;
   bool got_stereo = false;
@@ -851,8 +1455,113 @@ int main(int argc, char **argv) {
     break;
   }
 
+  // Restore the FM decoder state for a warm start.
+  DecoderState decoder_state;
+  if (!statefilename.empty()) {
+    if (modtype != ModType::FM) {
+      fprintf(stderr, "Decoder state checkpoint is available for FM only\n");
+      statefilename.clear();
+    } else if (decoder_state.load(statefilename) &&
+               decoder_state.matches(freq, "fm")) {
+      fm.set_state(decoder_state);
+      ppm_average.fill(decoder_state.ppm);
+      // Only the filters need to start up.
+      discarding_blocks = std::max(1u, stat_rate / 4);
+      fprintf(stderr, "Decoder state restored from '%s'\n",
+              statefilename.c_str());
+    } else {
+      fprintf(stderr, "Decoder state for the frequency not found in '%s'\n",
+              statefilename.c_str());
+    }
+  }
+  // Update the FM decoder state to be saved.
+  auto update_decoder_state = [&]() {
+    decoder_state.frequency = freq;
+    decoder_state.modtype = "fm";
+    decoder_state.ppm = ppm_average.average();
+    fm.get_state(decoder_state);
+  };
+  // The periodic saves are written in the background.
+  std::unique_ptr<DecoderStateWriter> decoder_state_writer;
+  if (!statefilename.empty()) {
+    std::size_t multipath_size =
+        (multipathfilter_stages > 0)
+            ? fm.get_multipath_filter().get_coefficients().size()
+            : 0;
+    decoder_state.multipath_coeff.reserve(multipath_size);
+    decoder_state_writer.reset(
+        new DecoderStateWriter(statefilename, multipath_size));
+  }
+
   float if_level = 0;
 
+  // Last RDS data written to the RDS file.
+  std::uint16_t rds_pi = 0;
+  std::string rds_ps;
+  std::string rds_rt;
+
+  // Place this thread after the other threads are started,
+  // which otherwise inherit the placement of the DSP thread.
+  ThreadPolicy::apply(ThreadPolicy::Role::Dsp);
+
+  // Allocate the decoder buffers and the blocks passed between the threads,
+  // then lock the memory, after the threads and buffers are set up.
+  if (memory_lock) {
+    // Source blocks for 0.5 seconds of the queue.
+    const std::size_t source_block = up_srcsdr->get_max_block_length();
+    const std::size_t source_blocks =
+        pool_blocks(std::size_t(ifrate / 2), source_block);
+    source_buffer.reserve_blocks(source_blocks, source_block);
+    std::size_t pool_bytes = source_blocks * source_block * sizeof(IQSample);
+    // Decoder input blocks, with the headroom for the IF resampler output.
+    const std::size_t if_block =
+        2 * std::size_t(source_block * demodulator_rate / ifrate + 1);
+    if_shifted_samples.reserve(source_block);
+    if_downsampled_samples.reserve(if_block);
+    switch (modtype) {
+    case ModType::FM:
+      fm.reserve(if_block);
+      break;
+    case ModType::AM:
+    case ModType::DSB:
+    case ModType::USB:
+    case ModType::LSB:
+    case ModType::CW:
+      am.reserve(if_block);
+      break;
+    case ModType::NBFM:
+      nbfm.reserve(if_block);
+      break;
+    }
+    // Output blocks for twice the buffer length,
+    // with the headroom for the resampler output.
+    const std::size_t audio_block =
+        2 * nchannel * std::size_t(source_block * pcmrate / ifrate + 1);
+    const std::size_t audio_blocks =
+        pool_blocks(2 * outputbuf_samples * nchannel, audio_block);
+    output_buffer.reserve_blocks(audio_blocks, audio_block);
+    pool_bytes += audio_blocks * audio_block * sizeof(Sample);
+    audiosamples = output_buffer.get_block(0);
+    if (mpx_output) {
+      // MPX blocks for the whole MPX output buffer.
+      const std::size_t mpx_blocks = pool_blocks(mpxbuf_limit, if_block);
+      mpx_buffer.reserve_blocks(mpx_blocks, if_block);
+      pool_bytes += mpx_blocks * if_block * sizeof(Sample);
+    }
+    std::string error;
+    if (MemoryLock::lock(error)) {
+      fprintf(stderr, "memory locked, %.1f [MB] of sample blocks allocated\n",
+              pool_bytes / (1024.0 * 1024.0));
+    } else {
+      fprintf(stderr, "WARNING: can not lock memory (%s)\n", error.c_str());
+    }
+  }
+  // Count the page faults in the main loop.
+  const MemoryLock::PageFaults dsp_faults_start =
+      MemoryLock::thread_page_faults();
+  const MemoryLock::PageFaults process_faults_start =
+      MemoryLock::process_page_faults();
+
   // Main loop.
   for (unsigned int block = 0; !stop_flag.load(); block++) {
 
@@ -865,8 +1574,10 @@ int main(int argc, char **argv) {
     // Pull next block from source buffer.
     IQSampleVector iqsamples = source_buffer.pull();
 
-    IQSampleVector if_shifted_samples;
-    IQSampleVector if_samples;
+    // Publish source samples to the shared-memory IQ bus.
+    if (shm_publisher) {
+      shm_publisher->publish(iqsamples);
+    }
 
     if (iqsamples.empty()) {
       break;
@@ -878,20 +1589,30 @@ int main(int argc, char **argv) {
     // Fine tuning is not needed
     // so long as the stability of the receiver device is
     // within the range of +- 1ppm (~100Hz or less).
+    // The source block is kept until the end of the loop
+    // to be recycled, and is used as the IF samples if not processed.
+    const IQSampleVector *if_input = &iqsamples;
     if (enable_fs_fourth_downconverter) {
       // Fs/4 downconvering is required
       // to avoid frequency zero offset
       // because Airspy HF+ and RTL-SDR are Zero IF receivers
-      fourth_downconverter.process(iqsamples, if_shifted_samples);
-    } else {
-      if_shifted_samples = std::move(iqsamples);
+      fourth_downconverter.process(*if_input, if_shifted_samples);
+      if_input = &if_shifted_samples;
     }
 
     // Downsample IF for the decoder.
     if (enable_downsampling) {
-      if_resampler.process(if_shifted_samples, if_samples);
-    } else {
-      if_samples = std::move(if_shifted_samples);
+      if_resampler.process(*if_input, if_downsampled_samples);
+      if_input = &if_downsampled_samples;
+    }
+    const IQSampleVector &if_samples = *if_input;
+
+    // Record IF samples.
+    if (iq_recorder) {
+      iq_recorder->push(if_samples);
+    }
+    if (iq_history) {
+      iq_history->push(if_samples);
     }
 
     // Downsample IF for the decoder.
@@ -905,6 +1626,28 @@ int main(int argc, char **argv) {
         // Decode FM signal.
         fm.process(if_samples, audiosamples);
         if_rms = fm.get_if_rms();
+        // Calibrate IF sample rate from the pilot frequency.
+        if (ifrate_calibrator) {
+          ifrate_calibrator->feed(fm.get_pilot_frequency(), if_samples.size(),
+                                  fm.pilot_locked());
+          if (ifrate_calibrator->update()) {
+            double ppm = ifrate_calibrator->get_ppm();
+            if_resampler.set_input_rate(nominal_ifrate * (1.0 + ppm * 1.0e-6));
+            enable_downsampling = true;
+            fprintf(stderr, "\nIF sample rate calibrated: %.3f [ppm]\n", ppm);
+          }
+        }
+        // Copy MPX signal to the MPX output buffer if not full.
+        if (mpx_output && !fm.get_baseband().empty()) {
+          if (mpx_buffer.queued_samples() < mpxbuf_limit) {
+            const SampleVector &baseband = fm.get_baseband();
+            SampleVector mpx = mpx_buffer.get_block(0);
+            mpx.assign(baseband.begin(), baseband.end());
+            mpx_buffer.push(std::move(mpx));
+          } else {
+            mpx_dropped_blocks++;
+          }
+        }
         break;
       case ModType::AM:
       case ModType::DSB:
@@ -928,19 +1671,44 @@ int main(int argc, char **argv) {
     size_t audiosamples_size = audiosamples.size();
     bool audio_exists = audiosamples_size > 0;
 
-    // Measure audio level when audio exists
+    // Measure audio level when audio exists,
+    // in the same pass as the gain adjustment.
     if (audio_exists) {
-      float audio_mean, audio_rms;
-      IQSampleDecodedVector audiosamples_float;
-      audiosamples_float.resize(audiosamples_size);
-      volk_64f_convert_32f(audiosamples_float.data(), audiosamples.data(),
-                           audiosamples_size);
-      Utility::samples_mean_rms(audiosamples_float, audio_mean, audio_rms);
-      audio_level = 0.95 * audio_level + 0.05 * audio_rms;
-
       // Set nominal audio volume (-6dB) when IF squelch is open,
       // set to zero volume if the squelch is closed.
-      Utility::adjust_gain(audiosamples, if_rms >= squelch_level ? 0.5 : 0.0);
+      LevelMeter audio_meter;
+      audio_meter.adjust_gain(audiosamples,
+                              if_rms >= squelch_level ? 0.5 : 0.0);
+      audio_level = 0.95 * audio_level + 0.05 * audio_meter.rms();
+    }
+
+    // Dump IQ history on the trigger events.
+    if (iq_history) {
+      const char *reason = nullptr;
+      bool squelch_open = if_rms >= squelch_level;
+      if (dump_flag.exchange(false)) {
+        reason = "sigusr2";
+      } else if (if_exists && squelch_open && !prev_squelch_open) {
+        reason = "squelch";
+      } else if (modtype == ModType::FM &&
+                 fm.get_multipath_reset_count() != prev_multipath_reset_count) {
+        reason = "multipath";
+      }
+      if (if_exists) {
+        prev_squelch_open = squelch_open;
+      }
+      if (modtype == ModType::FM) {
+        prev_multipath_reset_count = fm.get_multipath_reset_count();
+      }
+      if (reason != nullptr) {
+        std::string dumpname = iq_history_filename(reason);
+        if (iq_history->dump(dumpname)) {
+          fprintf(stderr, "\ndumping IQ history to '%s'\n", dumpname.c_str());
+        } else {
+          fprintf(stderr, "\nWARNING: IQ history dump failed: %s\n",
+                  iq_history->error().c_str());
+        }
+      }
     }
 
     if (modtype == ModType::FM) {
@@ -1052,6 +1820,38 @@ int main(int argc, char **argv) {
       }
     }
 
+    // Write RDS data.
+    if (rdsfile != nullptr) {
+      const RdsDecoder &rds = fm.get_rds_decoder();
+      for (const RdsDecoder::Group &group : rds.get_groups()) {
+        fprintf(rdsfile, "group %14s %04X %04X %04X %04X\n",
+                std::to_string(group.sample_index).c_str(), group.blocks[0],
+                group.blocks[1], group.blocks[2], group.blocks[3]);
+      }
+      if (rds.get_pi() != rds_pi) {
+        rds_pi = rds.get_pi();
+        fprintf(rdsfile, "pi %04X\n", rds_pi);
+      }
+      if (rds.get_ps() != rds_ps) {
+        rds_ps = rds.get_ps();
+        fprintf(rdsfile, "ps \"%s\"\n", rds_ps.c_str());
+      }
+      if (rds.get_rt() != rds_rt) {
+        rds_rt = rds.get_rt();
+        fprintf(rdsfile, "rt \"%s\"\n", rds_rt.c_str());
+      }
+      if (!rds.get_groups().empty()) {
+        fflush(rdsfile);
+      }
+    }
+
+    // Save the decoder state every ~60 seconds after the startup.
+    if (decoder_state_writer && (block > discarding_blocks) &&
+        ((block % (stat_rate * 600)) == 0)) {
+      update_decoder_state();
+      decoder_state_writer->save(decoder_state);
+    }
+
     // Throw away first blocks before stereo pilot locking is completed.
     // They are noisy because IF filters are still starting up.
     // (Increased from one to support high sampling rates)
@@ -1059,10 +1859,20 @@ int main(int argc, char **argv) {
       // Write samples to output.
       // Always use buffered write.
       output_buffer.push(std::move(audiosamples));
+      // Take a block recycled by the output thread for the next output.
+      audiosamples = output_buffer.get_block(0);
     }
+
+    // Return the source block for reuse by the source thread.
+    source_buffer.recycle(std::move(iqsamples));
   }
 
   fprintf(stderr, "\n");
+  long dsp_thread_switches = ThreadPolicy::involuntary_switches();
+  const MemoryLock::PageFaults dsp_faults_end =
+      MemoryLock::thread_page_faults();
+  const MemoryLock::PageFaults process_faults_end =
+      MemoryLock::process_page_faults();
 
   // Join background threads.
   up_srcsdr->stop();
@@ -1070,6 +1880,136 @@ int main(int argc, char **argv) {
   output_buffer.push_end();
   output_thread.join();
 
+  // Show the wakeup latency of the threads waiting for the samples,
+  // and the number of times they are preempted.
+  struct ThreadStats {
+    const char *name;
+    DataBufferWakeupStats wakeup;
+    long switches;
+  };
+  const ThreadStats thread_stats[] = {
+      {"dsp", source_buffer.get_wakeup_stats(), dsp_thread_switches},
+      {"output", output_buffer.get_wakeup_stats(),
+       output_thread_switches.load()}};
+  for (const ThreadStats &stats : thread_stats) {
+    fprintf(stderr, "Thread %s wakeup latency: %s waits", stats.name,
+            std::to_string(stats.wakeup.count).c_str());
+    if (stats.wakeup.count > 0) {
+      fprintf(stderr, ", mean %.1f [us], max %.1f [us]",
+              stats.wakeup.total / stats.wakeup.count * 1.0e6,
+              stats.wakeup.max * 1.0e6);
+    }
+    if (stats.switches >= 0) {
+      fprintf(stderr, ", involuntary context switches: %ld", stats.switches);
+    }
+    fprintf(stderr, "\n");
+  }
+  fprintf(stderr,
+          "Page faults in the main loop: dsp thread minor %ld, major %ld, "
+          "process minor %ld, major %ld\n",
+          dsp_faults_end.minor - dsp_faults_start.minor,
+          dsp_faults_end.major - dsp_faults_start.major,
+          process_faults_end.minor - process_faults_start.minor,
+          process_faults_end.major - process_faults_start.major);
+
+  if (decoder_state_writer) {
+    // Finish the periodic save in progress, and save the last state.
+    decoder_state_writer.reset();
+    update_decoder_state();
+    if (!decoder_state.save(statefilename)) {
+      fprintf(stderr, "ERROR: can not write '%s'\n", statefilename.c_str());
+    }
+  }
+
+  if ((modtype == ModType::FM) && (multipathfilter_stages > 0)) {
+    // Show the time and CPU load for each coefficient update interval.
+    const MultipathFilter &mf = fm.get_multipath_filter();
+    for (unsigned int i = 0; i < MultipathFilter::update_interval_levels;
+         i++) {
+      std::uint64_t samples = mf.get_level_samples()[i];
+      double cpu_time = mf.get_level_cpu_time()[i];
+      fprintf(stderr,
+              "Multipath filter update every %2u samples: %.1f [s], "
+              "CPU %.1f [ns/sample]\n",
+              MultipathFilter::update_intervals[i],
+              samples / FmDecoder::sample_rate_if,
+              samples > 0 ? cpu_time / samples * 1.0e9 : 0.0);
+    }
+    if (mf.get_algorithm() == MultipathFilter::Algorithm::IpnlmsSparse) {
+      fprintf(stderr, "Multipath filter taps updated at last: %u of %zu\n",
+              mf.get_active_taps(), mf.get_coefficients().size());
+    }
+  }
+
+  if ((modtype == ModType::FM) && stereo && stereo_gating) {
+    fprintf(stderr, "Stereo decoding skipped without pilot lock: %.1f [s]\n",
+            fm.get_stereo_skipped_samples() / FmDecoder::sample_rate_if);
+  }
+
+  if (ifrate_calibrator && ifrate_calibrator->calibrated()) {
+    fprintf(stderr,
+            "IF sample rate calibration: %.3f [ppm] "
+            "(pilot averaged for %.0f [s])\n",
+            ifrate_calibrator->get_ppm(), ifrate_calibrator->get_duration());
+    if (!IfRateCalibrator::save(calibration_filename, calibration_device,
+                                ifrate_calibrator->get_ppm())) {
+      fprintf(stderr, "ERROR: can not write '%s'\n",
+              calibration_filename.c_str());
+    }
+  }
+
+  if (encoder_output) {
+    double encoded_sec = encoder_output->get_encoded_frames() / double(pcmrate);
+    double cpu_sec = encoder_output->get_cpu_time();
+    fprintf(stderr,
+            "%s encoder: %.1f [s] encoded, CPU time %.3f [s] "
+            "(%.2f%% of real time)\n",
+            EncoderAudioOutput::codec_name(codec), encoded_sec, cpu_sec,
+            encoded_sec > 0 ? 100.0 * cpu_sec / encoded_sec : 0.0);
+  }
+
+  if (callback_output) {
+    fprintf(stderr,
+            "PortAudio callback output: %s underruns, "
+            "%s overruns (%s frames dropped), ratio %+.1f ppm\n",
+            std::to_string(callback_output->get_underruns()).c_str(),
+            std::to_string(callback_output->get_overruns()).c_str(),
+            std::to_string(callback_output->get_dropped_frames()).c_str(),
+            callback_output->get_ratio_ppm());
+  }
+
+  if (net_output) {
+    fprintf(stderr,
+            "RTP output: %s packets sent, %s packets dropped, "
+            "%s schedule resyncs\n",
+            std::to_string(net_output->get_sent_packets()).c_str(),
+            std::to_string(net_output->get_dropped_packets()).c_str(),
+            std::to_string(net_output->get_resyncs()).c_str());
+  }
+
+  if (iq_recorder) {
+    // Write the remaining samples.
+    iq_recorder->close();
+    if (!(*iq_recorder)) {
+      fprintf(stderr, "ERROR: IqRecorder: %s\n", iq_recorder->error().c_str());
+    }
+    fprintf(stderr,
+            "IQ recording: %s samples written, "
+            "%s blocks (%s samples) dropped\n",
+            std::to_string(iq_recorder->get_written_samples()).c_str(),
+            std::to_string(iq_recorder->get_dropped_blocks()).c_str(),
+            std::to_string(iq_recorder->get_dropped_samples()).c_str());
+  }
+
+  if (mpx_output) {
+    mpx_buffer.push_end();
+    mpx_thread.join();
+    if (mpx_dropped_blocks > 0) {
+      fprintf(stderr, "MPX output: %s blocks dropped\n",
+              std::to_string(mpx_dropped_blocks).c_str());
+    }
+  }
+
   // No cleanup needed; everything handled by destructors
 
   return 0;
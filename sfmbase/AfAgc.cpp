@@ -31,6 +31,9 @@ AfAgc::AfAgc(const double initial_gain, const double max_gain,
   // Do nothing
 }
 
+// Allocate the buffer in advance.
+void AfAgc::reserve(std::size_t n) { m_gain.reserve(n); }
+
 // AF AGC.
 // Algorithm shown in:
 // https://www.mathworks.com/help/comm/ref/comm.agc-system-object.html
@@ -44,12 +47,11 @@ void AfAgc::process(const SampleVector &samples_in, SampleVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
 
-  volk::vector<double> gain;
-  gain.resize(n);
+  m_gain.resize(n);
 
   for (unsigned int i = 0; i < n; i++) {
     // Store current gain.
-    gain[i] = std::exp(m_log_current_gain);
+    m_gain[i] = std::exp(m_log_current_gain);
     // Update the current gain.
     // Note: the original algorithm multiplied the abs(input)
     //       with the current gain (exp(log_current_gain))
@@ -66,8 +68,8 @@ void AfAgc::process(const SampleVector &samples_in, SampleVector &samples_out) {
     m_log_current_gain = new_log_current_gain;
   }
   // Compute output based on the current gain.
-  volk_64f_x2_multiply_64f(samples_out.data(), samples_in.data(), gain.data(),
-                           n);
+  volk_64f_x2_multiply_64f(samples_out.data(), samples_in.data(),
+                           m_gain.data(), n);
 }
 
 // end
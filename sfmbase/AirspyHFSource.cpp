@@ -28,6 +28,7 @@
 
 #include "AirspyHFSource.h"
 #include "ConfigParser.h"
+#include "ThreadPolicy.h"
 
 // #define DEBUG_AIRSPYHFSOURCE 1
 
@@ -373,6 +374,8 @@ void AirspyHFSource::run(airspyhf_device *dev, std::atomic_bool *stop_flag) {
 #ifdef DEBUG_AIRSPYSOURCE
   std::cerr << "AirspyHFSource::run" << std::endl;
 #endif
+  // The libairspyhf threads started here inherit the placement.
+  ThreadPolicy::apply(ThreadPolicy::Role::Source);
   airspyhf_error rc = (airspyhf_error)airspyhf_start(dev, rx_callback, nullptr);
 
   if (rc == AIRSPYHF_SUCCESS) {
@@ -412,9 +415,8 @@ int AirspyHFSource::rx_callback(airspyhf_transfer_t *transfer) {
 }
 
 void AirspyHFSource::callback(const float *buf, int len) {
-  IQSampleVector iqsamples;
-
-  iqsamples.resize(len / 2);
+  // Reuse a block recycled by the consumer.
+  IQSampleVector iqsamples = m_buf->get_block(len / 2);
 
   for (int i = 0, j = 0; i < len; i += 2, j++) {
     float re = buf[i];
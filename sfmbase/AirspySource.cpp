@@ -27,6 +27,7 @@
 
 #include "AirspySource.h"
 #include "ConfigParser.h"
+#include "ThreadPolicy.h"
 
 // #define DEBUG_AIRSPYSOURCE 1
 
@@ -47,7 +48,8 @@ const std::vector<int> AirspySource::m_vgains({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
 AirspySource::AirspySource(int dev_index)
     : m_dev(0), m_sampleRate(10000000), m_frequency(100000000), m_lnaGain(8),
       m_mixGain(0), m_vgaGain(10), m_biasAnt(false), m_lnaAGC(false),
-      m_mixAGC(false), m_running(false), m_thread(0) {
+      m_mixAGC(false), m_int16(false), m_running(false),
+      m_realConverter(1.0f / 32768.0f), m_thread(0) {
 
   // Get library version number first.
   airspy_lib_version(&m_libv);
@@ -208,11 +210,15 @@ void AirspySource::print_specific_parms() {
   fprintf(stderr, "Antenna bias: %s", m_biasAnt ? "on" : "off");
   fprintf(stderr, " / LNA AGC: %s", m_lnaAGC ? "on" : "off");
   fprintf(stderr, " / Mixer AGC: %s\n", m_mixAGC ? "on" : "off");
+  fprintf(stderr, "Sample type: %s\n",
+          m_int16 ? "INT16_REAL (in-house conversion)"
+                  : "FLOAT32_IQ (libairspy conversion)");
 }
 
 bool AirspySource::configure(int sampleRateIndex, uint32_t frequency,
                              bool bias_ant, int lna_gain, int mix_gain,
-                             int vga_gain, bool lna_agc, bool mix_agc) {
+                             int vga_gain, bool lna_agc, bool mix_agc,
+                             bool int16) {
   m_frequency = frequency;
   m_biasAnt = bias_ant;
   m_lnaGain = lna_gain;
@@ -220,6 +226,7 @@ bool AirspySource::configure(int sampleRateIndex, uint32_t frequency,
   m_vgaGain = vga_gain;
   m_lnaAGC = lna_agc;
   m_mixAGC = mix_agc;
+  m_int16 = int16;
 
   airspy_error rc;
 
@@ -303,6 +310,22 @@ bool AirspySource::configure(int sampleRateIndex, uint32_t frequency,
     return false;
   }
 
+  if (m_int16) {
+    // Receive the real samples at twice the sample rate
+    // and convert them by RealConverterIQ,
+    // skipping the libairspy float conversion and the extra copy.
+    rc = (airspy_error)airspy_set_sample_type(m_dev, AIRSPY_SAMPLE_INT16_REAL);
+
+    if (rc != AIRSPY_SUCCESS) {
+      std::ostringstream err_ostr;
+      err_ostr << "Could not set sample type to INT16_REAL";
+      m_error = err_ostr.str();
+      return false;
+    }
+
+    return true;
+  }
+
   // A halfband filter kernel for filtering aliases.
   // Twitter @lambdaprog says:
   // "This half band sets the aliasing ratio of the IQ conversion.
@@ -337,6 +360,7 @@ bool AirspySource::configure(std::string configurationStr) {
   bool antBias = false;
   bool lnaAGC = false;
   bool mixAGC = false;
+  bool int16 = false;
   ConfigParser cp;
   ConfigParser::map_type m;
 
@@ -452,11 +476,18 @@ bool AirspySource::configure(std::string configurationStr) {
     mixAGC = true;
   }
 
+  if (m.find("int16") != m.end()) {
+#ifdef DEBUG_AIRSPYSOURCE
+    std::cerr << "AirspySource::configure: int16" << std::endl;
+#endif
+    int16 = true;
+  }
+
   m_confFreq = frequency;
   // tuner_freq shift no longer required
   double tuner_freq = frequency;
   return configure(sampleRateIndex, tuner_freq, antBias, lnaGain, mixGain,
-                   vgaGain, lnaAGC, mixAGC);
+                   vgaGain, lnaAGC, mixAGC, int16);
 }
 
 bool AirspySource::start(DataBuffer<IQSample> *buf,
@@ -482,6 +513,8 @@ void AirspySource::run(airspy_device *dev, std::atomic_bool *stop_flag) {
 #ifdef DEBUG_AIRSPYSOURCE
   std::cerr << "AirspySource::run" << std::endl;
 #endif
+  // The libairspy threads started here inherit the placement.
+  ThreadPolicy::apply(ThreadPolicy::Role::Source);
   airspy_error rc = (airspy_error)airspy_start_rx(dev, rx_callback, 0);
 
   if (rc == AIRSPY_SUCCESS) {
@@ -511,19 +544,23 @@ bool AirspySource::stop() {
 }
 
 int AirspySource::rx_callback(airspy_transfer_t *transfer) {
-  int len = transfer->sample_count * 2; // interleaved I/Q samples
-
   if (m_this) {
-    m_this->callback((float *)transfer->samples, len);
+    if (m_this->m_int16) {
+      // real samples at twice the sample rate
+      m_this->callback_int16((int16_t *)transfer->samples,
+                             transfer->sample_count);
+    } else {
+      int len = transfer->sample_count * 2; // interleaved I/Q samples
+      m_this->callback((float *)transfer->samples, len);
+    }
   }
 
   return 0;
 }
 
 void AirspySource::callback(const float *buf, int len) {
-  IQSampleVector iqsamples;
-
-  iqsamples.resize(len / 2);
+  // Reuse a block recycled by the consumer.
+  IQSampleVector iqsamples = m_buf->get_block(len / 2);
 
   for (int i = 0, j = 0; i < len; i += 2, j++) {
     float re = buf[i];
@@ -533,3 +570,11 @@ void AirspySource::callback(const float *buf, int len) {
 
   m_buf->push(std::move(iqsamples));
 }
+
+void AirspySource::callback_int16(const int16_t *buf, int len) {
+  IQSampleVector iqsamples = m_buf->get_block(0);
+
+  m_realConverter.process(buf, len, iqsamples);
+
+  m_buf->push(std::move(iqsamples));
+}
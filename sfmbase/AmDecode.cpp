@@ -132,6 +132,22 @@ AmDecoder::AmDecoder(IQSampleCoeff &amfilter_coeff, const ModType mode)
   // Do nothing
 }
 
+void AmDecoder::reserve(std::size_t n) {
+  m_buf_filtered.reserve(n);
+  m_buf_filtered2.reserve(n);
+  m_buf_filtered2a.reserve(n);
+  m_buf_filtered2b.reserve(n);
+  m_buf_filtered3.reserve(n);
+  m_buf_filtered4.reserve(n);
+  m_buf_decoded.reserve(n);
+  m_buf_baseband_demod.reserve(n);
+  m_buf_baseband_preagc.reserve(n);
+  m_buf_baseband.reserve(n);
+  m_buf_mono.reserve(n);
+  m_ifagc.reserve(n);
+  m_afagc.reserve(n);
+}
+
 void AmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
   switch (m_mode) {
   case ModType::AM:
@@ -174,7 +190,7 @@ void AmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
     m_finetuner.process(m_buf_filtered2b, m_buf_filtered3);
     break;
   default:
-    m_buf_filtered3 = std::move(m_buf_filtered);
+    m_buf_filtered3.swap(m_buf_filtered);
     break;
   }
 
@@ -212,10 +228,10 @@ void AmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
     return;
   }
 
-  // Convert decoded data to baseband data
-  m_buf_baseband_demod.resize(decoded_size);
-  volk_32f_convert_64f(m_buf_baseband_demod.data(), m_buf_decoded.data(),
-                       decoded_size);
+  // Convert decoded data to baseband data,
+  // and measure baseband level in the same pass.
+  m_baseband_meter.reset();
+  m_baseband_meter.convert(m_buf_decoded, m_buf_baseband_demod);
 
   // DC blocking.
   m_dcblock.process_inplace(m_buf_baseband_demod);
@@ -229,17 +245,38 @@ void AmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
   // Audio AGC
   m_afagc.process(m_buf_baseband_demod, m_buf_baseband);
 
-  // Measure baseband level after DC blocking.
-  float baseband_mean, baseband_rms;
-  Utility::samples_mean_rms(m_buf_decoded, baseband_mean, baseband_rms);
-  m_baseband_mean = 0.95 * m_baseband_mean + 0.05 * baseband_mean;
-  m_baseband_level = 0.95 * m_baseband_level + 0.05 * baseband_rms;
+  // Update baseband level measured before DC blocking.
+  m_baseband_mean = 0.95 * m_baseband_mean + 0.05 * m_baseband_meter.mean();
+  m_baseband_level = 0.95 * m_baseband_level + 0.05 * m_baseband_meter.rms();
 
   // Deemphasis
   m_deemph.process_inplace(m_buf_baseband);
 
   // Return mono channel.
-  audio = std::move(m_buf_baseband);
+  audio.swap(m_buf_baseband);
+}
+
+// Return the processing cost of the FIR filter stages used for the mode.
+std::vector<FilterStageCost> AmDecoder::get_filter_costs() const {
+  std::vector<FilterStageCost> costs;
+  switch (m_mode) {
+  case ModType::AM:
+  case ModType::DSB:
+    costs.push_back(m_amfilter.get_cost("AM IF filter", internal_rate_pcm));
+    break;
+  case ModType::USB:
+  case ModType::LSB:
+    costs.push_back(m_ssbfilter.get_cost("SSB IF filter", internal_rate_pcm));
+    costs.push_back(
+        m_ssbshiftfilter.get_cost("SSB shifted filter", internal_rate_pcm));
+    break;
+  case ModType::CW:
+    costs.push_back(m_cwfilter.get_cost("CW IF filter", cw_rate_pcm));
+    break;
+  default:
+    break;
+  }
+  return costs;
 }
 
 // Demodulate AM signal.
@@ -23,7 +23,14 @@
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
 #include <fcntl.h>
+#include <netdb.h>
+#include <random>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
 #include <unistd.h>
 
 #include "AudioOutput.h"
@@ -269,6 +276,365 @@ template <typename T> void WavAudioOutput::set_value(uint8_t *ptr, T value) {
   }
 }
 
+/* ****************  class EncoderAudioOutput  **************** */
+
+// Construct encoder writer.
+EncoderAudioOutput::EncoderAudioOutput(const std::string &filename,
+                                       Codec codec, unsigned int samplerate,
+                                       bool stereo)
+    : m_nchannels(stereo ? 2 : 1), m_sndfile(nullptr), m_encoded_frames(0),
+      m_cpu_time(0) {
+  SF_INFO sfinfo;
+  memset(&sfinfo, 0, sizeof(sfinfo));
+  sfinfo.samplerate = samplerate;
+  sfinfo.channels = m_nchannels;
+
+  switch (codec) {
+  case Codec::FLAC:
+    sfinfo.format = SF_FORMAT_FLAC | SF_FORMAT_PCM_24;
+    break;
+  case Codec::Opus:
+#ifdef HAVE_SF_FORMAT_OPUS
+    sfinfo.format = SF_FORMAT_OGG | SF_FORMAT_OPUS;
+    break;
+#else
+    m_error = "Opus encoding requires libsndfile 1.0.29 or later";
+    m_zombie = true;
+    return;
+#endif
+  }
+
+  if (!sf_format_check(&sfinfo)) {
+    m_error = std::string(codec_name(codec)) +
+              " encoding is not supported by libsndfile"
+              " at this sample rate";
+    m_zombie = true;
+    return;
+  }
+
+  m_sndfile = sf_open(filename.c_str(), SFM_WRITE, &sfinfo);
+  if (m_sndfile == nullptr) {
+    m_error = "can not open '" + filename + "' (" + sf_strerror(nullptr) + ")";
+    m_zombie = true;
+    return;
+  }
+
+  // Limit output within [-1.0, 1.0] as the integer outputs.
+  sf_command(m_sndfile, SFC_SET_CLIPPING, nullptr, SF_TRUE);
+
+  m_device_name = "EncoderAudioOutput";
+}
+
+// Destructor.
+EncoderAudioOutput::~EncoderAudioOutput() {
+  if (m_sndfile) {
+    // Encode the remaining samples and finish the stream.
+    sf_close(m_sndfile);
+  }
+}
+
+// Choose codec from the file name extension.
+bool EncoderAudioOutput::parse_codec(const std::string &filename,
+                                     Codec &codec) {
+  std::size_t dot = filename.rfind('.');
+  if (dot == std::string::npos) {
+    return false;
+  }
+  std::string ext = filename.substr(dot + 1);
+  if (strcasecmp(ext.c_str(), "flac") == 0) {
+    codec = Codec::FLAC;
+  } else if (strcasecmp(ext.c_str(), "opus") == 0 ||
+             strcasecmp(ext.c_str(), "ogg") == 0) {
+    codec = Codec::Opus;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Return the codec name.
+const char *EncoderAudioOutput::codec_name(Codec codec) {
+  switch (codec) {
+  case Codec::FLAC:
+    return "FLAC";
+  case Codec::Opus:
+    return "Opus";
+  }
+  return "unknown";
+}
+
+// Write audio data.
+bool EncoderAudioOutput::write(const SampleVector &samples) {
+  if (m_zombie) {
+    return false;
+  }
+
+  return encode(samples.data(), samples.size() / m_nchannels);
+}
+
+// Encode the given interleaved samples.
+bool EncoderAudioOutput::encode(const Sample *samples, unsigned int nframes) {
+  struct timespec start, end;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+  sf_count_t k = sf_writef_double(m_sndfile, samples, nframes);
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+  m_cpu_time +=
+      (end.tv_sec - start.tv_sec) + 1.0e-9 * (end.tv_nsec - start.tv_nsec);
+
+  if (k != sf_count_t(nframes)) {
+    m_error = "encode failed (";
+    m_error += sf_strerror(m_sndfile);
+    m_error += ")";
+    return false;
+  }
+  m_encoded_frames += nframes;
+
+  return true;
+}
+
+/* ****************  class NetAudioOutput  **************** */
+
+constexpr double NetAudioOutput::max_schedule_delay;
+
+// Construct network audio output stream.
+NetAudioOutput::NetAudioOutput(const std::string &destination,
+                               unsigned int samplerate, bool stereo,
+                               bool float32)
+    : m_nchannels(stereo ? 2 : 1), m_samplerate(samplerate),
+      m_float32(float32), m_fd(-1), m_marker(true), m_schedule_frames(0),
+      m_sent_packets(0), m_dropped_packets(0), m_resyncs(0) {
+  unsigned int frame_size = m_nchannels * (m_float32 ? 4 : 2);
+  m_packet_frames = max_payload_size / frame_size;
+  m_packet.resize(rtp_header_size + m_packet_frames * frame_size);
+  m_pending.reserve(m_packet_frames * m_nchannels);
+
+  // Initial RTP values should be random (RFC 3550).
+  std::random_device rd;
+  m_sequence = rd() & 0xffff;
+  m_timestamp = rd();
+  m_ssrc = rd();
+
+  if (destination.compare(0, 5, "unix:") == 0) {
+    // Unix datagram socket, sent to the path for each packet
+    // so that the receiver can be restarted.
+    std::string path = destination.substr(5);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+      m_error = "invalid Unix socket path '" + path + "'";
+      m_zombie = true;
+      return;
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    m_addr.resize(sizeof(addr));
+    memcpy(m_addr.data(), &addr, sizeof(addr));
+    m_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (m_fd < 0) {
+      m_error = "can not create socket (";
+      m_error += strerror(errno);
+      m_error += ")";
+      m_zombie = true;
+      return;
+    }
+  } else {
+    // UDP, as host:port or [host]:port for IPv6 addresses.
+    std::size_t colon = destination.rfind(':');
+    if (colon == std::string::npos || colon == 0 ||
+        colon + 1 == destination.size()) {
+      m_error = "invalid destination '" + destination + "'";
+      m_zombie = true;
+      return;
+    }
+    std::string host = destination.substr(0, colon);
+    std::string port = destination.substr(colon + 1);
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+      host = host.substr(1, host.size() - 2);
+    }
+    struct addrinfo hints;
+    struct addrinfo *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int r = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (r != 0) {
+      m_error = "can not resolve '" + destination + "' (";
+      m_error += gai_strerror(r);
+      m_error += ")";
+      m_zombie = true;
+      return;
+    }
+    m_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (m_fd >= 0 && connect(m_fd, res->ai_addr, res->ai_addrlen) < 0) {
+      close(m_fd);
+      m_fd = -1;
+    }
+    freeaddrinfo(res);
+    if (m_fd < 0) {
+      m_error = "can not open socket to '" + destination + "' (";
+      m_error += strerror(errno);
+      m_error += ")";
+      m_zombie = true;
+      return;
+    }
+  }
+
+  m_device_name = "NetAudioOutput " + destination;
+}
+
+// Destructor.
+NetAudioOutput::~NetAudioOutput() {
+  if (m_fd >= 0) {
+    // Send the remaining samples as a shorter packet.
+    if (!m_pending.empty()) {
+      send_packet(m_pending.data(), m_pending.size() / m_nchannels);
+    }
+    close(m_fd);
+  }
+}
+
+// Write audio data.
+bool NetAudioOutput::write(const SampleVector &samples) {
+  if (m_zombie) {
+    return false;
+  }
+
+  const std::size_t packet_samples = m_packet_frames * m_nchannels;
+  std::size_t p = 0;
+  std::size_t n = samples.size();
+
+  // Complete the pending packet first.
+  if (!m_pending.empty()) {
+    std::size_t k = std::min(packet_samples - m_pending.size(), n);
+    m_pending.insert(m_pending.end(), samples.begin(), samples.begin() + k);
+    p = k;
+    if (m_pending.size() < packet_samples) {
+      return true;
+    }
+    if (!send_packet(m_pending.data(), m_packet_frames)) {
+      return false;
+    }
+    m_pending.clear();
+  }
+
+  // Send full packets directly from the input.
+  while (n - p >= packet_samples) {
+    if (!send_packet(samples.data() + p, m_packet_frames)) {
+      return false;
+    }
+    p += packet_samples;
+  }
+
+  // Keep the rest for the next packet.
+  m_pending.insert(m_pending.end(), samples.begin() + p, samples.end());
+
+  return true;
+}
+
+// Build and send a packet from the given interleaved samples.
+bool NetAudioOutput::send_packet(const Sample *samples, unsigned int nframes) {
+  // Wait until the scheduled time of the packet,
+  // so that the packets are sent at the sample rate
+  // even if the samples are written in large blocks.
+  typedef std::chrono::steady_clock clock;
+  clock::time_point now = clock::now();
+  if (m_schedule_frames == 0) {
+    m_schedule_start = now;
+  }
+  clock::time_point deadline =
+      m_schedule_start + std::chrono::duration_cast<clock::duration>(
+                             std::chrono::duration<double>(
+                                 double(m_schedule_frames) / m_samplerate));
+  if (now - deadline > std::chrono::duration<double>(max_schedule_delay)) {
+    // Too late; restart the schedule and mark the discontinuity.
+    m_schedule_start = now;
+    m_schedule_frames = 0;
+    m_marker = true;
+    m_resyncs++;
+  } else if (now < deadline) {
+    std::this_thread::sleep_until(deadline);
+  }
+  m_schedule_frames += nframes;
+
+  // RTP header (RFC 3550).
+  std::uint8_t *h = m_packet.data();
+  h[0] = 0x80; // version 2, no padding, no extension, no CSRC
+  h[1] = (m_marker ? 0x80 : 0) | rtp_payload_type;
+  h[2] = (m_sequence >> 8) & 0xff;
+  h[3] = m_sequence & 0xff;
+  h[4] = (m_timestamp >> 24) & 0xff;
+  h[5] = (m_timestamp >> 16) & 0xff;
+  h[6] = (m_timestamp >> 8) & 0xff;
+  h[7] = m_timestamp & 0xff;
+  h[8] = (m_ssrc >> 24) & 0xff;
+  h[9] = (m_ssrc >> 16) & 0xff;
+  h[10] = (m_ssrc >> 8) & 0xff;
+  h[11] = m_ssrc & 0xff;
+
+  // Payload in network byte order.
+  std::uint8_t *k = h + rtp_header_size;
+  const unsigned int nsamples = nframes * m_nchannels;
+  if (m_float32) {
+    for (unsigned int i = 0; i < nsamples; i++) {
+      // Union for converting float and uint32_t.
+      union {
+        float f;
+        uint32_t u32;
+      } v;
+      // Note: no output range limitation.
+      v.f = (float)samples[i];
+      uint32_t u = v.u32;
+      *(k++) = (u >> 24) & 0xff;
+      *(k++) = (u >> 16) & 0xff;
+      *(k++) = (u >> 8) & 0xff;
+      *(k++) = u & 0xff;
+    }
+  } else {
+    for (unsigned int i = 0; i < nsamples; i++) {
+      // Limit output within [-1.0, 1.0].
+      Sample s = std::max(Sample(-1.0), std::min(Sample(1.0), samples[i]));
+      // Convert output to [-32767, 32767].
+      unsigned long u = lrint(s * 32767);
+      *(k++) = (u >> 8) & 0xff;
+      *(k++) = u & 0xff;
+    }
+  }
+
+  // Never block on a slow or missing receiver; count the packet as dropped.
+  std::size_t len = k - h;
+  ssize_t r;
+  if (m_addr.empty()) {
+    r = send(m_fd, h, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  } else {
+    r = sendto(m_fd, h, len, MSG_DONTWAIT | MSG_NOSIGNAL,
+               reinterpret_cast<const struct sockaddr *>(m_addr.data()),
+               m_addr.size());
+  }
+  if (r < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS ||
+        errno == ECONNREFUSED || errno == ENOENT || errno == EINTR) {
+      m_dropped_packets++;
+    } else {
+      m_error = "send failed (";
+      m_error += strerror(errno);
+      m_error += ")";
+      return false;
+    }
+  } else {
+    m_sent_packets++;
+    m_marker = false;
+  }
+
+  // Sequence numbers and timestamps advance for dropped packets too,
+  // so that the receiver can detect the loss.
+  m_sequence++;
+  m_timestamp += nframes;
+
+  return true;
+}
+
 // Class PortAudioOutput
 
 // Construct PortAudio output stream.
@@ -370,4 +736,228 @@ void PortAudioOutput::add_paerror(const std::string &premsg) {
   m_zombie = true;
 }
 
+// Class PortAudioCallbackOutput
+
+// Construct PortAudio callback output stream.
+PortAudioCallbackOutput::PortAudioCallbackOutput(
+    const PaDeviceIndex device_index, unsigned int samplerate, bool stereo)
+    : m_nchannels(stereo ? 2 : 1), m_samplerate(samplerate),
+      m_stream(nullptr), m_write_pos(0), m_read_pos(0), m_playing(false),
+      m_underruns(0), m_overruns(0), m_dropped_frames(0),
+      m_level_integral(0), m_ratio_deviation(0), m_position(1) {
+  // Ring buffer size as a power of 2 for index masking.
+  m_ring_frames = 1;
+  while (m_ring_frames < ring_capacity * samplerate) {
+    m_ring_frames <<= 1;
+  }
+  m_ring.resize(m_ring_frames * m_nchannels);
+  m_target_frames = lrint(target_latency * samplerate);
+  m_level_average = m_target_frames;
+
+  // Start from silence as the preceding input.
+  m_history.assign(3 * m_nchannels, 0);
+
+  m_paerror = Pa_Initialize();
+  if (m_paerror != paNoError) {
+    add_paerror("Pa_Initialize()");
+    return;
+  }
+
+  if (device_index == -1) {
+    m_outputparams.device = Pa_GetDefaultOutputDevice();
+  } else {
+    PaDeviceIndex index = static_cast<PaDeviceIndex>(device_index);
+    if (index >= Pa_GetDeviceCount()) {
+      add_paerror("Device number out of range");
+      return;
+    }
+    m_outputparams.device = index;
+  }
+  if (m_outputparams.device == paNoDevice) {
+    add_paerror("No default output device");
+    return;
+  }
+  m_device_name = Pa_GetDeviceInfo(m_outputparams.device)->name;
+
+  m_outputparams.channelCount = m_nchannels;
+  m_outputparams.sampleFormat = paFloat32;
+  m_outputparams.suggestedLatency =
+      Pa_GetDeviceInfo(m_outputparams.device)->defaultLowOutputLatency;
+  m_outputparams.hostApiSpecificStreamInfo = NULL;
+
+  m_paerror =
+      Pa_OpenStream(&m_stream,
+                    NULL, // no input
+                    &m_outputparams, samplerate, paFramesPerBufferUnspecified,
+                    paClipOff, // no clipping
+                    callback, this);
+  if (m_paerror != paNoError) {
+    add_paerror("Pa_OpenStream()");
+    return;
+  }
+
+  m_paerror = Pa_StartStream(m_stream);
+  if (m_paerror != paNoError) {
+    add_paerror("Pa_StartStream()");
+    return;
+  }
+}
+
+// Destructor.
+PortAudioCallbackOutput::~PortAudioCallbackOutput() {
+  if (m_zombie) {
+    return;
+  }
+  m_paerror = Pa_StopStream(m_stream);
+  if (m_paerror != paNoError) {
+    add_paerror("Pa_StopStream()");
+    return;
+  }
+  Pa_Terminate();
+}
+
+// PortAudio stream callback.
+// This runs in the PortAudio real-time thread; no locks or allocations.
+int PortAudioCallbackOutput::callback(
+    const void *input, void *output, unsigned long frame_count,
+    const PaStreamCallbackTimeInfo *time_info,
+    PaStreamCallbackFlags status_flags, void *user_data) {
+  PortAudioCallbackOutput *self =
+      static_cast<PortAudioCallbackOutput *>(user_data);
+  float *out = static_cast<float *>(output);
+  const unsigned int nchannels = self->m_nchannels;
+  const std::uint64_t read_pos =
+      self->m_read_pos.load(std::memory_order_relaxed);
+  const std::uint64_t available =
+      self->m_write_pos.load(std::memory_order_acquire) - read_pos;
+
+  if (!self->m_playing.load(std::memory_order_relaxed)) {
+    // Wait until the ring buffer is filled up to the target level.
+    if (available < self->m_target_frames) {
+      std::fill(out, out + frame_count * nchannels, 0.0f);
+      return paContinue;
+    }
+    self->m_playing.store(true, std::memory_order_relaxed);
+  }
+
+  std::uint64_t n = std::min(available, std::uint64_t(frame_count));
+  std::uint64_t index = read_pos & (self->m_ring_frames - 1);
+  std::uint64_t first = std::min(n, self->m_ring_frames - index);
+  const float *ring = self->m_ring.data();
+  std::copy(ring + index * nchannels, ring + (index + first) * nchannels,
+            out);
+  std::copy(ring, ring + (n - first) * nchannels, out + first * nchannels);
+
+  if (n < frame_count) {
+    // Underrun; fill with silence and wait for the target level again.
+    std::fill(out + n * nchannels, out + frame_count * nchannels, 0.0f);
+    self->m_underruns.fetch_add(1, std::memory_order_relaxed);
+    self->m_playing.store(false, std::memory_order_relaxed);
+  }
+
+  self->m_read_pos.store(read_pos + n, std::memory_order_release);
+  return paContinue;
+}
+
+// Update the resampling ratio from the ring buffer level.
+void PortAudioCallbackOutput::update_ratio(std::uint64_t level,
+                                           std::size_t nframes) {
+  // The level is sampled just before each write,
+  // and smoothed to remove the jitter of the write timing.
+  m_level_average += level_smoothing * (double(level) - m_level_average);
+
+  // Level error and write interval in seconds.
+  double error = (m_level_average - double(m_target_frames)) / m_samplerate;
+  double dt = double(nframes) / m_samplerate;
+
+  // PI control; a higher level makes the output shorter.
+  const double limit = max_ratio_deviation;
+  const double integral_limit = limit / control_ki;
+  m_level_integral += error * dt;
+  m_level_integral =
+      std::max(-integral_limit, std::min(integral_limit, m_level_integral));
+  double deviation = control_kp * error + control_ki * m_level_integral;
+  m_ratio_deviation = std::max(-limit, std::min(limit, deviation));
+}
+
+// Resample the input into m_resampled
+// by 4-point cubic Hermite interpolation.
+void PortAudioCallbackOutput::resample(const SampleVector &samples) {
+  const std::size_t nchannels = m_nchannels;
+  m_history.insert(m_history.end(), samples.begin(), samples.end());
+  const std::size_t total = m_history.size() / nchannels;
+  const double step = 1.0 + m_ratio_deviation;
+
+  m_resampled.clear();
+  while (m_position + 2 < total) {
+    std::size_t i = std::size_t(m_position);
+    float mu = m_position - i;
+    const float *x = m_history.data() + (i - 1) * nchannels;
+    for (std::size_t ch = 0; ch < nchannels; ch++) {
+      float x0 = x[ch];
+      float x1 = x[nchannels + ch];
+      float x2 = x[2 * nchannels + ch];
+      float x3 = x[3 * nchannels + ch];
+      float c1 = 0.5f * (x2 - x0);
+      float c2 = x0 - 2.5f * x1 + 2.0f * x2 - 0.5f * x3;
+      float c3 = 0.5f * (x3 - x0) + 1.5f * (x1 - x2);
+      m_resampled.push_back(((c3 * mu + c2) * mu + c1) * mu + x1);
+    }
+    m_position += step;
+  }
+
+  // Keep the last 3 frames for the next interpolation.
+  m_history.erase(m_history.begin(), m_history.end() - 3 * nchannels);
+  m_position -= total - 3;
+}
+
+// Write audio data.
+bool PortAudioCallbackOutput::write(const SampleVector &samples) {
+  if (m_zombie) {
+    return false;
+  }
+
+  const std::uint64_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+  const std::uint64_t level =
+      write_pos - m_read_pos.load(std::memory_order_acquire);
+
+  // Control the ratio only while the callback is consuming samples.
+  if (m_playing.load(std::memory_order_relaxed)) {
+    update_ratio(level, samples.size() / m_nchannels);
+  }
+
+  resample(samples);
+
+  std::uint64_t n = m_resampled.size() / m_nchannels;
+  std::uint64_t space = m_ring_frames - level;
+  if (n > space) {
+    // Overrun; drop the samples not fit in the ring buffer.
+    m_overruns++;
+    m_dropped_frames += n - space;
+    n = space;
+  }
+
+  std::uint64_t index = write_pos & (m_ring_frames - 1);
+  std::uint64_t first = std::min(n, m_ring_frames - index);
+  const float *in = m_resampled.data();
+  std::copy(in, in + first * m_nchannels, m_ring.data() + index * m_nchannels);
+  std::copy(in + first * m_nchannels, in + n * m_nchannels, m_ring.data());
+
+  m_write_pos.store(write_pos + n, std::memory_order_release);
+  return true;
+}
+
+// Terminate PortAudio
+// then add PortAudio error string to m_error and set m_zombie flag.
+void PortAudioCallbackOutput::add_paerror(const std::string &premsg) {
+  Pa_Terminate();
+  m_error += premsg;
+  m_error += ": PortAudio error: (number: ";
+  m_error += std::to_string(m_paerror);
+  m_error += " message: ";
+  m_error += Pa_GetErrorText(m_paerror);
+  m_error += ")";
+  m_zombie = true;
+}
+
 /* end */
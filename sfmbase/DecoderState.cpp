@@ -0,0 +1,178 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "DecoderState.h"
+
+// File format identifier and version.
+static const char *const state_magic = "airspy-fmradion-state";
+static const int state_version = 1;
+
+// class DecoderState
+
+DecoderState::DecoderState()
+    : frequency(0), ppm(0), if_agc_gain(1), pilot_valid(false),
+      pilot_freq(0), pilot_loopfilter_x1(0) {}
+
+bool DecoderState::matches(double frequency, const std::string &modtype) const {
+  // Allow a rounding error of the frequency in the text file.
+  return std::fabs(this->frequency - frequency) < 0.5 &&
+         this->modtype == modtype;
+}
+
+// The state file is a text file of "key value..." lines,
+// followed by the multipath filter coefficients of a pair of
+// the real and imaginary parts per line.
+
+bool DecoderState::load(const std::string &filename) {
+  std::ifstream file(filename);
+  std::string magic;
+  int version;
+  if (!(file >> magic >> version) || magic != state_magic ||
+      version != state_version) {
+    return false;
+  }
+  DecoderState state;
+  std::string key;
+  while (file >> key) {
+    if (key == "frequency") {
+      file >> state.frequency;
+    } else if (key == "modtype") {
+      file >> state.modtype;
+    } else if (key == "ppm") {
+      file >> state.ppm;
+    } else if (key == "if_agc_gain") {
+      file >> state.if_agc_gain;
+    } else if (key == "pilot") {
+      file >> state.pilot_freq >> state.pilot_loopfilter_x1;
+      state.pilot_valid = true;
+    } else if (key == "multipath") {
+      unsigned int n;
+      file >> n;
+      for (unsigned int i = 0; file && i < n; i++) {
+        float re, im;
+        file >> re >> im;
+        state.multipath_coeff.emplace_back(re, im);
+      }
+    } else {
+      return false;
+    }
+    if (!file) {
+      return false;
+    }
+  }
+  if (!std::isfinite(state.if_agc_gain) || state.if_agc_gain <= 0) {
+    return false;
+  }
+  *this = std::move(state);
+  return true;
+}
+
+bool DecoderState::save(const std::string &filename) const {
+  std::ostringstream out;
+  out.precision(17);
+  out << state_magic << ' ' << state_version << '\n';
+  out << "frequency " << frequency << '\n';
+  out << "modtype " << modtype << '\n';
+  out << "ppm " << ppm << '\n';
+  out << "if_agc_gain " << if_agc_gain << '\n';
+  if (pilot_valid) {
+    out << "pilot " << pilot_freq << ' ' << pilot_loopfilter_x1 << '\n';
+  }
+  if (!multipath_coeff.empty()) {
+    out.precision(9);
+    out << "multipath " << multipath_coeff.size() << '\n';
+    for (const auto &c : multipath_coeff) {
+      out << c.real() << ' ' << c.imag() << '\n';
+    }
+  }
+
+  // Write to a temporary file and rename it
+  // to keep the previous state intact on errors.
+  std::string tmpname = filename + ".tmp";
+  {
+    std::ofstream file(tmpname, std::ios::trunc);
+    file << out.str();
+    if (!file) {
+      return false;
+    }
+  }
+  return rename(tmpname.c_str(), filename.c_str()) == 0;
+}
+
+// class DecoderStateWriter
+
+DecoderStateWriter::DecoderStateWriter(const std::string &filename,
+                                       std::size_t multipath_size)
+    : m_filename(filename), m_writing(false), m_stop(false) {
+  m_state.multipath_coeff.reserve(multipath_size);
+  m_thread = std::thread(&DecoderStateWriter::run, this);
+}
+
+DecoderStateWriter::~DecoderStateWriter() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    // unlock m_mutex here by getting out of scope
+  }
+  m_cond.notify_all();
+  m_thread.join();
+}
+
+bool DecoderStateWriter::save(const DecoderState &state) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_writing) {
+      return false;
+    }
+    // Copy into the reserved capacity without allocation.
+    m_state = state;
+    m_writing = true;
+    // unlock m_mutex here by getting out of scope
+  }
+  m_cond.notify_all();
+  return true;
+}
+
+void DecoderStateWriter::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true) {
+    m_cond.wait(lock, [&] { return m_writing || m_stop; });
+    if (!m_writing) {
+      // Stopped and no write requested.
+      break;
+    }
+    lock.unlock();
+
+    if (!m_state.save(m_filename)) {
+      fprintf(stderr, "\nERROR: can not write '%s'\n", m_filename.c_str());
+    }
+
+    lock.lock();
+    m_writing = false;
+  }
+}
+
+/* end */
@@ -29,6 +29,7 @@
 
 #include "ConfigParser.h"
 #include "FileSource.h"
+#include "ThreadPolicy.h"
 #include "Utility.h"
 
 FileSource *FileSource::m_this = 0;
@@ -383,6 +384,8 @@ bool FileSource::stop() {
 void FileSource::run() {
   IQSampleVector iqsamples;
 
+  ThreadPolicy::apply(ThreadPolicy::Role::Source);
+
   // expected microseconds per block reading
   double d_expected =
       ((double)m_this->m_block_length) / m_this->m_sample_rate_per_us;
@@ -404,7 +407,8 @@ void FileSource::run() {
   // Get clock and start reading.
   auto begin = std::chrono::system_clock::now();
   while (!m_this->m_stop_flag->load()) {
-    // Read and convert samples.
+    // Read and convert samples into a block recycled by the consumer.
+    iqsamples = m_this->m_buf->get_block(0);
     if (!get_samples(&iqsamples)) {
       break;
     }
@@ -469,7 +473,8 @@ bool FileSource::get_sf_read_float(IQSampleVector *samples) {
   // setup vector for reading
   sf_count_t n_read;
   sf_count_t sz = m_this->m_block_length * 2;
-  std::vector<float> buf(sz);
+  std::vector<float> &buf = m_this->m_floatbuf;
+  buf.resize(sz);
 
   // read float samples
   // Note: implicit conversion done in sf_read_float()
@@ -25,17 +25,51 @@
 
 #include "Filter.h"
 
+// Return the index of the only non-zero coefficient
+// if the coefficients are a pure delay, otherwise 0.
+// All the coefficients including coeff[0] are checked,
+// so that e.g. {a, 0, a} or {0.5, 0.5} are not a pure delay.
+template <typename C>
+static unsigned int pure_delay_index(const std::vector<C> &coeff) {
+  unsigned int index = 0;
+  unsigned int nonzero = 0;
+  for (unsigned int j = 0; j < coeff.size(); j++) {
+    if (coeff[j] != 0) {
+      index = j;
+      nonzero++;
+    }
+  }
+  unsigned int delay = nonzero == 1 ? index : 0;
+  // coeff[0] is used by the FIR kernel, so a filter with
+  // non-zero end taps, e.g. {a, 0, a}, must never be a delay.
+  assert(delay == 0 || coeff[0] == 0);
+  return delay;
+}
+
 // class LowPassFilterFirIQ
 
 // Construct low-pass filter.
 LowPassFilterFirIQ::LowPassFilterFirIQ(const IQSampleCoeff &coeff,
                                        const unsigned int downsample)
-    : m_coeff(coeff), m_order(coeff.size() - 1), m_downsample(downsample),
-      m_pos(0) {
+    : m_coeff(coeff),
+      m_kernel(make_fir_kernel<IQSample, IQSample::value_type>(coeff)),
+      m_order(coeff.size() - 1), m_downsample(downsample), m_pos(0),
+      m_delay(pure_delay_index(coeff)),
+      m_delay_gain(m_delay > 0 ? coeff[m_delay] : 0) {
   assert(downsample >= 1);
   m_state.resize(m_order);
 }
 
+// Return the processing cost of the filter.
+FilterStageCost LowPassFilterFirIQ::get_cost(const std::string &name,
+                                             const double sample_rate) const {
+  // Real coefficients for complex samples.
+  unsigned int macs =
+      m_delay == 0 ? 2 * m_order : (m_delay_gain == 1 ? 0 : 2);
+  return FilterStageCost{name, sample_rate / m_downsample, macs, m_delay,
+                         false};
+}
+
 // Process samples.
 void LowPassFilterFirIQ::process(const IQSampleVector &samples_in,
                                  IQSampleVector &samples_out) {
@@ -53,32 +87,44 @@ void LowPassFilterFirIQ::process(const IQSampleVector &samples_in,
     return;
   }
 
-  // The first few samples need data from m_state.
-  // NOTE: this assumes the filter has symmetric coefficient pairs
   unsigned int i = 0;
-  for (; p < n && p < order; p += pstep, i++) {
-    IQSample y = 0;
-    for (unsigned int j = p + 1; j <= order; j++) {
-      y += m_state[order + p - j] * m_coeff[j];
+  if (m_delay > 0) {
+    // Pure delay: copy the samples without convolution.
+    unsigned int d = m_delay;
+    for (; p < n && p < d; p += pstep, i++) {
+      samples_out[i] = m_state[order + p - d] * m_delay_gain;
     }
-    for (unsigned int j = 1; j <= p; j++) {
-      y += samples_in[p - j] * m_coeff[j];
+    if (p < n && pstep == 1 && m_delay_gain == 1) {
+      std::copy(samples_in.begin() + (p - d), samples_in.end() - d,
+                samples_out.begin() + i);
+      i += n - p;
+      p = n;
     }
-    samples_out[i] = y;
-  }
-
-  // Remaining samples only need data from samples_in.
-  // NOTE: this assumes the filter has symmetric coefficient pairs
-  unsigned int half_order = (order - 1) / 2;
-  for (; p < n; p += pstep, i++) {
-    IQSample y = 0;
-    for (unsigned int k = 0; k <= half_order; k++) {
-      y += (samples_in[p - k] + samples_in[p - (order - k)]) * m_coeff[k];
+    for (; p < n; p += pstep, i++) {
+      samples_out[i] = samples_in[p - d] * m_delay_gain;
     }
-    if ((order % 2) == 0) {
-      y += samples_in[p - (order / 2)] * m_coeff[(order / 2)];
+  } else {
+    // The first few samples need data from m_state.
+    // NOTE: this assumes the filter has symmetric coefficient pairs
+    for (; p < n && p < order; p += pstep, i++) {
+      IQSample y = 0;
+      for (unsigned int j = p + 1; j <= order; j++) {
+        y += m_state[order + p - j] * m_coeff[j];
+      }
+      for (unsigned int j = 1; j <= p; j++) {
+        y += samples_in[p - j] * m_coeff[j];
+      }
+      samples_out[i] = y;
+    }
+
+    // Remaining samples only need data from samples_in.
+    // NOTE: this assumes the filter has symmetric coefficient pairs
+    if (p < n) {
+      unsigned int nout = (n - p + pstep - 1) / pstep;
+      m_kernel->process(&samples_in[p - order], nout, pstep, &samples_out[i]);
+      p += nout * pstep;
+      i += nout;
     }
-    samples_out[i] = y;
   }
 
   assert(i == samples_out.size());
@@ -99,10 +145,31 @@ void LowPassFilterFirIQ::process(const IQSampleVector &samples_in,
 
 // Construct low-pass filter.
 LowPassFilterFirAudio::LowPassFilterFirAudio(const SampleCoeff &coeff)
-    : m_coeff(coeff), m_order(coeff.size() - 1), m_pos(0) {
+    : m_coeff(coeff), m_kernel(make_fir_kernel<Sample, Sample>(coeff)),
+      m_order(coeff.size() - 1), m_pos(0), m_delay(pure_delay_index(coeff)),
+      m_delay_gain(m_delay > 0 ? coeff[m_delay] : 0) {
   m_state.resize(m_order);
 }
 
+// Advance the filter as if n zero samples were input.
+void LowPassFilterFirAudio::fast_forward(const std::uint64_t n) {
+  unsigned int order = m_state.size();
+  if (n < order) {
+    copy(m_state.begin() + n, m_state.end(), m_state.begin());
+    std::fill(m_state.end() - n, m_state.end(), 0);
+  } else {
+    std::fill(m_state.begin(), m_state.end(), 0);
+  }
+}
+
+// Return the processing cost of the filter.
+FilterStageCost
+LowPassFilterFirAudio::get_cost(const std::string &name,
+                                const double sample_rate) const {
+  unsigned int macs = m_delay == 0 ? m_order : (m_delay_gain == 1 ? 0 : 1);
+  return FilterStageCost{name, sample_rate, macs, m_delay, false};
+}
+
 // Process samples.
 void LowPassFilterFirAudio::process(const SampleVector &samples_in,
                                     SampleVector &samples_out) {
@@ -115,32 +182,37 @@ void LowPassFilterFirAudio::process(const SampleVector &samples_in,
     return;
   }
 
-  // The first few samples need data from m_state.
-  // NOTE: this assumes the filter has symmetric coefficient pairs
   unsigned int i = 0;
-  for (; p < n && p < order; p++, i++) {
-    Sample y = 0;
-    for (unsigned int j = p + 1; j <= order; j++) {
-      y += m_state[order + p - j] * m_coeff[j];
+  if (m_delay > 0) {
+    // Pure delay: copy the samples without convolution.
+    unsigned int d = m_delay;
+    for (; p < n && p < d; p++, i++) {
+      samples_out[i] = m_state[order + p - d] * m_delay_gain;
     }
-    for (unsigned int j = 1; j <= p; j++) {
-      y += samples_in[p - j] * m_coeff[j];
+    for (; p < n; p++, i++) {
+      samples_out[i] = samples_in[p - d] * m_delay_gain;
     }
-    samples_out[i] = y;
-  }
-
-  // Remaining samples only need data from samples_in.
-  // NOTE: this assumes the filter has symmetric coefficient pairs
-  unsigned int half_order = (order - 1) / 2;
-  for (; p < n; p++, i++) {
-    Sample y = 0;
-    for (unsigned int k = 0; k <= half_order; k++) {
-      y += (samples_in[p - k] + samples_in[p - (order - k)]) * m_coeff[k];
+  } else {
+    // The first few samples need data from m_state.
+    // NOTE: this assumes the filter has symmetric coefficient pairs
+    for (; p < n && p < order; p++, i++) {
+      Sample y = 0;
+      for (unsigned int j = p + 1; j <= order; j++) {
+        y += m_state[order + p - j] * m_coeff[j];
+      }
+      for (unsigned int j = 1; j <= p; j++) {
+        y += samples_in[p - j] * m_coeff[j];
+      }
+      samples_out[i] = y;
     }
-    if ((order % 2) == 0) {
-      y += samples_in[p - (order / 2)] * m_coeff[(order / 2)];
+
+    // Remaining samples only need data from samples_in.
+    // NOTE: this assumes the filter has symmetric coefficient pairs
+    if (p < n) {
+      m_kernel->process(&samples_in[p - order], n - p, 1, &samples_out[i]);
+      i += n - p;
+      p = n;
     }
-    samples_out[i] = y;
   }
 
   assert(i == samples_out.size());
@@ -157,6 +229,137 @@ void LowPassFilterFirAudio::process(const SampleVector &samples_in,
   }
 }
 
+// Class DecimatingFilterFirAudio
+
+// Construct decimating low-pass filter.
+DecimatingFilterFirAudio::DecimatingFilterFirAudio(
+    const SampleCoeff &coeff, const unsigned int downsample)
+    : m_center_coeff(0), m_order(coeff.size() - 1), m_downsample(downsample),
+      m_pos(0) {
+  assert(downsample >= 1);
+  // Only the first half is needed for symmetric coefficient pairs.
+  for (unsigned int k = 0; 2 * k < m_order; k++) {
+    if (coeff[k] != 0) {
+      m_tap_index.push_back(k);
+      m_tap_coeff.push_back(coeff[k]);
+    }
+  }
+  if ((m_order % 2) == 0) {
+    m_center_coeff = coeff[m_order / 2];
+  }
+  if (std::find(coeff.begin(), coeff.end(), 0) == coeff.end()) {
+    m_kernel = make_fir_kernel<Sample, Sample>(coeff);
+  }
+  m_buf.resize(m_order);
+}
+
+// Return the processing cost of the filter.
+FilterStageCost
+DecimatingFilterFirAudio::get_cost(const std::string &name,
+                                   const double sample_rate) const {
+  // Only the non-zero coefficients are counted.
+  unsigned int macs = 2 * m_tap_index.size() + (m_center_coeff != 0 ? 1 : 0);
+  return FilterStageCost{name, sample_rate / m_downsample, macs, 0, false};
+}
+
+// Advance the filter as if n zero samples were input.
+std::uint64_t DecimatingFilterFirAudio::fast_forward(const std::uint64_t n) {
+  unsigned int order = m_order;
+  if (n < order) {
+    copy(m_buf.begin() + n, m_buf.end(), m_buf.begin());
+    std::fill(m_buf.end() - n, m_buf.end(), 0);
+  } else {
+    std::fill(m_buf.begin(), m_buf.end(), 0);
+  }
+  // Output positions in the skipped samples are also skipped.
+  std::uint64_t skipped =
+      m_pos < n ? (n - m_pos + m_downsample - 1) / m_downsample : 0;
+  m_pos = m_pos + skipped * m_downsample - n;
+  return skipped;
+}
+
+// Process samples.
+void DecimatingFilterFirAudio::process(const SampleVector &samples_in,
+                                       SampleVector &samples_out) {
+  unsigned int order = m_order;
+  unsigned int n = samples_in.size();
+  unsigned int p = m_pos;
+  unsigned int pstep = m_downsample;
+
+  samples_out.resize(p < n ? (n - p + pstep - 1) / pstep : 0);
+
+  m_buf.insert(m_buf.end(), samples_in.begin(), samples_in.end());
+
+  unsigned int ntaps = m_tap_index.size();
+  unsigned int i = 0;
+  if (m_kernel && p < n) {
+    i = samples_out.size();
+    m_kernel->process(m_buf.data() + p, i, pstep, samples_out.data());
+    p += i * pstep;
+  }
+  for (; p < n; p += pstep, i++) {
+    // x[0] is the oldest sample and x[order] is the newest sample.
+    const Sample *x = m_buf.data() + p;
+    Sample y = m_center_coeff * x[order / 2];
+    for (unsigned int t = 0; t < ntaps; t++) {
+      unsigned int k = m_tap_index[t];
+      y += (x[k] + x[order - k]) * m_tap_coeff[t];
+    }
+    samples_out[i] = y;
+  }
+
+  assert(i == samples_out.size());
+
+  // Update index of start position in next sample block.
+  m_pos = p - n;
+
+  // Keep the last order samples.
+  m_buf.erase(m_buf.begin(), m_buf.end() - order);
+}
+
+/* ****************  struct IirBiquad  **************** */
+
+IirBiquad IirBiquad::identity() { return IirBiquad{1, 0, 0, 0, 0}; }
+
+IirBiquad IirBiquad::lowpass_rc(const double timeconst) {
+  // Same as LowPassFilterRC.
+  Sample a1 = -exp(-1 / timeconst);
+  return IirBiquad{1 + a1, 0, 0, a1, 0};
+}
+
+IirBiquad IirBiquad::highpass_butterworth(const double cutoff) {
+  typedef std::complex<double> CDbl;
+
+  // Angular cutoff frequency.
+  double w = 2 * M_PI * cutoff;
+
+  // Poles 1 and 2 are a conjugate pair.
+  // Continuous-domain:
+  //   p_k = w / exp( (2*k + n - 1) / (2*n) * pi * j)
+  CDbl p1s = w / exp((2 * 1 + 2 - 1) / double(2 * 2) * CDbl(0, M_PI));
+
+  // Map poles to discrete-domain via matched Z transform.
+  CDbl p1z = exp(p1s);
+
+  // Both zeros are located in s = 0, z = 1.
+
+  // Discrete-domain transfer function:
+  //   H(z) = g * (1 - 1/z) * (1 - 1/z) / ( (1 - p1/z) * (1 - p2/z) )
+  //        = g * (1 - 2/z + 1/z**2) / (1 - (p1+p2)/z + (p1*p2)/z**2)
+  //
+  // Note that z2 = conj(z1).
+  // Therefore p1+p2 == 2*real(p1), p1*2 == abs(p1*p1), z4 = conj(z1)
+  //
+  IirBiquad s{1, -2, 1, -2 * real(p1z), abs(p1z * p1z)};
+
+  // Adjust b coefficients to get unit gain at Nyquist frequency (z=-1).
+  double g = (s.b0 - s.b1 + s.b2) / (1 - s.a1 + s.a2);
+  s.b0 /= g;
+  s.b1 /= g;
+  s.b2 /= g;
+  return s;
+}
+
 /* ****************  class LowPassFilterRC  **************** */
 
 // Construct 1st order low-pass IIR filter.
@@ -262,39 +465,12 @@ void LowPassFilterRC::process_interleaved_inplace(SampleVector &samples) {
 // Construct 2nd order high-pass IIR filter.
 HighPassFilterIir::HighPassFilterIir(const double cutoff)
     : x1(0), x2(0), y1(0), y2(0) {
-  typedef std::complex<double> CDbl;
-
-  // Angular cutoff frequency.
-  double w = 2 * M_PI * cutoff;
-
-  // Poles 1 and 2 are a conjugate pair.
-  // Continuous-domain:
-  //   p_k = w / exp( (2*k + n - 1) / (2*n) * pi * j)
-  CDbl p1s = w / exp((2 * 1 + 2 - 1) / double(2 * 2) * CDbl(0, M_PI));
-
-  // Map poles to discrete-domain via matched Z transform.
-  CDbl p1z = exp(p1s);
-
-  // Both zeros are located in s = 0, z = 1.
-
-  // Discrete-domain transfer function:
-  //   H(z) = g * (1 - 1/z) * (1 - 1/z) / ( (1 - p1/z) * (1 - p2/z) )
-  //        = g * (1 - 2/z + 1/z**2) / (1 - (p1+p2)/z + (p1*p2)/z**2)
-  //
-  // Note that z2 = conj(z1).
-  // Therefore p1+p2 == 2*real(p1), p1*2 == abs(p1*p1), z4 = conj(z1)
-  //
-  b0 = 1;
-  b1 = -2;
-  b2 = 1;
-  a1 = -2 * real(p1z);
-  a2 = abs(p1z * p1z);
-
-  // Adjust b coefficients to get unit gain at Nyquist frequency (z=-1).
-  double g = (b0 - b1 + b2) / (1 - a1 + a2);
-  b0 /= g;
-  b1 /= g;
-  b2 /= g;
+  IirBiquad s = IirBiquad::highpass_butterworth(cutoff);
+  b0 = s.b0;
+  b1 = s.b1;
+  b2 = s.b2;
+  a1 = s.a1;
+  a2 = s.a2;
 }
 
 // Process samples.
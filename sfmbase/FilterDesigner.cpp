@@ -0,0 +1,291 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#include "FilterDesigner.h"
+
+// class FilterDesigner
+
+bool FilterDesigner::parse_spec(const std::string &str, double sample_rate,
+                                Spec &spec) {
+  double passband_khz, stopband_khz;
+  double attenuation = default_attenuation;
+  char extra;
+  int n = sscanf(str.c_str(), "%lf,%lf,%lf%c", &passband_khz, &stopband_khz,
+                 &attenuation, &extra);
+  if (n != 2 && n != 3) {
+    return false;
+  }
+  spec.sample_rate = sample_rate;
+  spec.passband = passband_khz * 1000.0;
+  spec.stopband = stopband_khz * 1000.0;
+  spec.attenuation = attenuation;
+  return valid(spec);
+}
+
+bool FilterDesigner::valid(const Spec &spec) {
+  return spec.passband > 0 && spec.stopband > spec.passband &&
+         spec.stopband <= spec.sample_rate / 2 && spec.attenuation >= 10 &&
+         spec.attenuation <= 150;
+}
+
+double FilterDesigner::kaiser_beta(double attenuation) {
+  if (attenuation > 50) {
+    return 0.1102 * (attenuation - 8.7);
+  } else if (attenuation >= 21) {
+    return 0.5842 * pow(attenuation - 21, 0.4) +
+           0.07886 * (attenuation - 21);
+  } else {
+    return 0;
+  }
+}
+
+double FilterDesigner::bessel_i0(double x) {
+  // Power series, which converges fast enough for the window.
+  double sum = 1;
+  double term = 1;
+  double half_x = x / 2;
+  for (unsigned int k = 1; k < 100; k++) {
+    term *= (half_x / k) * (half_x / k);
+    sum += term;
+    if (term < sum * 1e-17) {
+      break;
+    }
+  }
+  return sum;
+}
+
+SampleCoeff FilterDesigner::windowed_sinc(const Spec &spec,
+                                          unsigned int taps) {
+  SampleCoeff coeff(taps);
+  // Cutoff at the middle of the transition band.
+  double cutoff = (spec.passband + spec.stopband) / 2 / spec.sample_rate;
+  double beta = kaiser_beta(spec.attenuation + design_margin);
+  double i0_beta = bessel_i0(beta);
+  double center = (taps - 1) / 2.0;
+  double sum = 0;
+  for (unsigned int i = 0; i < taps; i++) {
+    double t = i - center;
+    double h = (t == 0) ? 2 * cutoff
+                        : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+    double r = (center > 0) ? t / center : 0;
+    double w = bessel_i0(beta * sqrt(std::max(0.0, 1 - r * r))) / i0_beta;
+    coeff[i] = h * w;
+    sum += coeff[i];
+  }
+  // Normalize for the unity DC gain.
+  for (auto &c : coeff) {
+    c /= sum;
+  }
+  return coeff;
+}
+
+bool FilterDesigner::meets(const Spec &spec, const SampleCoeff &coeff) {
+  double deviation = pow(10.0, -spec.attenuation / 20);
+  unsigned int taps = coeff.size();
+  unsigned int center = (taps - 1) / 2;
+  // Evaluate the zero-phase response of the symmetric filter
+  // on a grid of 8 points per tap in each band.
+  // The response is the cosine series sum of a[k] * cos(k * w),
+  // where a[0] = coeff[center] and a[k] = 2 * coeff[center + k],
+  // evaluated by the Clenshaw recurrence without calling cos() per tap.
+  unsigned int points = 8 * taps;
+  for (int band = 0; band < 2; band++) {
+    double f0 = (band == 0) ? 0 : spec.stopband;
+    double f1 = (band == 0) ? spec.passband : spec.sample_rate / 2;
+    double target = (band == 0) ? 1 : 0;
+    for (unsigned int p = 0; p <= points; p++) {
+      double f = (f0 + (f1 - f0) * p / points) / spec.sample_rate;
+      double x = cos(2 * M_PI * f);
+      double b1 = 0, b2 = 0;
+      for (unsigned int k = center; k > 0; k--) {
+        double b0 = 2 * coeff[center + k] + 2 * x * b1 - b2;
+        b2 = b1;
+        b1 = b0;
+      }
+      double h = coeff[center] + x * b1 - b2;
+      if (std::fabs(h - target) > deviation) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool FilterDesigner::design_lowpass(const Spec &spec, SampleCoeff &coeff,
+                                    std::string &error) {
+  // Kaiser estimate of the filter order.
+  double transition = (spec.stopband - spec.passband) / spec.sample_rate;
+  double order = (spec.attenuation - 7.95) / (14.36 * transition);
+  // Start slightly below the estimate with an odd number of taps,
+  // which has the center tap at an integer delay.
+  double start = std::min(std::max(0.0, 0.9 * order),
+                          static_cast<double>(max_taps));
+  unsigned int taps = static_cast<unsigned int>(start) | 1;
+  taps = std::max(taps, 3u);
+
+  coeff = windowed_sinc(spec, taps);
+  if (meets(spec, coeff)) {
+    return true;
+  }
+
+  // Double the step until the filter meets the specification,
+  // so that low and high bracket the minimum number of taps.
+  unsigned int low = taps;
+  unsigned int high;
+  SampleCoeff high_coeff;
+  unsigned int step = 2;
+  while (true) {
+    if (low == max_taps) {
+      error = "more than " + std::to_string(max_taps) +
+              " taps are required for the specification";
+      coeff.clear();
+      return false;
+    }
+    high = std::min(low + step, max_taps);
+    high_coeff = windowed_sinc(spec, high);
+    if (meets(spec, high_coeff)) {
+      break;
+    }
+    low = high;
+    step *= 2;
+  }
+
+  // Bisect the odd numbers between low (failed) and high (met).
+  while (high - low > 2) {
+    unsigned int middle = ((low + high) / 2) | 1;
+    SampleCoeff middle_coeff = windowed_sinc(spec, middle);
+    if (meets(spec, middle_coeff)) {
+      high = middle;
+      high_coeff.swap(middle_coeff);
+    } else {
+      low = middle;
+    }
+  }
+  coeff.swap(high_coeff);
+  return true;
+}
+
+std::string FilterDesigner::cache_directory() {
+  const char *cache_home = getenv("XDG_CACHE_HOME");
+  if (cache_home != nullptr && cache_home[0] != '\0') {
+    return std::string(cache_home) + "/airspy-fmradion";
+  }
+  const char *home = getenv("HOME");
+  return std::string(home != nullptr ? home : ".") +
+         "/.cache/airspy-fmradion";
+}
+
+std::string FilterDesigner::cache_filename(const Spec &spec) {
+  char name[128];
+  snprintf(name, sizeof(name), "/fir-kaiser-%.9g-%.9g-%.9g-%.9g.txt",
+           spec.sample_rate, spec.passband, spec.stopband, spec.attenuation);
+  return cache_directory() + name;
+}
+
+// The cache file contains the specification as comment lines
+// starting with '#', followed by a coefficient per line.
+
+bool FilterDesigner::load(const std::string &filename, SampleCoeff &coeff) {
+  std::ifstream file(filename);
+  if (!file) {
+    return false;
+  }
+  coeff.clear();
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    char *end;
+    double c = strtod(line.c_str(), &end);
+    if (end == line.c_str()) {
+      return false;
+    }
+    coeff.push_back(c);
+  }
+  // Reject a truncated or an asymmetric file.
+  if (coeff.size() < 3 || coeff.size() % 2 == 0) {
+    return false;
+  }
+  for (unsigned int i = 0; i < coeff.size() / 2; i++) {
+    if (coeff[i] != coeff[coeff.size() - 1 - i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FilterDesigner::save(const std::string &filename, const Spec &spec,
+                          const SampleCoeff &coeff) {
+  // Create the cache directory and its parent if needed.
+  std::string dir = cache_directory();
+  std::string parent = dir.substr(0, dir.rfind('/'));
+  if (!parent.empty()) {
+    mkdir(parent.c_str(), 0755);
+  }
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    return false;
+  }
+
+  // Write to a temporary file and rename it
+  // not to leave a partially written file.
+  std::string tmpname = filename + ".tmp";
+  {
+    std::ofstream file(tmpname, std::ios::trunc);
+    file << "# Kaiser window low-pass FIR filter\n";
+    file << "# sample_rate=" << spec.sample_rate
+         << " passband=" << spec.passband << " stopband=" << spec.stopband
+         << " attenuation=" << spec.attenuation << "\n";
+    file << "# taps=" << coeff.size() << "\n";
+    file.precision(17);
+    for (double c : coeff) {
+      file << c << '\n';
+    }
+    if (!file) {
+      return false;
+    }
+  }
+  return rename(tmpname.c_str(), filename.c_str()) == 0;
+}
+
+bool FilterDesigner::lowpass(const Spec &spec, SampleCoeff &coeff,
+                             bool &cached, std::string &error) {
+  std::string filename = cache_filename(spec);
+  cached = load(filename, coeff);
+  if (cached) {
+    return true;
+  }
+  if (!design_lowpass(spec, coeff, error)) {
+    return false;
+  }
+  // The cache is only an optimization; ignore write errors.
+  save(filename, spec, coeff);
+  return true;
+}
+
+/* end */
@@ -940,4 +940,117 @@ const IQSampleCoeff FilterParameters::jj1bdx_fm_384kHz_medium = {
     2.8328482949954486e-06,
 };
 
+const SampleCoeff FilterParameters::jj1bdx_mpx_384khz_halfband = {
+    -1.1817097281436479e-05,  0.0,                     2.7816406170087126e-05,
+    0.0,                      -5.26737444387412e-05,   0.0,
+    8.916196963163214e-05,    0.0,                     -0.0001405389103101623,
+    0.0,                      0.0002105774255969757,   0.0,
+    -0.0003035933942941499,   0.0,                     0.00042447321672319215,
+    0.0,                      -0.000578703473037957,   0.0,
+    0.0007724067731066503,    0.0,                     -0.0010123896813480568,
+    0.0,                      0.0013062111039322906,   0.0,
+    -0.0016622830030250627,   0.0,                     0.002090020267734295,
+    0.0,                      -0.0026000638715221484,  0.0,
+    0.0032046125040893422,    0.0,                     -0.003917915126369656,
+    0.0,                      0.004757004670338102,    0.0,
+    -0.005742799223913829,    0.0,                     0.006901776241557544,
+    0.0,                      -0.008268566443157587,   0.0,
+    0.009890076166110024,     0.0,                     -0.011832257462222448,
+    0.0,                      0.014191696550963672,    0.0,
+    -0.017116504520945486,    0.0,                     0.02084651100023537,
+    0.0,                      -0.025797306631053986,   0.0,
+    0.03275631653381187,      0.0,                     -0.04341493240283196,
+    0.0,                      0.06217762187701202,     0.0,
+    -0.10520717386456536,     0.0,                     0.31801180747500707,
+    0.5000028573365953,       0.31801180747500707,     0.0,
+    -0.10520717386456536,     0.0,                     0.06217762187701202,
+    0.0,                      -0.04341493240283196,    0.0,
+    0.03275631653381187,      0.0,                     -0.025797306631053986,
+    0.0,                      0.02084651100023537,     0.0,
+    -0.017116504520945486,    0.0,                     0.014191696550963672,
+    0.0,                      -0.011832257462222448,   0.0,
+    0.009890076166110024,     0.0,                     -0.008268566443157587,
+    0.0,                      0.006901776241557544,    0.0,
+    -0.005742799223913829,    0.0,                     0.004757004670338102,
+    0.0,                      -0.003917915126369656,   0.0,
+    0.0032046125040893422,    0.0,                     -0.0026000638715221484,
+    0.0,                      0.002090020267734295,    0.0,
+    -0.0016622830030250627,   0.0,                     0.0013062111039322906,
+    0.0,                      -0.0010123896813480568,  0.0,
+    0.0007724067731066503,    0.0,                     -0.000578703473037957,
+    0.0,                      0.00042447321672319215,  0.0,
+    -0.0003035933942941499,   0.0,                     0.0002105774255969757,
+    0.0,                      -0.0001405389103101623,  0.0,
+    8.916196963163214e-05,    0.0,                     -5.26737444387412e-05,
+    0.0,                      2.7816406170087126e-05,  0.0,
+    -1.1817097281436479e-05,
+};
+
+const SampleCoeff FilterParameters::jj1bdx_384khz_fmaudio_halfband = {
+    1.1851432388864046e-05,  0.0,                     -0.0013778014825881404,
+    0.0,                     0.012847831696682745,    0.0,
+    -0.061514841756998215,   0.0,                     0.3000364974053475,
+    0.49999292541033435,     0.3000364974053475,      0.0,
+    -0.061514841756998215,   0.0,                     0.012847831696682745,
+    0.0,                     -0.0013778014825881404,  0.0,
+    1.1851432388864046e-05,
+};
+
+const SampleCoeff FilterParameters::jj1bdx_192khz_fmaudio_halfband = {
+    -9.696797692421006e-06,  0.0,                     0.0006550407121215097,
+    0.0,                     -0.005212147899897243,   0.0,
+    0.022504438792349743,    0.0,                     -0.07391238625248694,
+    0.0,                     0.3059738750915495,      0.5000017527081115,
+    0.3059738750915495,      0.0,                     -0.07391238625248694,
+    0.0,                     0.022504438792349743,    0.0,
+    -0.005212147899897243,   0.0,                     0.0006550407121215097,
+    0.0,                     -9.696797692421006e-06,
+};
+
+const SampleCoeff FilterParameters::jj1bdx_96khz_fmaudio_2to1 = {
+    -1.5084028578496379e-05,  -2.1233729578789975e-05,  1.0026975050556294e-06,
+    5.4228299790334284e-05,   9.211632222243456e-05,    5.316184110671769e-05,
+    -5.900933216217666e-05,   -0.0001392298734759509,   -6.906220214366389e-05,
+    0.00012796862356287124,   0.00024919416024283327,   0.00010275659179633285,
+    -0.00023237301444549037,  -0.000399022986448106,    -0.0001205842345941321,
+    0.0004082853424573542,    0.0006031811607965042,    0.00010644554713067504,
+    -0.0006794360106137378,   -0.000859425466786475,    -2.689271793059963e-05,
+    0.0010765403945600406,    0.001158626377351575,     -0.00016146568100211403,
+    -0.0016287621248924438,   -0.001477196469603597,    0.0005147458606024469,
+    0.0023615651454361266,    0.0017743652996920127,    -0.0011006326690416522,
+    -0.003291934314619662,    -0.00198834921398088,     0.0019976620200599145,
+    0.004424303950390294,     0.0020332297154076113,    -0.0032945019687263743,
+    -0.005746713646831717,    -0.0017947759453972863,   0.005091823303287462,
+    0.007228509804266539,     0.001123568812283592,     -0.007510005245489695,
+    -0.008820021381483531,    0.00017983482172309934,   0.01070980158014622,
+    0.010453968124102242,     -0.002401024736536661,    -0.014944250616810163,
+    -0.012049684353362691,    0.006001838550925347,     0.020689045143528508,
+    0.01351912763604941,      -0.011870529757365756,    -0.0290132747457241,
+    -0.014774408649080552,    0.0221509648987878,       0.04290376794661528,
+    0.015735943459359497,     -0.044077731495550804,    -0.07453534948813965,
+    -0.016340256687329423,    0.12835622589687487,      0.2833001108171364,
+    0.34987970961919407,      0.2833001108171364,       0.12835622589687487,
+    -0.016340256687329423,    -0.07453534948813965,     -0.044077731495550804,
+    0.015735943459359497,     0.04290376794661528,      0.0221509648987878,
+    -0.014774408649080552,    -0.0290132747457241,      -0.011870529757365756,
+    0.01351912763604941,      0.020689045143528508,     0.006001838550925347,
+    -0.012049684353362691,    -0.014944250616810163,    -0.002401024736536661,
+    0.010453968124102242,     0.01070980158014622,      0.00017983482172309934,
+    -0.008820021381483531,    -0.007510005245489695,    0.001123568812283592,
+    0.007228509804266539,     0.005091823303287462,     -0.0017947759453972863,
+    -0.005746713646831717,    -0.0032945019687263743,   0.0020332297154076113,
+    0.004424303950390294,     0.0019976620200599145,    -0.00198834921398088,
+    -0.003291934314619662,    -0.0011006326690416522,   0.0017743652996920127,
+    0.0023615651454361266,    0.0005147458606024469,    -0.001477196469603597,
+    -0.0016287621248924438,   -0.00016146568100211403,  0.001158626377351575,
+    0.0010765403945600406,    -2.689271793059963e-05,   -0.000859425466786475,
+    -0.0006794360106137378,   0.00010644554713067504,   0.0006031811607965042,
+    0.0004082853424573542,    -0.0001205842345941321,   -0.000399022986448106,
+    -0.00023237301444549037,  0.00010275659179633285,   0.00024919416024283327,
+    0.00012796862356287124,   -6.906220214366389e-05,   -0.0001392298734759509,
+    -5.900933216217666e-05,   5.316184110671769e-05,    9.211632222243456e-05,
+    5.4228299790334284e-05,   1.0026975050556294e-06,   -2.1233729578789975e-05,
+    -1.5084028578496379e-05,
+};
+
 // End of FilterParameters.cpp
@@ -17,6 +17,7 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -73,6 +74,7 @@ PilotPhaseLock::PilotPhaseLock(double freq, double bandwidth,
 
   // Initialize frequency and phase.
   m_freq = freq * 2.0 * M_PI;
+  m_block_freq = freq;
   m_phase = 0;
 
   m_phasor_i1 = 0;
@@ -87,12 +89,26 @@ PilotPhaseLock::PilotPhaseLock(double freq, double bandwidth,
   m_sample_cnt = 0;
 }
 
+// Restore the loop state.
+void PilotPhaseLock::set_loop_state(double freq, double loopfilter_x1) {
+  if (!std::isfinite(freq) || !std::isfinite(loopfilter_x1)) {
+    return;
+  }
+  m_freq = std::max(m_minfreq, std::min(m_maxfreq, freq));
+  m_block_freq = m_freq / (2.0 * M_PI);
+  m_loopfilter_x1 = loopfilter_x1;
+}
+
 // Process samples and generate the 38kHz locked tone.
 void PilotPhaseLock::process(const SampleVector &samples_in,
-                             SampleVector &samples_out, bool pilot_shift) {
+                             SampleVector &samples_out, bool pilot_shift,
+                             IQSampleVector *rds_carrier) {
   unsigned int n = samples_in.size();
 
   samples_out.resize(n);
+  if (rds_carrier != nullptr) {
+    rds_carrier->resize(n);
+  }
 
   bool was_locked = (m_lock_cnt >= m_lock_delay);
   m_pps_events.clear();
@@ -105,6 +121,9 @@ void PilotPhaseLock::process(const SampleVector &samples_in,
     return;
   }
 
+  // Sum of the phase increments in the block.
+  Sample freq_sum = 0;
+
   for (unsigned int i = 0; i < n; i++) {
 
     // Generate locked pilot tone.
@@ -122,6 +141,14 @@ void PilotPhaseLock::process(const SampleVector &samples_in,
       samples_out[i] = 2 * psin * pcos;
     }
 
+    // Generate triple-frequency output for RDS.
+    if (rds_carrier != nullptr) {
+      // cos(3*x) = cos(x) * (4 * cos(x) * cos(x) - 3)
+      // sin(3*x) = sin(x) * (3 - 4 * sin(x) * sin(x))
+      (*rds_carrier)[i] = IQSample(pcos * (4 * pcos * pcos - 3),
+                                   -psin * (3 - 4 * psin * psin));
+    }
+
     // Multiply locked tone with input.
     Sample x = samples_in[i];
     Sample phasor_i = psin * x;
@@ -154,6 +181,7 @@ void PilotPhaseLock::process(const SampleVector &samples_in,
 
     // Update locked phase.
     m_phase += m_freq;
+    freq_sum += m_freq;
     if (m_phase > 2.0 * M_PI) {
       m_phase -= 2.0 * M_PI;
       m_pilot_periods++;
@@ -173,6 +201,9 @@ void PilotPhaseLock::process(const SampleVector &samples_in,
     }
   }
 
+  // Mean frequency of the block, relative to sample frequency.
+  m_block_freq = freq_sum / (2.0 * M_PI * n);
+
   // Update lock status.
   if (2 * m_pilot_level > m_minsignal) {
     if (m_lock_cnt < m_lock_delay) {
@@ -193,32 +224,68 @@ void PilotPhaseLock::process(const SampleVector &samples_in,
   m_sample_cnt += n;
 }
 
+// class FmAudioDecimator
+
+FmAudioDecimator::FmAudioDecimator()
+    : m_stage1(FilterParameters::jj1bdx_384khz_fmaudio_halfband, 2),
+      m_stage2(FilterParameters::jj1bdx_192khz_fmaudio_halfband, 2),
+      m_stage3(FilterParameters::jj1bdx_96khz_fmaudio_2to1, 2) {}
+
+void FmAudioDecimator::process(const SampleVector &samples_in,
+                               SampleVector &samples_out) {
+  m_stage1.process(samples_in, m_buf1);
+  m_stage2.process(m_buf1, m_buf2);
+  m_stage3.process(m_buf2, samples_out);
+}
+
+void FmAudioDecimator::reserve(std::size_t n) {
+  m_stage1.reserve(n);
+  m_buf1.reserve(n / 2 + 1);
+  m_stage2.reserve(n / 2 + 1);
+  m_buf2.reserve(n / 4 + 1);
+  m_stage3.reserve(n / 4 + 1);
+}
+
+void FmAudioDecimator::fast_forward(const std::uint64_t n) {
+  // The output samples skipped by a stage are the input samples
+  // skipped by the next stage.
+  m_stage3.fast_forward(m_stage2.fast_forward(m_stage1.fast_forward(n)));
+}
+
+void FmAudioDecimator::get_costs(const std::string &name,
+                                 const double sample_rate,
+                                 std::vector<FilterStageCost> &costs) const {
+  costs.push_back(m_stage1.get_cost(name + " 1/3", sample_rate));
+  costs.push_back(m_stage2.get_cost(name + " 2/3", sample_rate / 2));
+  costs.push_back(m_stage3.get_cost(name + " 3/3", sample_rate / 4));
+}
+
 // class FmDecoder
 
 FmDecoder::FmDecoder(IQSampleCoeff &fmfilter_coeff, bool stereo,
-                     double deemphasis, bool pilot_shift,
-                     unsigned int multipath_stages)
+                     bool stereo_gating, double deemphasis, bool pilot_shift,
+                     unsigned int multipath_stages,
+                     MultipathFilter::Algorithm multipath_algorithm, bool rds)
     // Initialize member fields
     : m_fmfilter_coeff(fmfilter_coeff), m_pilot_shift(pilot_shift),
       m_enable_multipath_filter((multipath_stages > 0)),
       // Wait first 100 blocks to enable the multipath filter
       m_wait_multipath_blocks(100), m_multipath_stages(multipath_stages),
-      m_stereo_enabled(stereo), m_stereo_detected(false), m_baseband_mean(0),
-      m_baseband_level(0), m_if_rms(0.0)
+      m_multipath_reset_count(0), m_stereo_enabled(stereo),
+      m_stereo_gating(stereo_gating), m_rds_enabled(rds),
+      // The stereo chain starts in sync with the mono one.
+      m_stereo_detected(false), m_stereo_running(true),
+      m_stereo_gap_samples(0), m_stereo_skipped_samples(0),
+      m_baseband_mean(0), m_baseband_level(0), m_if_rms(0.0)
 
       // Construct FM narrow filter
       ,
       m_fmfilter(m_fmfilter_coeff, 1)
 
-      // Construct AudioResampler for mono and stereo channels
+      // Construct 8:1 audio decimators for mono and stereo channels,
+      // which also cut the 19kHz pilot signal
       ,
-      m_audioresampler_mono(sample_rate_if, sample_rate_pcm),
-      m_audioresampler_stereo(sample_rate_if, sample_rate_pcm)
-
-      // Construct 19kHz pilot signal cut filter
-      ,
-      m_pilotcut_mono(FilterParameters::jj1bdx_48khz_fmaudio),
-      m_pilotcut_stereo(FilterParameters::jj1bdx_48khz_fmaudio)
+      m_audiodecimator_mono(), m_audiodecimator_stereo()
 
       // Construct PhaseDiscriminator
       ,
@@ -230,18 +297,10 @@ FmDecoder::FmDecoder(IQSampleCoeff &fmfilter_coeff, bool stereo,
                  50 / sample_rate_if,         // bandwidth
                  0.01)                        // minsignal (was 0.04)
 
-      // Construct HighPassFilterIir
-      // cutoff: 4.8Hz for 48kHz sampling rate
-      ,
-      m_dcblock_mono(0.0001), m_dcblock_stereo(0.0001)
-
-      // Construct LowPassFilterRC for deemphasis
-      // Note: sampling rate is of the FM demodulator
+      // Construct DC blocking and deemphasis filters
+      // of one section each, set in the constructor body
       ,
-      m_deemph_mono((deemphasis == 0) ? 1.0
-                                      : (deemphasis * sample_rate_if * 1.0e-6)),
-      m_deemph_stereo(
-          (deemphasis == 0) ? 1.0 : (deemphasis * sample_rate_if * 1.0e-6))
+      m_dcblock(1), m_deemph(1)
 
       // Construct IF AGC
       ,
@@ -250,10 +309,48 @@ FmDecoder::FmDecoder(IQSampleCoeff &fmfilter_coeff, bool stereo,
       // Construct multipath filter
       // for 384kHz IF: 288 -> 750 microseconds (288/384000 * 1000000)
       ,
-      m_multipathfilter(m_enable_multipath_filter ? m_multipath_stages : 1)
+      m_multipathfilter(m_enable_multipath_filter ? m_multipath_stages : 1,
+                        multipath_algorithm)
 
 {
-  // Do nothing
+  // DC blocking by 2nd order Butterworth high-pass filter.
+  // cutoff: 4.8Hz for 48kHz sampling rate
+  IirBiquad dcblock = IirBiquad::highpass_butterworth(0.0001);
+  m_dcblock.set_section(0, 0, dcblock);
+  m_dcblock.set_section(0, 1, dcblock);
+
+  // Deemphasis by 1st order low-pass filter.
+  // Note: sampling rate is of the FM demodulator
+  IirBiquad deemph = IirBiquad::lowpass_rc(
+      (deemphasis == 0) ? 1.0 : (deemphasis * sample_rate_if * 1.0e-6));
+  m_deemph.set_section(0, 0, deemph);
+  // No deemphasis for the stereo (L-R) signal for QMM.
+  m_deemph.set_section(0, 1, m_pilot_shift ? IirBiquad::identity() : deemph);
+}
+
+void FmDecoder::reserve(std::size_t n) {
+  // Output samples of the 8:1 audio decimators.
+  const std::size_t n_audio = n / 8 + 1;
+  m_samples_in_iffiltered.reserve(n);
+  m_samples_in_after_agc.reserve(n);
+  m_samples_in_multipathfiltered.reserve(n);
+  m_buf_decoded.reserve(n);
+  m_buf_baseband.reserve(n);
+  m_buf_baseband_deemph.reserve(n);
+  m_buf_mono.reserve(n_audio);
+  m_ifagc.reserve(n);
+  m_audiodecimator_mono.reserve(n);
+  if (m_stereo_enabled || m_rds_enabled) {
+    m_buf_rawstereo.reserve(n);
+  }
+  if (m_stereo_enabled) {
+    m_buf_stereo.reserve(n_audio);
+    m_audiodecimator_stereo.reserve(n);
+  }
+  if (m_rds_enabled) {
+    m_buf_rds_carrier.reserve(n);
+    m_rdsdecoder.reserve(n);
+  }
 }
 
 void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
@@ -269,10 +366,14 @@ void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
   m_if_rms = Utility::rms_level_approx(samples_in);
 
   // Apply IF filter.
-  m_fmfilter.process(samples_in, m_samples_in_iffiltered);
-
-  // Perform IF AGC.
-  m_ifagc.process(m_samples_in_iffiltered, m_samples_in_after_agc);
+  // A pure delay of unity gain (e.g., FilterParameters::delay_3taps_only_iq)
+  // only shifts the sample timing by a constant, so skip it.
+  if (m_fmfilter.is_unity_delay()) {
+    m_ifagc.process(samples_in, m_samples_in_after_agc);
+  } else {
+    m_fmfilter.process(samples_in, m_samples_in_iffiltered);
+    m_ifagc.process(m_samples_in_iffiltered, m_samples_in_after_agc);
+  }
 
 #ifdef DEBUG_IF_AGC
   // Measure IF RMS level for checking how IF AGC works.
@@ -283,7 +384,7 @@ void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
   if (m_wait_multipath_blocks > 0) {
     m_wait_multipath_blocks--;
     // No multipath filter applied.
-    m_samples_in_multipathfiltered = std::move(m_samples_in_after_agc);
+    m_samples_in_multipathfiltered.swap(m_samples_in_after_agc);
   } else {
     if (m_enable_multipath_filter) {
       // Apply multipath filter.
@@ -293,14 +394,15 @@ void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
       if (!done_ok) {
         // Reset the filter coefficients.
         m_multipathfilter.initialize_coefficients();
+        m_multipath_reset_count++;
         // fprintf(stderr, "Reset Multipath Filter coefficients\n");
         // Discard the invalid filter output, and
         // use the no-filter input after resetting the filter.
-        m_samples_in_multipathfiltered = std::move(m_samples_in_after_agc);
+        m_samples_in_multipathfiltered.swap(m_samples_in_after_agc);
       }
     } else {
       // No multipath filter applied.
-      m_samples_in_multipathfiltered = std::move(m_samples_in_after_agc);
+      m_samples_in_multipathfiltered.swap(m_samples_in_after_agc);
     }
   }
 
@@ -311,69 +413,99 @@ void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
   // terminate and wait for next block,
   size_t decoded_size = m_buf_decoded.size();
   if (decoded_size == 0) {
+    m_buf_baseband.resize(0);
     audio.resize(0);
     return;
   }
 
-  // Convert decoded data to baseband data
-  m_buf_baseband.resize(decoded_size);
-  volk_32f_convert_64f(m_buf_baseband.data(), m_buf_decoded.data(),
-                       decoded_size);
+  // Convert decoded data to baseband data,
+  // and measure baseband level in the same pass.
+  m_baseband_meter.reset();
+  m_baseband_meter.convert(m_buf_decoded, m_buf_baseband);
+  m_baseband_mean = 0.95 * m_baseband_mean + 0.05 * m_baseband_meter.mean();
+  m_baseband_level = 0.95 * m_baseband_level + 0.05 * m_baseband_meter.rms();
+
+  // Lock on stereo pilot,
+  // and remove locked 19kHz tone from the composite signal.
+  // RDS decoding also requires the pilot PLL for the 57kHz carrier.
+  if (m_stereo_enabled || m_rds_enabled) {
+    m_pilotpll.process(m_buf_baseband, m_buf_rawstereo, m_pilot_shift,
+                       m_rds_enabled ? &m_buf_rds_carrier : nullptr);
+  }
 
-  // Measure baseband level.
-  float baseband_mean, baseband_rms;
-  Utility::samples_mean_rms(m_buf_decoded, baseband_mean, baseband_rms);
-  m_baseband_mean = 0.95 * m_baseband_mean + 0.05 * baseband_mean;
-  m_baseband_level = 0.95 * m_baseband_level + 0.05 * baseband_rms;
+  // Decode RDS from the MPX signal before deemphasis.
+  if (m_rds_enabled) {
+    m_rdsdecoder.process(m_buf_baseband, m_buf_rds_carrier);
+  }
 
-  // The following function must be executed anyway
-  // even if the mono audio resampler output does not come out.
   if (m_stereo_enabled) {
-    // Lock on stereo pilot,
-    // and remove locked 19kHz tone from the composite signal.
-    m_pilotpll.process(m_buf_baseband, m_buf_rawstereo, m_pilot_shift);
+    if (m_stereo_gating) {
+      // Decode stereo only while the pilot is locked.
+      m_stereo_detected = m_pilotpll.locked();
+    } else {
+      // Force-set this flag to true to measure stereo PLL phase noise
+      m_stereo_detected = true;
+    }
+  }
 
-    // Force-set this flag to true to measure stereo PLL phase noise
-    m_stereo_detected = true;
-    // Use locked flag for the normal use
-    // m_stereo_detected = m_pilotpll.locked();
+  // The stereo chain runs only when the stereo signal is detected.
+  // While skipped, the L-R signal is regarded as zero.
+  const bool stereo_running = m_stereo_enabled && m_stereo_detected;
+  const bool stereo_resumed = stereo_running && !m_stereo_running;
+  m_stereo_running = stereo_running;
+  if (m_stereo_enabled && !stereo_running) {
+    m_stereo_skipped_samples += decoded_size;
+    m_stereo_gap_samples += decoded_size;
+  }
 
+  if (stereo_running) {
     // Demodulate stereo signal.
     demod_stereo(m_buf_baseband, m_buf_rawstereo);
+  }
 
-    // Deemphasize the stereo (L-R) signal if not for QMM.
-    if (!m_pilot_shift) {
-      m_deemph_stereo.process_inplace(m_buf_rawstereo);
-    }
+  // Deemphasize the mono and stereo (L-R) audio signals in one pass.
+  // (m_buf_baseband is kept intact for the MPX output)
+  // While the stereo chain is skipped, the stereo channel is skipped too,
+  // and the filter state decays as for the zero L-R signal.
+  m_buf_baseband_deemph.resize(decoded_size);
+  {
+    Sample *stereo = stereo_running ? m_buf_rawstereo.data() : nullptr;
+    const Sample *deemph_in[2] = {m_buf_baseband.data(), stereo};
+    Sample *const deemph_out[2] = {m_buf_baseband_deemph.data(), stereo};
+    m_deemph.process(deemph_in, deemph_out, decoded_size);
+  }
 
-    // Downsample.
-    // NOTE: This MUST be done even if no stereo signal is detected yet,
-    // because the downsamplers for mono and stereo signal must be
-    // kept in sync.
-    m_audioresampler_stereo.process(m_buf_rawstereo, m_buf_stereo_firstout);
+  if (stereo_resumed) {
+    // Fast-forward the stereo decimator over the skipped zero L-R signal,
+    // which also keeps the decimation phase in sync with the mono one.
+    m_audiodecimator_stereo.fast_forward(m_stereo_gap_samples);
+    m_stereo_gap_samples = 0;
   }
 
-  // Deemphasize the mono audio signal.
-  m_deemph_mono.process_inplace(m_buf_baseband);
+  // Extract mono audio signal, downsample, and filter out 19kHz pilot signal.
+  m_audiodecimator_mono.process(m_buf_baseband_deemph, m_buf_mono);
+  if (stereo_running) {
+    // Extract stereo audio signal, downsample, and filter out 19kHz pilot.
+    // NOTE: the decimators for mono and stereo signal must be
+    // kept in sync.
+    m_audiodecimator_stereo.process(m_buf_rawstereo, m_buf_stereo);
+    assert(m_buf_stereo.size() == m_buf_mono.size());
+  }
 
-  // Extract mono audio signal.
-  m_audioresampler_mono.process(m_buf_baseband, m_buf_mono_firstout);
   // If no mono audio signal comes out, terminate and wait for next block,
-  if (m_buf_mono_firstout.size() == 0) {
+  if (m_buf_mono.size() == 0) {
     audio.resize(0);
     return;
   }
-  // Filter out mono 19kHz pilot signal.
-  m_pilotcut_mono.process(m_buf_mono_firstout, m_buf_mono);
-  // DC blocking
-  m_dcblock_mono.process_inplace(m_buf_mono);
 
-  if (m_stereo_enabled) {
-    // Filter out mono 19kHz pilot signal.
-    m_pilotcut_stereo.process(m_buf_stereo_firstout, m_buf_stereo);
-    // DC blocking
-    m_dcblock_stereo.process_inplace(m_buf_stereo);
+  // DC blocking of the mono and stereo signals in one pass.
+  {
+    Sample *stereo = stereo_running ? m_buf_stereo.data() : nullptr;
+    Sample *const dcblock_buf[2] = {m_buf_mono.data(), stereo};
+    m_dcblock.process(dcblock_buf, dcblock_buf, m_buf_mono.size());
+  }
 
+  if (m_stereo_enabled) {
     if (m_stereo_detected) {
       if (m_pilot_shift) {
         // Duplicate L-R shifted output in left/right channels.
@@ -385,7 +517,7 @@ void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
     } else {
       if (m_pilot_shift) {
         // Fill zero output in left/right channels.
-        zero_to_left_right(m_buf_stereo, audio);
+        zero_to_left_right(m_buf_mono, audio);
       } else {
         // Duplicate mono signal in left/right channels.
         mono_to_left_right(m_buf_mono, audio);
@@ -393,7 +525,52 @@ void FmDecoder::process(const IQSampleVector &samples_in, SampleVector &audio) {
     }
   } else {
     // Just return mono channel.
-    audio = std::move(m_buf_mono);
+    audio.swap(m_buf_mono);
+  }
+}
+
+// Return the processing cost of the FIR filter stages.
+std::vector<FilterStageCost> FmDecoder::get_filter_costs() const {
+  std::vector<FilterStageCost> costs;
+  FilterStageCost if_cost = m_fmfilter.get_cost("FM IF filter", sample_rate_if);
+  if_cost.elided = m_fmfilter.is_unity_delay();
+  costs.push_back(if_cost);
+  m_audiodecimator_mono.get_costs("audio decimator mono", sample_rate_if,
+                                  costs);
+  if (m_stereo_enabled) {
+    m_audiodecimator_stereo.get_costs("audio decimator stereo", sample_rate_if,
+                                      costs);
+  }
+  return costs;
+}
+
+// Save the adaptive states to the checkpoint.
+void FmDecoder::get_state(DecoderState &state) const {
+  state.if_agc_gain = m_ifagc.get_current_gain();
+  state.pilot_valid = (m_stereo_enabled || m_rds_enabled);
+  if (state.pilot_valid) {
+    m_pilotpll.get_loop_state(state.pilot_freq, state.pilot_loopfilter_x1);
+  }
+  state.multipath_coeff.clear();
+  if (m_enable_multipath_filter) {
+    const MfCoeffVector &coeff = m_multipathfilter.get_coefficients();
+    state.multipath_coeff.assign(coeff.begin(), coeff.end());
+  }
+}
+
+// Restore the adaptive states from the checkpoint.
+void FmDecoder::set_state(const DecoderState &state) {
+  m_ifagc.set_current_gain(state.if_agc_gain);
+  if (state.pilot_valid && (m_stereo_enabled || m_rds_enabled)) {
+    m_pilotpll.set_loop_state(state.pilot_freq, state.pilot_loopfilter_x1);
+  }
+  if (m_enable_multipath_filter && !state.multipath_coeff.empty()) {
+    MfCoeffVector coeff(state.multipath_coeff.begin(),
+                        state.multipath_coeff.end());
+    if (m_multipathfilter.set_coefficients(coeff)) {
+      // No need to wait for the IF AGC to settle.
+      m_wait_multipath_blocks = 0;
+    }
   }
 }
 
@@ -32,6 +32,12 @@ IfAgc::IfAgc(const float initial_gain, const float max_gain,
   // Do nothing
 }
 
+// Allocate the buffers in advance.
+void IfAgc::reserve(std::size_t n) {
+  m_log_gain.reserve(n);
+  m_gain.reserve(n);
+}
+
 // IF AGC.
 // Algorithm shown in:
 // https://www.mathworks.com/help/comm/ref/comm.agc-system-object.html
@@ -46,13 +52,12 @@ void IfAgc::process(const IQSampleVector &samples_in,
   unsigned int n = samples_in.size();
   samples_out.resize(n);
 
-  volk::vector<float> log_gain, gain;
-  log_gain.resize(n);
-  gain.resize(n);
+  m_log_gain.resize(n);
+  m_gain.resize(n);
 
   for (unsigned int i = 0; i < n; i++) {
     // Store logarithm of current gain.
-    log_gain[i] = m_log_current_gain;
+    m_log_gain[i] = m_log_current_gain;
     // Update the current gain.
     // Note: the original algorithm multiplied the abs(input)
     //       with the current gain (exp(log_current_gain))
@@ -71,9 +76,9 @@ void IfAgc::process(const IQSampleVector &samples_in,
   // Compute output based on the saved logarithm of current gain.
   // NOTE: DO NOT USE volk_32f_expfast_32f() here
   //       because the calculation error is audible on AM mode!
-  volk_32f_exp_32f(gain.data(), log_gain.data(), n);
+  volk_32f_exp_32f(m_gain.data(), m_log_gain.data(), n);
   volk_32fc_32f_multiply_32fc(samples_out.data(), samples_in.data(),
-                              gain.data(), n);
+                              m_gain.data(), n);
 }
 
 // end
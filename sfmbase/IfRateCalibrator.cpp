@@ -0,0 +1,123 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "IfRateCalibrator.h"
+
+// class IfRateCalibrator
+
+IfRateCalibrator::IfRateCalibrator(double sample_rate, double ppm)
+    : m_sample_rate(sample_rate), m_ppm(ppm), m_calibrated(false),
+      m_freq_sum(0), m_samples(0) {}
+
+void IfRateCalibrator::feed(double pilot_freq, std::size_t n, bool locked) {
+  if (!locked || n == 0) {
+    return;
+  }
+  m_freq_sum += pilot_freq * n;
+  m_samples += n;
+}
+
+double IfRateCalibrator::estimate() const {
+  double mean_freq = m_freq_sum / m_samples;
+  // The true sample rate is the applied one
+  // multiplied by (nominal pilot / measured pilot).
+  return ((1.0 + m_ppm * 1.0e-6) * (pilot_frequency / mean_freq) - 1.0) *
+         1.0e6;
+}
+
+bool IfRateCalibrator::update() {
+  if (get_duration() < min_duration) {
+    return false;
+  }
+  double ppm = estimate();
+  m_calibrated = true;
+  if (std::fabs(ppm - m_ppm) < min_update_ppm) {
+    // Keep averaging for a better estimate.
+    return false;
+  }
+  m_ppm = ppm;
+  m_freq_sum = 0;
+  m_samples = 0;
+  return true;
+}
+
+std::string IfRateCalibrator::default_filename() {
+  const char *home = getenv("HOME");
+  return std::string(home != nullptr ? home : ".") +
+         "/.airspy-fmradion-calibration";
+}
+
+// Each line of the calibration file is the device name and the correction
+// in ppm, separated by a tab.
+
+bool IfRateCalibrator::load(const std::string &filename,
+                            const std::string &device, double &ppm) {
+  std::ifstream file(filename);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::size_t tab = line.rfind('\t');
+    if (tab != std::string::npos && line.substr(0, tab) == device) {
+      ppm = atof(line.c_str() + tab + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IfRateCalibrator::save(const std::string &filename,
+                            const std::string &device, double ppm) {
+  // Keep the entries of the other devices.
+  std::vector<std::string> lines;
+  {
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+      std::size_t tab = line.rfind('\t');
+      if (tab != std::string::npos && line.substr(0, tab) != device) {
+        lines.push_back(line);
+      }
+    }
+  }
+  std::ostringstream entry;
+  entry.precision(6);
+  entry << device << '\t' << std::fixed << ppm;
+  lines.push_back(entry.str());
+
+  // Write to a temporary file and rename it
+  // to keep the file intact on errors.
+  std::string tmpname = filename + ".tmp";
+  {
+    std::ofstream file(tmpname, std::ios::trunc);
+    for (const std::string &line : lines) {
+      file << line << '\n';
+    }
+    if (!file) {
+      return false;
+    }
+  }
+  return rename(tmpname.c_str(), filename.c_str()) == 0;
+}
+
+/* end */
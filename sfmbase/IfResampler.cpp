@@ -26,6 +26,19 @@
 IfResampler::IfResampler(const double input_rate, const double output_rate)
     : m_irate(input_rate), m_orate(output_rate),
       m_ratio(output_rate / input_rate) {
+  create();
+}
+
+IfResampler::~IfResampler() { soxr_delete(m_soxr); }
+
+void IfResampler::set_input_rate(const double input_rate) {
+  soxr_delete(m_soxr);
+  m_irate = input_rate;
+  m_ratio = m_orate / m_irate;
+  create();
+}
+
+void IfResampler::create() {
   soxr_error_t error;
   // Use float, see typedef of IQSample
   soxr_io_spec_t io_spec = soxr_io_spec(SOXR_FLOAT32_I, SOXR_FLOAT32_I);
@@ -58,36 +71,17 @@ void IfResampler::process(const IQSampleVector &samples_in,
   size_t output_length;
   soxr_error_t error;
 
-  IQSampleCoeff samples_in_interleaved;
-  IQSampleCoeff samples_out_interleaved;
-
-  samples_in_interleaved.resize(input_size * 2);
-  samples_out_interleaved.resize(output_size * 2);
-
-  // Create real and imaginary part vectors from sample input.
-  for (unsigned int i = 0, j = 0; i < input_size; i++, j += 2) {
-    IQSample value = samples_in[i];
-    samples_in_interleaved[j] = value.real();
-    samples_in_interleaved[j + 1] = value.imag();
-  }
-
-  // Process the real and imaginary parts.
+  // Process the interleaved real and imaginary parts directly,
+  // since std::complex<float> is layout-compatible with float[2].
   error = soxr_process(
-      m_soxr, static_cast<soxr_in_t>(samples_in_interleaved.data()), input_size,
-      nullptr, static_cast<soxr_out_t>(samples_out_interleaved.data()),
-      output_size, &output_length);
+      m_soxr, static_cast<soxr_in_t>(samples_in.data()), input_size, nullptr,
+      static_cast<soxr_out_t>(samples_out.data()), output_size, &output_length);
   if (error) {
     soxr_delete(m_soxr);
     fprintf(stderr, "IfResampler: soxr_process error of m_soxr: %s\n", error);
     exit(1);
   }
 
-  // Create complex sample output from the real and imaginary part vectors.
-  for (unsigned int i = 0, j = 0; i < output_length; i++, j += 2) {
-    samples_out[i] =
-        IQSample(samples_out_interleaved[j], samples_out_interleaved[j + 1]);
-  }
-
   samples_out.resize(output_length);
 }
 
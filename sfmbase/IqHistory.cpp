@@ -0,0 +1,138 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "IqHistory.h"
+
+// Construct IQ history buffer.
+IqHistory::IqHistory(double seconds, double sample_rate, double frequency,
+                     IqRecorder::Format format)
+    : m_ring(std::max(1L, std::lrint(seconds * sample_rate))), m_pos(0),
+      m_fill(0), m_sample_rate(sample_rate), m_frequency(frequency),
+      m_format(format), m_dump_ring(m_ring.size()), m_dump_pos(0),
+      m_dump_fill(0), m_dumping(false), m_stop(false) {
+  m_thread = std::thread(&IqHistory::run, this);
+}
+
+// Finish the dump in progress and stop the writer thread.
+IqHistory::~IqHistory() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    // unlock m_mutex here by getting out of scope
+  }
+  m_cond.notify_all();
+  m_thread.join();
+}
+
+// Store samples into the history.
+void IqHistory::push(const IQSampleVector &samples) {
+  std::size_t size = m_ring.size();
+  std::size_t n = samples.size();
+  IQSampleVector::const_iterator begin = samples.begin();
+
+  // Only the last size samples are kept if the block is too long.
+  if (n > size) {
+    begin += n - size;
+    n = size;
+  }
+
+  std::size_t first = std::min(n, size - m_pos);
+  std::copy(begin, begin + first, m_ring.begin() + m_pos);
+  std::copy(begin + first, begin + n, m_ring.begin());
+
+  m_pos = (m_pos + n) % size;
+  m_fill = std::min(m_fill + n, size);
+}
+
+// Dump the history to the file in the background.
+bool IqHistory::dump(const std::string &filename) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_dumping) {
+      m_error = "previous dump still in progress";
+      return false;
+    }
+    if (m_fill == 0) {
+      m_error = "no samples stored";
+      return false;
+    }
+
+    // Hand the history over to the writer thread without copying.
+    m_ring.swap(m_dump_ring);
+    m_dump_pos = m_pos;
+    m_dump_fill = m_fill;
+    m_dump_filename = filename;
+    m_dumping = true;
+    m_pos = 0;
+    m_fill = 0;
+    // unlock m_mutex here by getting out of scope
+  }
+  m_cond.notify_all();
+  return true;
+}
+
+// Writer thread.
+void IqHistory::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true) {
+    m_cond.wait(lock, [&] { return m_dumping || m_stop; });
+    if (!m_dumping) {
+      // Stopped and no dump requested.
+      break;
+    }
+    std::string filename(m_dump_filename);
+    lock.unlock();
+
+    write_dump(filename);
+
+    lock.lock();
+    m_dumping = false;
+  }
+}
+
+// Write the swapped out history to the file.
+void IqHistory::write_dump(const std::string &filename) {
+  // The recorder buffers one second of samples at most.
+  std::size_t second = std::max(1L, std::lrint(m_sample_rate));
+  std::size_t buffer_samples = std::min(m_dump_fill, second);
+  IqRecorder recorder(filename, m_format, m_sample_rate, m_frequency,
+                      buffer_samples);
+
+  // Oldest samples first.
+  std::size_t size = m_dump_ring.size();
+  if (recorder) {
+    if (m_dump_fill < size) {
+      recorder.push_wait(m_dump_ring.data(), m_dump_fill);
+    } else {
+      recorder.push_wait(m_dump_ring.data() + m_dump_pos, size - m_dump_pos);
+      recorder.push_wait(m_dump_ring.data(), m_dump_pos);
+    }
+    recorder.close();
+  }
+  if (!recorder) {
+    fprintf(stderr, "\nWARNING: IQ history dump to '%s' failed: %s\n",
+            filename.c_str(), recorder.error().c_str());
+  }
+}
+
+/* end */
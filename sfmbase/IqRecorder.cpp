@@ -0,0 +1,296 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+#include "IqRecorder.h"
+
+// Construct IQ recorder and start the writer thread.
+IqRecorder::IqRecorder(const std::string &filename, Format format,
+                       double sample_rate, double frequency,
+                       std::size_t buffer_samples)
+    : m_format(format), m_file(nullptr), m_write_error(false),
+      m_ring(buffer_samples), m_read_pos(0), m_fill(0), m_stop(false),
+      m_dropped_blocks(0), m_dropped_samples(0), m_written_samples(0) {
+
+  m_file = fopen(filename.c_str(), "wb");
+  if (m_file == nullptr) {
+    m_error = "can not open '" + filename + "' (" + strerror(errno) + ")";
+    return;
+  }
+
+  const std::string sigmf_data(".sigmf-data");
+  if (filename.size() > sigmf_data.size() &&
+      filename.compare(filename.size() - sigmf_data.size(), sigmf_data.size(),
+                       sigmf_data) == 0) {
+    std::string meta_filename =
+        filename.substr(0, filename.size() - sigmf_data.size()) +
+        ".sigmf-meta";
+    if (!write_sigmf_meta(meta_filename, sample_rate, frequency)) {
+      return;
+    }
+  }
+
+  m_thread = std::thread(&IqRecorder::run, this);
+}
+
+// Close the recorder.
+IqRecorder::~IqRecorder() { close(); }
+
+// Write the remaining samples, stop the writer thread, and close the file.
+void IqRecorder::close() {
+  if (m_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+      // unlock m_mutex here by getting out of scope
+    }
+    m_cond.notify_all();
+    m_thread.join();
+  }
+  if (m_file != nullptr) {
+    if (fclose(m_file) != 0) {
+      m_write_error.store(true);
+    }
+    m_file = nullptr;
+  }
+}
+
+// Copy samples into the ring buffer.
+void IqRecorder::push(const IQSampleVector &samples) {
+  push(samples.data(), samples.size());
+}
+
+// Copy n samples from the pointer into the ring buffer.
+void IqRecorder::push(const IQSample *samples, std::size_t n) {
+  std::size_t size = m_ring.size();
+  std::size_t write_pos;
+
+  if (n == 0 || !m_thread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (n > size - m_fill) {
+      m_dropped_blocks++;
+      m_dropped_samples += n;
+      return;
+    }
+    write_pos = (m_read_pos + m_fill) % size;
+    // unlock m_mutex here by getting out of scope
+  }
+
+  // The free region of the ring buffer is not accessed by the writer thread
+  // until m_fill is updated, so the copy does not need the lock.
+  std::size_t first = std::min(n, size - write_pos);
+  std::copy(samples, samples + first, m_ring.begin() + write_pos);
+  std::copy(samples + first, samples + n, m_ring.begin());
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fill += n;
+    // unlock m_mutex here by getting out of scope
+  }
+  m_cond.notify_all();
+}
+
+// Copy n samples into the ring buffer, waiting for the space.
+bool IqRecorder::push_wait(const IQSample *samples, std::size_t n) {
+  std::size_t size = m_ring.size();
+
+  if (!m_thread.joinable()) {
+    return false;
+  }
+
+  while (n > 0) {
+    std::size_t count = std::min(n, size);
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [&] {
+        return size - m_fill >= count || m_write_error.load();
+      });
+      // unlock m_mutex here by getting out of scope
+    }
+    if (m_write_error.load()) {
+      return false;
+    }
+    push(samples, count);
+    samples += count;
+    n -= count;
+  }
+  return true;
+}
+
+// Return the number of samples waiting to be written.
+std::size_t IqRecorder::queued_samples() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_fill;
+}
+
+// Return the last error.
+std::string IqRecorder::error() const {
+  if (!m_error.empty()) {
+    return m_error;
+  } else if (m_write_error.load()) {
+    return "write error";
+  }
+  return std::string();
+}
+
+// Parse format name.
+bool IqRecorder::parse_format(const std::string &name, Format &format) {
+  if (name == "cf32") {
+    format = Format::CF32;
+  } else if (name == "cs16") {
+    format = Format::CS16;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Return format name.
+const char *IqRecorder::format_name(Format format) {
+  switch (format) {
+  case Format::CF32:
+    return "cf32";
+  case Format::CS16:
+    return "cs16";
+  }
+  return "";
+}
+
+// Write SigMF metadata file.
+bool IqRecorder::write_sigmf_meta(const std::string &filename,
+                                  double sample_rate, double frequency) {
+  std::FILE *meta = fopen(filename.c_str(), "w");
+  if (meta == nullptr) {
+    m_error = "can not open '" + filename + "' (" + strerror(errno) + ")";
+    return false;
+  }
+
+  char datetime[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(datetime, sizeof(datetime), "%Y-%m-%dT%H:%M:%SZ",
+                std::gmtime(&now));
+
+  fprintf(meta,
+          "{\n"
+          "  \"global\": {\n"
+          "    \"core:datatype\": \"%s\",\n"
+          "    \"core:sample_rate\": %.9g,\n"
+          "    \"core:version\": \"1.0.0\",\n"
+          "    \"core:recorder\": \"airspy-fmradion\"\n"
+          "  },\n"
+          "  \"captures\": [\n"
+          "    {\n"
+          "      \"core:sample_start\": 0,\n"
+          "      \"core:frequency\": %.9g,\n"
+          "      \"core:datetime\": \"%s\"\n"
+          "    }\n"
+          "  ],\n"
+          "  \"annotations\": []\n"
+          "}\n",
+          m_format == Format::CF32 ? "cf32_le" : "ci16_le", sample_rate,
+          frequency, datetime);
+
+  if (fclose(meta) != 0) {
+    m_error = "can not write '" + filename + "' (" + strerror(errno) + ")";
+    return false;
+  }
+  return true;
+}
+
+// Encode samples into m_bytebuf as little-endian data.
+void IqRecorder::encode_samples(const IQSample *samples, std::size_t n) {
+  switch (m_format) {
+  case Format::CF32: {
+    m_bytebuf.resize(8 * n);
+    std::vector<std::uint8_t>::iterator k = m_bytebuf.begin();
+    for (std::size_t i = 0; i < n; i++) {
+      const float v[2] = {samples[i].real(), samples[i].imag()};
+      for (unsigned int j = 0; j < 2; j++) {
+        std::uint32_t u;
+        memcpy(&u, &v[j], sizeof(u));
+        *(k++) = u & 0xff;
+        *(k++) = (u >> 8) & 0xff;
+        *(k++) = (u >> 16) & 0xff;
+        *(k++) = (u >> 24) & 0xff;
+      }
+    }
+  } break;
+  case Format::CS16: {
+    m_bytebuf.resize(4 * n);
+    std::vector<std::uint8_t>::iterator k = m_bytebuf.begin();
+    for (std::size_t i = 0; i < n; i++) {
+      const float v[2] = {samples[i].real(), samples[i].imag()};
+      for (unsigned int j = 0; j < 2; j++) {
+        // Limit output within [-1.0, 1.0].
+        float s = std::max(-1.0f, std::min(1.0f, v[j]));
+        std::uint16_t u =
+            static_cast<std::int16_t>(std::lrint(s * 32767.0f));
+        *(k++) = u & 0xff;
+        *(k++) = (u >> 8) & 0xff;
+      }
+    }
+  } break;
+  }
+}
+
+// Writer thread.
+void IqRecorder::run() {
+  std::size_t size = m_ring.size();
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true) {
+    m_cond.wait(lock, [&] { return m_fill > 0 || m_stop; });
+    if (m_fill == 0) {
+      // Stopped and all samples written.
+      break;
+    }
+
+    // Write the contiguous region from m_read_pos.
+    // The region is not modified by push() until m_fill is updated.
+    std::size_t start = m_read_pos;
+    std::size_t n = std::min(m_fill, size - start);
+    lock.unlock();
+
+    if (!m_write_error.load()) {
+      encode_samples(m_ring.data() + start, n);
+      if (fwrite(m_bytebuf.data(), 1, m_bytebuf.size(), m_file) !=
+          m_bytebuf.size()) {
+        m_write_error.store(true);
+      } else {
+        m_written_samples += n;
+      }
+    }
+
+    lock.lock();
+    m_read_pos = (start + n) % size;
+    m_fill -= n;
+    // Wake up push_wait().
+    m_cond.notify_all();
+  }
+}
+
+/* end */
@@ -0,0 +1,119 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "IqShmBus.h"
+
+// Create the shared memory object.
+IqShmPublisher::IqShmPublisher(const std::string &name,
+                               std::uint32_t sample_rate,
+                               std::uint32_t frequency,
+                               std::uint32_t configured_frequency,
+                               bool low_if, std::size_t capacity)
+    : m_name(name), m_size(shm_size(capacity)), m_header(nullptr),
+      m_ring(nullptr) {
+
+  int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    m_error = "can not open shared memory '" + m_name + "' (" +
+              strerror(errno) + ")";
+    return;
+  }
+
+  if (ftruncate(fd, m_size) < 0) {
+    m_error = "can not resize shared memory '" + m_name + "' (" +
+              strerror(errno) + ")";
+    close(fd);
+    shm_unlink(m_name.c_str());
+    return;
+  }
+
+  void *addr = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    m_error = "can not map shared memory '" + m_name + "' (" +
+              strerror(errno) + ")";
+    shm_unlink(m_name.c_str());
+    return;
+  }
+
+  m_header = new (addr) IqShmHeader;
+  m_ring = reinterpret_cast<IQSample *>(static_cast<char *>(addr) +
+                                        sizeof(IqShmHeader));
+  m_header->sample_rate = sample_rate;
+  m_header->frequency = frequency;
+  m_header->configured_frequency = configured_frequency;
+  m_header->low_if = low_if ? 1 : 0;
+  m_header->capacity = capacity;
+  m_header->write_reserve.store(0);
+  m_header->write_count.store(0);
+  m_header->closed.store(0);
+  m_header->version = IqShmHeader::version_value;
+  // Consumers check magic first, so it must be written last.
+  std::atomic_thread_fence(std::memory_order_release);
+  m_header->magic = IqShmHeader::magic_value;
+}
+
+// Mark the bus closed and remove the shared memory object.
+IqShmPublisher::~IqShmPublisher() {
+  if (m_header != nullptr) {
+    m_header->closed.store(1, std::memory_order_release);
+    munmap(m_header, m_size);
+    // Attached consumers keep their mappings until they detach.
+    shm_unlink(m_name.c_str());
+  }
+}
+
+// Copy samples into the ring buffer and advance the sequence number.
+void IqShmPublisher::publish(const IQSampleVector &samples) {
+  if (m_header == nullptr) {
+    return;
+  }
+
+  std::size_t capacity = m_header->capacity;
+  std::size_t n = samples.size();
+  IQSampleVector::const_iterator begin = samples.begin();
+  std::uint64_t count = m_header->write_count.load(std::memory_order_relaxed);
+
+  // Only the last capacity samples are kept if the block is too long.
+  if (n > capacity) {
+    count += n - capacity;
+    begin += n - capacity;
+    n = capacity;
+  }
+
+  // Announce the samples to be overwritten before the copy.
+  m_header->write_reserve.store(count + n, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  std::size_t pos = count % capacity;
+  std::size_t first = std::min(n, capacity - pos);
+  std::copy(begin, begin + first, m_ring + pos);
+  std::copy(begin + first, begin + n, m_ring);
+
+  m_header->write_count.store(count + n, std::memory_order_release);
+}
+
+/* end */
@@ -0,0 +1,75 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "MemoryLock.h"
+
+// Touch the stack pages of the calling thread.
+static void __attribute__((noinline)) prefault_stack() {
+  volatile unsigned char stack[MemoryLock::stack_bytes];
+  long page_size = sysconf(_SC_PAGESIZE);
+  for (std::size_t i = 0; i < sizeof(stack); i += page_size) {
+    stack[i] = 0;
+  }
+}
+
+bool MemoryLock::lock(std::string &error) {
+  prefault_stack();
+  // Locking the current memory also faults in its pages.
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    error = strerror(errno);
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY) {
+      error += ", RLIMIT_MEMLOCK " +
+               std::to_string(static_cast<unsigned long long>(limit.rlim_cur)) +
+               " bytes";
+    }
+    return false;
+  }
+  return true;
+}
+
+// Return the page faults of the rusage target.
+static MemoryLock::PageFaults page_faults(int who) {
+  struct rusage usage;
+  if (getrusage(who, &usage) != 0) {
+    return MemoryLock::PageFaults{0, 0};
+  }
+  return MemoryLock::PageFaults{usage.ru_minflt, usage.ru_majflt};
+}
+
+MemoryLock::PageFaults MemoryLock::process_page_faults() {
+  return page_faults(RUSAGE_SELF);
+}
+
+MemoryLock::PageFaults MemoryLock::thread_page_faults() {
+#ifdef RUSAGE_THREAD
+  return page_faults(RUSAGE_THREAD);
+#else
+  return page_faults(RUSAGE_SELF);
+#endif
+}
+
+/* end */
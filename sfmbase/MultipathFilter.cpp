@@ -22,23 +22,41 @@
 // Signal Processing, vol. 31, no. 2, pp. 459-472, April 1983.
 // doi: 10.1109/TASSP.1983.1164062
 
+// Proportionate NLMS reference:
+// [3] J. Benesty and S. L. Gay, "An improved PNLMS algorithm," in 2002 IEEE
+// International Conference on Acoustics, Speech, and Signal Processing,
+// vol. 2, pp. II-1881-II-1884, 2002.
+// doi: 10.1109/ICASSP.2002.5744994
+
 // Multipath adaptive filter construction method reference in Japanese:
 // [2] Takashi Mochizuki, and Mitsutoshi Hatori, "Automatic Cancelling of FM
 // Multipath Distortion Using and Adaptive Digital Filter", The Journal of the
 // Institute of Television Engineers of Japan, Vol. 39, No. 3, pp. 228-234
 // (1985). https://doi.org/10.3169/itej1978.39.228
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <ctime>
 
 #include "MultipathFilter.h"
 
 // Class MultipathFilter
 // Complex adaptive filter for reducing FM multipath.
 
-MultipathFilter::MultipathFilter(unsigned int stages)
+constexpr unsigned int
+    MultipathFilter::update_intervals[MultipathFilter::update_interval_levels];
+
+// Thread CPU time in seconds.
+static double thread_cpu_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+MultipathFilter::MultipathFilter(unsigned int stages, Algorithm algorithm)
     : // Filter stages.
-      m_stages(stages)
+      m_stages(stages), m_algorithm(algorithm)
 
       // Filter reference point position in the vector.
       ,
@@ -60,16 +78,46 @@ MultipathFilter::MultipathFilter(unsigned int stages)
 
       // Initialize coefficient and state vectors with the size.
       ,
-      m_coeff(m_filter_order), m_state(m_filter_order) {
+      m_coeff(m_filter_order), m_state(m_filter_order * 2), m_state_pos(0),
+      m_state_window(m_state.data() + 1), m_state_mag_sq(m_filter_order),
+      m_state_power(0), m_error(0), m_coeff_mag(m_filter_order),
+      m_tap_gain(m_filter_order), m_weighted_state(m_filter_order),
+      m_pruned_mag_sum(0), m_prune_countdown(0),
+      m_interval_level(0), m_update_countdown(0), m_stable_count(0),
+      m_error_fast(0), m_error_slow(0) {
 
   assert(stages > 0);
-  for (unsigned int i = 0; i < m_filter_order; i++) {
+  for (unsigned int i = 0; i < update_interval_levels; i++) {
+    m_level_samples[i] = 0;
+    m_level_cpu_time[i] = 0;
+  }
+  for (unsigned int i = 0; i < m_filter_order * 2; i++) {
     m_state[i] = IQSample(0, 0);
   }
+  m_active_taps.reserve(m_filter_order);
   initialize_coefficients();
 }
 
+bool MultipathFilter::set_coefficients(const MfCoeffVector &coeff) {
+  if (coeff.size() != m_filter_order) {
+    return false;
+  }
+  m_coeff = coeff;
+  // Select the active taps again at the next update.
+  m_prune_countdown = 0;
+  return true;
+}
+
 void MultipathFilter::initialize_coefficients() {
+  // Restart adaptation at the full rate.
+  m_interval_level = 0;
+  m_stable_count = 0;
+  m_error_fast = 0;
+  m_error_slow = 0;
+  // Update all taps until the echoes are found again.
+  m_active_taps.clear();
+  m_prune_countdown = 0;
+
   for (unsigned int i = 0; i < m_index_reference_point; i++) {
     m_coeff[i] = MfCoeff(0, 0);
   }
@@ -85,16 +133,23 @@ void MultipathFilter::initialize_coefficients() {
 
 // Apply a simple FIR filter for each input.
 inline IQSample MultipathFilter::single_process(const IQSample filter_input) {
-  // Remove the element number zero (oldest one)
-  // and add the input as the newest element at the end of the buffer
-  m_state.emplace_back(filter_input);
-  m_state.erase(m_state.begin());
+  // Overwrite the oldest element by the input at both positions,
+  // then the window ends with the input as the newest element,
+  // without moving the other elements.
+  // The overwritten element is the oldest one leaving the window.
+  m_state_power += std::norm(filter_input) - std::norm(m_state[m_state_pos]);
+  m_state[m_state_pos] = filter_input;
+  m_state[m_state_pos + m_filter_order] = filter_input;
+  m_state_window = m_state.data() + m_state_pos + 1;
+  if (++m_state_pos == m_filter_order) {
+    m_state_pos = 0;
+  }
   IQSample output = IQSample(0, 0);
   // VOLK calculation, equivalent to:
   // for (unsigned int i = 0; i < m_filter_order; i++) {
-  //   output += m_state[i] * m_coeff[i];
+  //   output += m_state_window[i] * m_coeff[i];
   // }
-  volk_32fc_x2_dot_prod_32fc(&output, m_state.data(), m_coeff.data(),
+  volk_32fc_x2_dot_prod_32fc(&output, m_state_window, m_coeff.data(),
                              m_filter_order);
   return output;
 }
@@ -102,8 +157,6 @@ inline IQSample MultipathFilter::single_process(const IQSample filter_input) {
 // Update coefficients by complex LMS/CMA method.
 inline void MultipathFilter::update_coeff(const IQSample result) {
 
-  volk::vector<float> state_mag_sq;
-  state_mag_sq.resize(m_filter_order);
   float state_mag_sq_sum;
 
   // Input instant envelope
@@ -115,9 +168,9 @@ inline void MultipathFilter::update_coeff(const IQSample result) {
   // First calculate the square norm of input data (m_state) by
   // * Compute the square magnitude of each element of m_state
   // * Then add the square magnitude for all the elements
-  volk_32fc_magnitude_squared_32f(state_mag_sq.data(), m_state.data(),
+  volk_32fc_magnitude_squared_32f(m_state_mag_sq.data(), m_state_window,
                                   m_filter_order);
-  volk_32f_accumulator_s32f(&state_mag_sq_sum, state_mag_sq.data(),
+  volk_32f_accumulator_s32f(&state_mag_sq_sum, m_state_mag_sq.data(),
                             m_filter_order);
   // fprintf(stderr, "state_mag_sq_sum = %.9g\n", state_mag_sq_sum);
 
@@ -131,13 +184,13 @@ inline void MultipathFilter::update_coeff(const IQSample result) {
   // Recalculate all coefficients
   // VOLK calculation, equivalent to:
   // for (unsigned int i = 0; i < m_filter_order; i++) {
-  //  m_coeff[i] += factor_times_result * std::conj(m_state[i]);
+  //  m_coeff[i] += factor_times_result * std::conj(m_state_window[i]);
   // }
   // Note: always check if the result and the source vectors can overlap!
   // For volk_32fc_x2_s32fc_multiply_conjugate_add_32fc(),
   // the overlapping issue seems to be OK.
   volk_32fc_x2_s32fc_multiply_conjugate_add_32fc(
-      m_coeff.data(), m_coeff.data(), m_state.data(), factor_times_result,
+      m_coeff.data(), m_coeff.data(), m_state_window, factor_times_result,
       m_filter_order);
   // Set the imaginary part of the middle (position 0) coefficient to zero
   m_coeff[m_index_reference_point] =
@@ -146,6 +199,153 @@ inline void MultipathFilter::update_coeff(const IQSample result) {
   m_error = error;
 }
 
+// Update coefficients by complex IPNLMS/CMA method [3].
+// Each tap k has its own step gain
+//   g[k] = (1 - a) / (2 * N) + (1 + a) * |h[k]| / (2 * sum(|h|) + eps)
+// where a = ipnlms_alpha and N = m_filter_order, and is updated as
+//   h[k] += alpha * error * result * g[k] * conj(x[k])
+//           / sum(g[k] * |x[k]|^2)
+// which is the same as NLMS when all g[k] = 1 / N.
+// In IpnlmsSparse, once the interval is lengthened from the full rate,
+// only the taps selected at every prune_refresh-th update are updated
+// in between, and the proportionate part of g[k] * |x[k]|^2
+// of the other taps is omitted from the normalization.
+inline void MultipathFilter::update_coeff_proportionate(const IQSample result) {
+  // Input instant envelope
+  const double env = std::norm(result);
+  // error = [desired signal] - [filter output]
+  const double error = if_target_level - env;
+
+  const bool sparse = m_algorithm == Algorithm::IpnlmsSparse;
+  const bool full_update =
+      !sparse || m_interval_level == 0 || m_prune_countdown == 0;
+  const float gain_uniform = (1 - ipnlms_alpha) / (2 * m_filter_order);
+  float mag_sum;
+  float weighted_power;
+
+  if (full_update) {
+    // Cancel the rounding error accumulated in the running sum.
+    volk_32fc_magnitude_squared_32f(m_state_mag_sq.data(), m_state_window,
+                                    m_filter_order);
+    float state_mag_sq_sum;
+    volk_32f_accumulator_s32f(&state_mag_sq_sum, m_state_mag_sq.data(),
+                              m_filter_order);
+    m_state_power = state_mag_sq_sum;
+
+    volk_32fc_magnitude_32f(m_coeff_mag.data(), m_coeff.data(),
+                            m_filter_order);
+    volk_32f_accumulator_s32f(&mag_sum, m_coeff_mag.data(), m_filter_order);
+    const float gain_proportionate =
+        (1 + ipnlms_alpha) / (2 * mag_sum + ipnlms_epsilon);
+    volk_32f_x2_dot_prod_32f(&weighted_power, m_coeff_mag.data(),
+                             m_state_mag_sq.data(), m_filter_order);
+    weighted_power = gain_uniform * state_mag_sq_sum +
+                     gain_proportionate * weighted_power;
+    m_mu = alpha / weighted_power;
+
+    // Apply the tap gains to the state, then equivalent to:
+    // for (unsigned int i = 0; i < m_filter_order; i++) {
+    //   m_coeff[i] += factor_times_result * m_tap_gain[i] *
+    //                 std::conj(m_state_window[i]);
+    // }
+    for (unsigned int i = 0; i < m_filter_order; i++) {
+      m_tap_gain[i] = gain_uniform + gain_proportionate * m_coeff_mag[i];
+    }
+    volk_32fc_32f_multiply_32fc(m_weighted_state.data(), m_state_window,
+                                m_tap_gain.data(), m_filter_order);
+    const float factor = error * m_mu;
+    const MfCoeff factor_times_result =
+        MfCoeff(factor * result.real(), factor * result.imag());
+    volk_32fc_x2_s32fc_multiply_conjugate_add_32fc(
+        m_coeff.data(), m_coeff.data(), m_weighted_state.data(),
+        factor_times_result, m_filter_order);
+  } else {
+    // The magnitudes of the pruned taps do not change
+    // between the full updates.
+    mag_sum = m_pruned_mag_sum;
+    weighted_power = 0;
+    for (unsigned int k : m_active_taps) {
+      const float mag = std::sqrt(std::norm(m_coeff[k]));
+      m_coeff_mag[k] = mag;
+      mag_sum += mag;
+      weighted_power += mag * std::norm(m_state_window[k]);
+    }
+    const float gain_proportionate =
+        (1 + ipnlms_alpha) / (2 * mag_sum + ipnlms_epsilon);
+    weighted_power = gain_uniform * m_state_power +
+                     gain_proportionate * weighted_power;
+    m_mu = alpha / weighted_power;
+
+    const float factor = error * m_mu;
+    const MfCoeff factor_times_result =
+        MfCoeff(factor * result.real(), factor * result.imag());
+    for (unsigned int k : m_active_taps) {
+      const float gain = gain_uniform + gain_proportionate * m_coeff_mag[k];
+      m_coeff[k] += (gain * factor_times_result) * std::conj(m_state_window[k]);
+    }
+  }
+  // Set the imaginary part of the middle (position 0) coefficient to zero
+  m_coeff[m_index_reference_point] =
+      MfCoeff(m_coeff[m_index_reference_point].real(), 0);
+  // Set the latest error value for monitoring
+  m_error = error;
+
+  if (!sparse) {
+    return;
+  }
+  if (!full_update) {
+    m_prune_countdown--;
+    return;
+  }
+  if (m_interval_level == 0) {
+    // Update all taps while adapting at the full rate,
+    // so that new echoes are found.
+    m_active_taps.clear();
+    m_prune_countdown = 0;
+    return;
+  }
+  // Select the taps to update until the next full update.
+  // The reference point is always updated.
+  float mag_max = 0;
+  for (unsigned int i = 0; i < m_filter_order; i++) {
+    mag_max = std::max(mag_max, m_coeff_mag[i]);
+  }
+  const float threshold = mag_max * prune_threshold;
+  m_active_taps.clear();
+  m_pruned_mag_sum = 0;
+  for (unsigned int i = 0; i < m_filter_order; i++) {
+    if (m_coeff_mag[i] >= threshold || i == m_index_reference_point) {
+      m_active_taps.push_back(i);
+    } else {
+      m_pruned_mag_sum += m_coeff_mag[i];
+    }
+  }
+  m_prune_countdown = prune_refresh - 1;
+}
+
+// Lengthen the update interval while the error is small and stable,
+// and return to the full rate on an error spike.
+inline void MultipathFilter::schedule_update(const double error) {
+  // Exponential moving averages of the error magnitude
+  // over ~16 and ~1024 updates.
+  float error_mag = std::fabs(error);
+  m_error_fast += (error_mag - m_error_fast) * (1.0f / 16);
+  m_error_slow += (error_mag - m_error_slow) * (1.0f / 1024);
+
+  if (m_error_fast > m_error_slow + spike_margin) {
+    m_interval_level = 0;
+    m_stable_count = 0;
+  } else if (m_error_slow < stable_error) {
+    if (++m_stable_count >= stable_updates &&
+        m_interval_level + 1 < update_interval_levels) {
+      m_interval_level++;
+      m_stable_count = 0;
+    }
+  } else {
+    m_stable_count = 0;
+  }
+}
+
 // Process block samples.
 bool MultipathFilter::process(const IQSampleVector &samples_in,
                               IQSampleVector &samples_out) {
@@ -156,10 +356,13 @@ bool MultipathFilter::process(const IQSampleVector &samples_in,
   }
   samples_out.resize(n);
 
-  // Note: this is bitmask
-  // Run the update every four (4) samples to reduce CPU load
-  // This still maintain 384000/4 = 96000 times/sec update rate
-  const unsigned int filter_interval = 0x03;
+  // Account the CPU time to the interval level at the block start.
+  unsigned int level = m_interval_level;
+  double start_time = thread_cpu_time();
+
+  // Run the update every four (4) samples or less often
+  // to reduce CPU load, as scheduled by schedule_update().
+  // The full rate still maintains 384000/4 = 96000 times/sec update rate
   for (unsigned int i = 0; i < n; i++) {
     IQSample output = single_process(samples_in[i]);
     // Note well: -ffast-math DISABLES NaN processing (-menable-no-nans)
@@ -169,9 +372,17 @@ bool MultipathFilter::process(const IQSampleVector &samples_in,
       return false;
     }
     samples_out[i] = output;
-    if ((i & filter_interval) == 0) {
+    if (m_update_countdown > 0) {
+      m_update_countdown--;
+    } else {
+      m_update_countdown = update_intervals[m_interval_level] - 1;
       // Update filter coefficients here
-      update_coeff(output);
+      if (m_algorithm == Algorithm::Nlms) {
+        update_coeff(output);
+      } else {
+        update_coeff_proportionate(output);
+      }
+      schedule_update(m_error);
       // Check if error value is finite
       if (!std::isfinite(m_error)) {
         return false;
@@ -184,6 +395,8 @@ bool MultipathFilter::process(const IQSampleVector &samples_in,
     }
   }
   assert(n == samples_out.size());
+  m_level_samples[level] += n;
+  m_level_cpu_time[level] += thread_cpu_time() - start_time;
   return true;
 }
 
@@ -51,6 +51,15 @@ NbfmDecoder::NbfmDecoder(IQSampleCoeff &nbfmfilter_coeff, const double freq_dev)
   // Do nothing
 }
 
+void NbfmDecoder::reserve(std::size_t n) {
+  m_buf_filtered.reserve(n);
+  m_samples_in_after_agc.reserve(n);
+  m_buf_decoded.reserve(n);
+  m_buf_baseband.reserve(n);
+  m_buf_baseband_filtered.reserve(n);
+  m_ifagc.reserve(n);
+}
+
 void NbfmDecoder::process(const IQSampleVector &samples_in,
                           SampleVector &audio) {
 
@@ -78,10 +87,10 @@ void NbfmDecoder::process(const IQSampleVector &samples_in,
     audio.resize(0);
     return;
   }
-  // Convert decoded data to baseband data
-  m_buf_baseband.resize(decoded_size);
-  volk_32f_convert_64f(m_buf_baseband.data(), m_buf_decoded.data(),
-                       decoded_size);
+  // Convert decoded data to baseband data,
+  // and measure baseband level in the same pass.
+  m_baseband_meter.reset();
+  m_baseband_meter.convert(m_buf_decoded, m_buf_baseband);
 
   // If no downsampled baseband signal comes out,
   // terminate and wait for next block,
@@ -90,11 +99,9 @@ void NbfmDecoder::process(const IQSampleVector &samples_in,
     return;
   }
 
-  // Measure baseband level.
-  float baseband_mean, baseband_rms;
-  Utility::samples_mean_rms(m_buf_decoded, baseband_mean, baseband_rms);
-  m_baseband_mean = 0.95 * m_baseband_mean + 0.05 * baseband_mean;
-  m_baseband_level = 0.95 * m_baseband_level + 0.05 * baseband_rms;
+  // Update baseband level.
+  m_baseband_mean = 0.95 * m_baseband_mean + 0.05 * m_baseband_meter.mean();
+  m_baseband_level = 0.95 * m_baseband_level + 0.05 * m_baseband_meter.rms();
 
   // Filter out audio high frequency noise.
   m_audiofilter.process(m_buf_baseband, m_buf_baseband_filtered);
@@ -104,7 +111,15 @@ void NbfmDecoder::process(const IQSampleVector &samples_in,
   Utility::adjust_gain(m_buf_baseband_filtered, audio_gain);
 
   // Just return mono channel.
-  audio = std::move(m_buf_baseband_filtered);
+  audio.swap(m_buf_baseband_filtered);
+}
+
+// Return the processing cost of the FIR filter stages.
+std::vector<FilterStageCost> NbfmDecoder::get_filter_costs() const {
+  std::vector<FilterStageCost> costs;
+  costs.push_back(m_nbfmfilter.get_cost("NBFM IF filter", internal_rate_pcm));
+  costs.push_back(m_audiofilter.get_cost("NBFM audio filter", sample_rate_pcm));
+  return costs;
 }
 
 /* end */
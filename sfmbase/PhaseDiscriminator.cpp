@@ -17,8 +17,10 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
 
 #include "PhaseDiscriminator.h"
 #include "Utility.h"
@@ -29,21 +31,63 @@
 // frequency scaling factor = 1.0 / (max_freq_dev * 2.0 * M_PI)
 PhaseDiscriminator::PhaseDiscriminator(double max_freq_dev)
     : m_normalize_factor(max_freq_dev * 2.0 * M_PI),
-      // boundary = M_PI / m_normalize_factor;
-      m_boundary(1.0 / (max_freq_dev * 2.0)) {}
+      m_scale(1.0 / m_normalize_factor), m_last_sample(0) {}
+
+// Compute atan2(y, x).
+// atan(a) for 0 <= a <= 1 is approximated by an odd polynomial
+// of degree 15 (least maximum error fit),
+// then mapped to the octant of (x, y) by selections,
+// which the compiler can vectorize as blend instructions.
+inline float PhaseDiscriminator::fast_atan2(float y, float x) {
+  float ax = std::fabs(x);
+  float ay = std::fabs(y);
+  float mx = std::max(ax, ay);
+  float mn = std::min(ax, ay);
+  float a = (mx > 0) ? mn / mx : 0.0f;
+  float s = a * a;
+  float r =
+      a * (0.999999344f +
+           s * (-0.333298594f +
+                s * (0.199465662f +
+                     s * (-0.139086291f +
+                          s * (0.096421957f +
+                               s * (-0.0559123009f +
+                                    s * (0.021862939f +
+                                         s * -0.00405456172f)))))));
+  r = (ay > ax) ? float(M_PI_2) - r : r;
+  r = (x < 0) ? float(M_PI) - r : r;
+  return (y < 0) ? -r : r;
+}
 
 // Process samples.
 void PhaseDiscriminator::process(const IQSampleVector &samples_in,
                                  IQSampleDecodedVector &samples_out) {
   unsigned int n = samples_in.size();
   samples_out.resize(n);
-  m_phase.resize(n);
+  if (n == 0) {
+    return;
+  }
+
+  // Phase difference from the last sample of the previous block.
+  IQSample d0 = samples_in[0] * std::conj(m_last_sample);
+  samples_out[0] = fast_atan2(d0.imag(), d0.real()) * m_scale;
+
+  // std::complex<float> is layout-compatible with float[2].
+  const float *x = reinterpret_cast<const float *>(samples_in.data());
+  float *out = samples_out.data();
+  const float scale = m_scale;
+  for (std::size_t i = 1; i < n; i++) {
+    float re = x[2 * i];
+    float im = x[2 * i + 1];
+    float re_prev = x[2 * i - 2];
+    float im_prev = x[2 * i - 1];
+    // x[i] * conj(x[i - 1])
+    float d_re = re * re_prev + im * im_prev;
+    float d_im = im * re_prev - re * im_prev;
+    out[i] = fast_atan2(d_im, d_re) * scale;
+  }
 
-  // libvolk parallelism
-  volk_32fc_s32f_atan2_32f(m_phase.data(), samples_in.data(),
-                           m_normalize_factor, n);
-  volk_32f_s32f_32f_fm_detect_32f(samples_out.data(), m_phase.data(),
-                                  m_boundary, &m_save_value, n);
+  m_last_sample = samples_in[n - 1];
 }
 
 /* end */
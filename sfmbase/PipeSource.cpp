@@ -0,0 +1,332 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+
+#include "ConfigParser.h"
+#include "PipeSource.h"
+#include "ThreadPolicy.h"
+
+PipeSource *PipeSource::m_this = 0;
+
+// Constructor
+PipeSource::PipeSource(int dev_index)
+    : m_sample_rate(default_sample_rate), m_frequency(default_frequency),
+      m_zero_offset(false), m_block_length(default_block_length),
+      m_format_type(FormatType::CU8), m_sample_size(2), m_fd(-1),
+      m_thread(0) {
+  m_this = this;
+}
+
+// Destructor
+PipeSource::~PipeSource() {
+  // Close the pipe unless stdin.
+  if (m_fd > STDIN_FILENO) {
+    close(m_fd);
+  }
+  m_fd = -1;
+
+  m_this = 0;
+}
+
+bool PipeSource::configure(std::string configurationStr) {
+  std::string filename("-");
+  FormatType format_type = FormatType::CU8;
+  uint32_t sample_rate = default_sample_rate;
+  uint32_t frequency = default_frequency;
+  bool zero_offset = false;
+  int block_length = default_block_length;
+
+  ConfigParser cp;
+  ConfigParser::map_type m;
+
+  // filename
+  cp.parse_config_string(configurationStr, m);
+  if (m.find("filename") != m.end()) {
+    std::cerr << "PipeSource::configure: filename: " << m["filename"]
+              << std::endl;
+    filename = m["filename"];
+  }
+
+  // srate
+  if (m.find("srate") != m.end()) {
+    std::cerr << "PipeSource::configure: srate: " << m["srate"] << std::endl;
+    sample_rate = atoi(m["srate"].c_str());
+  }
+
+  // freq
+  if (m.find("freq") != m.end()) {
+    std::cerr << "PipeSource::configure: freq: " << m["freq"] << std::endl;
+    frequency = atoi(m["freq"].c_str());
+  }
+
+  // blklen
+  if (m.find("blklen") != m.end()) {
+    std::cerr << "PipeSource::configure: blklen: " << m["blklen"] << std::endl;
+    block_length = atoi(m["blklen"].c_str());
+  }
+
+  // zero_offset
+  if (m.find("zero_offset") != m.end()) {
+    std::cerr << "PipeSource::configure: zero_offset" << std::endl;
+    zero_offset = true;
+  }
+
+  // format_type
+  if (m.find("format") != m.end()) {
+    if (m["format"] == "cu8") {
+      format_type = FormatType::CU8;
+    } else if (m["format"] == "cs8") {
+      format_type = FormatType::CS8;
+    } else if (m["format"] == "cs16") {
+      format_type = FormatType::CS16;
+    } else if (m["format"] == "cf32") {
+      format_type = FormatType::CF32;
+    } else {
+      std::cerr << "PipeSource::configure: format: " << m["format"]
+                << " is not supported." << std::endl;
+      std::cerr << "PipeSource::configure: supported format is cu8, cs8, "
+                   "cs16, cf32."
+                << std::endl;
+      return false;
+    }
+    std::cerr << "PipeSource::configure: format: " << m["format"] << std::endl;
+  }
+
+  // configure
+  return configure(filename, format_type, sample_rate, frequency, zero_offset,
+                   block_length);
+}
+
+bool PipeSource::configure(std::string fname, FormatType format_type,
+                           std::uint32_t sample_rate, std::uint32_t frequency,
+                           bool zero_offset, int block_length) {
+  m_devname = fname;
+  m_format_type = format_type;
+  m_sample_rate = sample_rate;
+  m_frequency = frequency;
+  m_zero_offset = zero_offset;
+
+  if (block_length <= 0) {
+    m_error = "Invalid block length";
+    return false;
+  }
+  m_block_length = block_length;
+
+  switch (m_format_type) {
+  case FormatType::CU8:
+    m_sample_size = 2;
+    m_format_name = "cu8";
+    break;
+  case FormatType::CS8:
+    m_sample_size = 2;
+    m_format_name = "cs8";
+    break;
+  case FormatType::CS16:
+    m_sample_size = 4;
+    m_format_name = "cs16";
+    break;
+  case FormatType::CF32:
+    m_sample_size = 8;
+    m_format_name = "cf32";
+    break;
+  }
+
+  // CF32 samples are read directly into the sample blocks.
+  if (m_format_type != FormatType::CF32) {
+    m_bytebuf.resize(m_block_length * m_sample_size);
+  }
+
+  // Open pipe.
+  if (m_devname == "-") {
+    m_fd = STDIN_FILENO;
+  } else {
+    // Note: opening a FIFO blocks until the writer opens it.
+    m_fd = open(m_devname.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+      m_error = "Failed to open ";
+      m_error += m_devname + " : " + strerror(errno);
+      return false;
+    }
+  }
+
+  m_confFreq = frequency;
+
+  return true;
+}
+
+std::uint32_t PipeSource::get_sample_rate() { return m_sample_rate; }
+
+std::uint32_t PipeSource::get_frequency() { return m_frequency; }
+
+bool PipeSource::is_low_if() { return !m_zero_offset; }
+
+void PipeSource::print_specific_parms() {
+  fprintf(stderr, "Pipe format:       %s\n", m_format_name.c_str());
+}
+
+// Return a list of supported device.
+void PipeSource::get_device_names(std::vector<std::string> &devices) {
+  devices.push_back("PipeSource");
+}
+
+bool PipeSource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag) {
+  m_buf = buf;
+  m_stop_flag = stop_flag;
+
+  // Start thread.
+  if (m_thread == 0) {
+    m_thread = new std::thread(run);
+    return true;
+  } else {
+    m_error = "Source thread already started";
+    return false;
+  }
+}
+
+bool PipeSource::stop() {
+  // Terminate thread.
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+  }
+
+  return true;
+}
+
+// Read exactly size bytes unless the end of stream is reached.
+long PipeSource::read_fully(std::uint8_t *buf, std::size_t size) {
+  std::size_t done = 0;
+
+  while (done < size) {
+    if (m_this->m_stop_flag->load()) {
+      return -1;
+    }
+
+    // Wait with timeout so that the stop flag is checked periodically.
+    struct pollfd pfd;
+    pfd.fd = m_this->m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ret = poll(&pfd, 1, poll_timeout_ms);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "PipeSource: poll: " << strerror(errno) << std::endl;
+      return -1;
+    } else if (ret == 0) {
+      continue;
+    }
+
+    ssize_t len = read(m_this->m_fd, buf + done, size - done);
+    if (len < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      std::cerr << "PipeSource: read: " << strerror(errno) << std::endl;
+      return -1;
+    } else if (len == 0) {
+      // End of stream.
+      break;
+    }
+    done += len;
+  }
+
+  return done;
+}
+
+// Convert n samples in m_bytebuf into samples.
+void PipeSource::convert(IQSampleVector &samples, std::size_t n) {
+  float *out = reinterpret_cast<float *>(samples.data());
+  std::uint8_t *in = m_this->m_bytebuf.data();
+
+  switch (m_this->m_format_type) {
+  case FormatType::CU8:
+    // Offset binary to two's complement: (u - 128) == (int8_t)(u ^ 0x80)
+    for (std::size_t i = 0; i < 2 * n; i++) {
+      in[i] ^= 0x80;
+    }
+    volk_8i_s32f_convert_32f(out, reinterpret_cast<const std::int8_t *>(in),
+                             128.0f, 2 * n);
+    break;
+  case FormatType::CS8:
+    volk_8i_s32f_convert_32f(out, reinterpret_cast<const std::int8_t *>(in),
+                             128.0f, 2 * n);
+    break;
+  case FormatType::CS16:
+    volk_16i_s32f_convert_32f(out, reinterpret_cast<const std::int16_t *>(in),
+                              32768.0f, 2 * n);
+    break;
+  case FormatType::CF32:
+    // Already read into samples.
+    break;
+  }
+}
+
+// Thread to read IQSample from the pipe.
+void PipeSource::run() {
+  const std::size_t block_length = m_this->m_block_length;
+  const std::size_t sample_size = m_this->m_sample_size;
+
+  ThreadPolicy::apply(ThreadPolicy::Role::Source);
+
+  while (!m_this->m_stop_flag->load()) {
+    // Reuse a block recycled by the consumer.
+    IQSampleVector iqsamples = m_this->m_buf->get_block(block_length);
+
+    // CF32 (native float, little-endian) is read without conversion.
+    std::uint8_t *dest =
+        (m_this->m_format_type == FormatType::CF32)
+            ? reinterpret_cast<std::uint8_t *>(iqsamples.data())
+            : m_this->m_bytebuf.data();
+
+    long len = read_fully(dest, block_length * sample_size);
+    if (len <= 0) {
+      break;
+    }
+
+    // Drop the incomplete sample at the end of stream.
+    std::size_t n = len / sample_size;
+    if (n == 0) {
+      break;
+    }
+    convert(iqsamples, n);
+    iqsamples.resize(n);
+
+    // Push samples.
+    m_this->m_buf->push(std::move(iqsamples));
+
+    if (n < block_length) {
+      // End of stream.
+      break;
+    }
+  }
+
+  // Push end.
+  m_this->m_buf->push_end();
+}
+
+/* end */
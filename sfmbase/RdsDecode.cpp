@@ -0,0 +1,431 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// RDS specification reference:
+// [1] CENELEC EN 50067:1998, "Specification of the radio data system (RDS)
+// for VHF/FM sound broadcasting in the frequency range from 87,5 to 108,0
+// MHz".
+// [2] NRSC-4-B, "United States RBDS Standard", April 2011.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "RdsDecode.h"
+
+// Generator polynomial of the (26, 16) shortened cyclic code:
+// g(x) = x^10 + x^8 + x^7 + x^5 + x^4 + x^3 + 1
+static constexpr std::uint32_t rds_generator = 0x5b9;
+
+// Offset words of block A, B, C, C', and D.
+// Note: the syndrome of a valid block equals to the offset word
+//       when computed as the remainder of the division by g(x).
+static constexpr unsigned int rds_offset_a = 0x0fc;
+static constexpr unsigned int rds_offset_b = 0x198;
+static constexpr unsigned int rds_offset_c = 0x168;
+static constexpr unsigned int rds_offset_cprime = 0x350;
+static constexpr unsigned int rds_offset_d = 0x1b4;
+
+// Lose the block synchronization after this number of consecutive errors.
+static constexpr unsigned int rds_max_bad_blocks = 8;
+
+// class RdsDecoder
+
+RdsDecoder::RdsDecoder()
+    // Initialize member fields
+    : m_history(filter_taps - 1, IQSample(0, 0)),
+      m_decim_pos(filter_taps - 1), m_sq_average(0, 0), m_mf_index(0),
+      m_mf_sum_first(0), m_mf_sum_second(0), m_bit_phase(3.0),
+      m_energy_ontime(0), m_energy_halfway(0), m_prev_symbol(0),
+      m_shift_reg(0), m_bit_count(0), m_synced(false),
+      m_sync_candidate_offset(0), m_sync_candidate_bit(0),
+      m_sync_candidate(false), m_block_index(0), m_bad_blocks(0),
+      m_group_valid(0), m_sample_cnt(0), m_decimated_cnt(0), m_pi(0),
+      m_ps_buf(8, ' '), m_ps_mask(0), m_rt_buf(64, ' '), m_rt_mask(0),
+      m_rt_ab_flag(-1) {
+  // Each half of a biphase symbol lasts for 1/(2 * bit_rate) seconds.
+  unsigned int half_symbol = lrint(sample_rate_rds / bit_rate / 2.0);
+  m_mf_delay.assign(2 * half_symbol, 0.0f);
+  design_filter();
+}
+
+// Create the decimation lowpass filter coefficients
+// by the Hamming-windowed sinc function.
+// RDS signal occupies +-2.4kHz around the subcarrier,
+// and the 6kHz cutoff leaves sufficient margin for the transition band.
+// Coefficients are stored in the reversed order.
+void RdsDecoder::design_filter() {
+  const double cutoff = 6000.0 / sample_rate_if;
+  const double center = (filter_taps - 1) / 2.0;
+  double sum = 0;
+  std::vector<double> coeff(filter_taps);
+
+  for (unsigned int i = 0; i < filter_taps; i++) {
+    double t = i - center;
+    double sinc = (t == 0) ? 2.0 * cutoff
+                           : std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+    double window = 0.54 - 0.46 * std::cos(2.0 * M_PI * i / (filter_taps - 1));
+    coeff[i] = sinc * window;
+    sum += coeff[i];
+  }
+
+  m_coeff.resize(filter_taps);
+  for (unsigned int i = 0; i < filter_taps; i++) {
+    // Normalize to the unity DC gain.
+    m_coeff[filter_taps - 1 - i] = coeff[i] / sum;
+  }
+}
+
+// Allocate the buffers in advance.
+void RdsDecoder::reserve(std::size_t n) {
+  // Up to two bits are left unconsumed in the matched filter output.
+  const std::size_t mf_left = 2 * std::size_t(sample_rate_rds / bit_rate) + 2;
+  // A group is 104 bits.
+  const std::size_t group_samples =
+      104 * std::size_t(sample_rate_if / bit_rate);
+  m_history.reserve(filter_taps - 1 + n);
+  m_decimated.reserve(n / decimation + 1);
+  m_mf_out.reserve(n / decimation + 1 + mf_left);
+  m_groups.reserve(n / group_samples + 2);
+}
+
+// Process MPX baseband samples.
+void RdsDecoder::process(const SampleVector &samples_in,
+                         const IQSampleVector &carrier) {
+  unsigned int n = samples_in.size();
+  assert(n == carrier.size());
+
+  m_groups.clear();
+  if (n == 0) {
+    return;
+  }
+
+  // Mix down the 57kHz subcarrier to the baseband.
+  unsigned int base = m_history.size();
+  m_history.resize(base + n);
+  for (unsigned int i = 0; i < n; i++) {
+    m_history[base + i] = carrier[i] * float(samples_in[i]);
+  }
+
+  // Polyphase decimation:
+  // compute the filter output only for every decimation-th sample.
+  m_decimated.clear();
+  unsigned int p = m_decim_pos;
+  unsigned int hsize = m_history.size();
+  IQSample sq_sum(0, 0);
+  for (; p < hsize; p += decimation) {
+    const IQSample *x = &m_history[p - (filter_taps - 1)];
+    float re = 0, im = 0;
+    for (unsigned int k = 0; k < filter_taps; k++) {
+      re += m_coeff[k] * x[k].real();
+      im += m_coeff[k] * x[k].imag();
+    }
+    IQSample y(re, im);
+    sq_sum += y * y;
+    m_decimated.push_back(y);
+  }
+
+  // Keep the last (filter_taps - 1) samples for the next block.
+  unsigned int drop = hsize - (filter_taps - 1);
+  m_history.erase(m_history.begin(), m_history.begin() + drop);
+  m_decim_pos = p - drop;
+  m_sample_cnt += n;
+
+  unsigned int nd = m_decimated.size();
+  if (nd == 0) {
+    return;
+  }
+  m_decimated_cnt += nd;
+
+  // Estimate the subcarrier phase offset.
+  // The subcarrier is locked to the pilot, so the phase offset
+  // is almost constant; squaring removes the BPSK modulation.
+  m_sq_average = 0.9f * m_sq_average + 0.1f * (sq_sum / float(nd));
+  float theta = 0.5f * std::arg(m_sq_average);
+  IQSample rotation = std::polar(1.0f, -theta);
+
+  // Apply the biphase symbol matched filter
+  // (+1 for the first half, -1 for the second half).
+  unsigned int mf_len = m_mf_delay.size();
+  unsigned int mf_half = mf_len / 2;
+  for (unsigned int i = 0; i < nd; i++) {
+    float s = (m_decimated[i] * rotation).real();
+    float oldest = m_mf_delay[m_mf_index];
+    float middle = m_mf_delay[(m_mf_index + mf_half) % mf_len];
+    m_mf_sum_first += middle - oldest;
+    m_mf_sum_second += s - middle;
+    m_mf_delay[m_mf_index] = s;
+    m_mf_index = (m_mf_index + 1) % mf_len;
+    m_mf_out.push_back(m_mf_sum_first - m_mf_sum_second);
+  }
+
+  // Recompute the running sums to prevent accumulating rounding errors.
+  m_mf_sum_first = 0;
+  m_mf_sum_second = 0;
+  for (unsigned int i = 0; i < mf_half; i++) {
+    m_mf_sum_first += m_mf_delay[(m_mf_index + i) % mf_len];
+    m_mf_sum_second += m_mf_delay[(m_mf_index + mf_half + i) % mf_len];
+  }
+
+  recover_bits();
+}
+
+// Recover the bit clock from the matched filter output
+// by an early-late gate, and make the bit decisions.
+inline void RdsDecoder::recover_bits() {
+  const double samples_per_bit = sample_rate_rds / bit_rate;
+  const double half_bit = samples_per_bit / 2.0;
+  const double delta = 2.0;
+  const double loop_gain = 0.25;
+  const unsigned int size = m_mf_out.size();
+
+  // Linear interpolation of the matched filter output.
+  auto interpolate = [&](double t) {
+    unsigned int i = static_cast<unsigned int>(t);
+    float frac = t - i;
+    return m_mf_out[i] * (1.0f - frac) + m_mf_out[i + 1] * frac;
+  };
+
+  while (m_bit_phase + half_bit + 1.0 < size) {
+    float value = interpolate(m_bit_phase);
+    float early = std::fabs(interpolate(m_bit_phase - delta));
+    float late = std::fabs(interpolate(m_bit_phase + delta));
+    float halfway = std::fabs(interpolate(m_bit_phase + half_bit));
+
+    // Bit decision and differential decoding.
+    unsigned int symbol = value > 0 ? 1 : 0;
+    unsigned int bit = symbol ^ m_prev_symbol;
+    m_prev_symbol = symbol;
+    process_bit(bit);
+
+    // The matched filter also peaks at the middle of two bits
+    // when the adjacent symbols are the same.
+    // Detect which of the two instants gives larger average energy
+    // and skip half a bit if the current one is the wrong one.
+    m_energy_ontime = 0.99f * m_energy_ontime + 0.01f * std::fabs(value);
+    m_energy_halfway = 0.99f * m_energy_halfway + 0.01f * halfway;
+    double step = samples_per_bit;
+    if (m_energy_halfway > 1.25f * m_energy_ontime) {
+      step += half_bit;
+      std::swap(m_energy_ontime, m_energy_halfway);
+    }
+
+    // Move the sampling instant towards the larger side.
+    float error = (late - early) / (late + early + 1.0e-9f);
+    m_bit_phase += step + loop_gain * error;
+  }
+
+  // Drop the consumed matched filter output.
+  // The next sampling instant may be beyond the end of the output.
+  int drop = std::min(static_cast<int>(m_bit_phase - delta) - 1,
+                      static_cast<int>(size));
+  if (drop > 0) {
+    m_mf_out.erase(m_mf_out.begin(), m_mf_out.begin() + drop);
+    m_bit_phase -= drop;
+  }
+}
+
+// Compute the 10-bit syndrome of a 26-bit block.
+inline unsigned int RdsDecoder::syndrome(std::uint32_t block) {
+  std::uint32_t reg = block;
+  for (int i = 25; i >= 10; i--) {
+    if (reg & (1u << i)) {
+      reg ^= rds_generator << (i - 10);
+    }
+  }
+  return reg & 0x3ff;
+}
+
+// Process a differentially decoded bit.
+inline void RdsDecoder::process_bit(unsigned int bit) {
+  m_shift_reg = ((m_shift_reg << 1) | bit) & 0x3ffffff;
+  m_bit_count++;
+
+  unsigned int s = syndrome(m_shift_reg);
+
+  if (!m_synced) {
+    // Block position of the syndrome, or 4 if none.
+    unsigned int position;
+    switch (s) {
+    case rds_offset_a:
+      position = 0;
+      break;
+    case rds_offset_b:
+      position = 1;
+      break;
+    case rds_offset_c:
+    case rds_offset_cprime:
+      position = 2;
+      break;
+    case rds_offset_d:
+      position = 3;
+      break;
+    default:
+      position = 4;
+      break;
+    }
+    if (position == 4) {
+      return;
+    }
+    // Two valid blocks in the consistent distance establish the sync.
+    if (m_sync_candidate) {
+      unsigned int distance = m_bit_count - m_sync_candidate_bit;
+      if ((distance % 26) == 0 && distance <= 26 * 4 &&
+          ((m_sync_candidate_offset + distance / 26) % 4) == position) {
+        m_synced = true;
+        m_bad_blocks = 0;
+        m_group_valid = 0;
+        m_bit_count = 0;
+        m_block_index = position;
+        if (position == 0) {
+          m_group_blocks[0] = m_shift_reg >> 10;
+          m_group_valid = 1;
+        }
+        return;
+      }
+    }
+    m_sync_candidate = true;
+    m_sync_candidate_offset = position;
+    m_sync_candidate_bit = m_bit_count;
+    return;
+  }
+
+  // Wait until a whole block is received.
+  if (m_bit_count < 26) {
+    return;
+  }
+  m_bit_count = 0;
+  m_block_index = (m_block_index + 1) % 4;
+
+  bool valid;
+  switch (m_block_index) {
+  case 0:
+    valid = (s == rds_offset_a);
+    m_group_valid = 0;
+    break;
+  case 1:
+    valid = (s == rds_offset_b);
+    break;
+  case 2:
+    valid = (s == rds_offset_c) || (s == rds_offset_cprime);
+    break;
+  default:
+    valid = (s == rds_offset_d);
+    break;
+  }
+
+  if (valid) {
+    m_bad_blocks = 0;
+    m_group_blocks[m_block_index] = m_shift_reg >> 10;
+    m_group_valid |= 1 << m_block_index;
+  } else if (++m_bad_blocks >= rds_max_bad_blocks) {
+    m_synced = false;
+    m_sync_candidate = false;
+    return;
+  }
+
+  if (m_block_index == 3 && m_group_valid == 0xf) {
+    process_group();
+  }
+}
+
+// Process a group.
+inline void RdsDecoder::process_group() {
+  Group group;
+  for (unsigned int i = 0; i < 4; i++) {
+    group.blocks[i] = m_group_blocks[i];
+  }
+  // Bit decisions lag behind the input by the filter delays;
+  // the index is for the time-stamping reference only.
+  group.sample_index = m_decimated_cnt * decimation;
+  m_groups.push_back(group);
+
+  m_pi = m_group_blocks[0];
+
+  const std::uint16_t block_b = m_group_blocks[1];
+  const std::uint16_t block_c = m_group_blocks[2];
+  const std::uint16_t block_d = m_group_blocks[3];
+  const unsigned int group_type = block_b >> 12;
+  const bool version_b = (block_b >> 11) & 1;
+
+  // Replace non-printable characters.
+  auto printable = [](const std::string &str) {
+    std::string ret(str);
+    for (char &c : ret) {
+      if (c < 0x20 || c > 0x7e) {
+        c = '?';
+      }
+    }
+    return ret;
+  };
+
+  switch (group_type) {
+  case 0: {
+    // Program Service name: 2 characters per group.
+    unsigned int address = block_b & 0x3;
+    m_ps_buf[address * 2] = block_d >> 8;
+    m_ps_buf[address * 2 + 1] = block_d & 0xff;
+    m_ps_mask |= 1 << address;
+    if (m_ps_mask == 0xf) {
+      m_ps = printable(m_ps_buf);
+      m_ps_mask = 0;
+    }
+    break;
+  }
+  case 2: {
+    // RadioText: 4 characters per 2A group, 2 characters per 2B group.
+    int ab_flag = (block_b >> 4) & 1;
+    if (ab_flag != m_rt_ab_flag) {
+      // Text A/B flag toggled: clear the whole text.
+      m_rt_ab_flag = ab_flag;
+      m_rt_buf.assign(64, ' ');
+      m_rt_mask = 0;
+    }
+    unsigned int address = block_b & 0xf;
+    unsigned int segment_length;
+    if (version_b) {
+      segment_length = 2;
+      m_rt_buf[address * 2] = block_d >> 8;
+      m_rt_buf[address * 2 + 1] = block_d & 0xff;
+    } else {
+      segment_length = 4;
+      m_rt_buf[address * 4] = block_c >> 8;
+      m_rt_buf[address * 4 + 1] = block_c & 0xff;
+      m_rt_buf[address * 4 + 2] = block_d >> 8;
+      m_rt_buf[address * 4 + 3] = block_d & 0xff;
+    }
+    m_rt_mask |= 1 << address;
+    // The text ends at the carriage return, or at the maximum length.
+    std::size_t length = m_rt_buf.find('\r');
+    if (length == std::string::npos || length > segment_length * 16) {
+      length = segment_length * 16;
+    }
+    unsigned int segments = (length + segment_length - 1) / segment_length;
+    unsigned int needed = (1u << segments) - 1;
+    if ((m_rt_mask & needed) == needed) {
+      m_rt = printable(m_rt_buf.substr(0, length));
+    }
+    break;
+  }
+  default:
+    // Other groups are not decoded.
+    break;
+  }
+}
+
+/* end */
@@ -27,6 +27,7 @@
 
 #include "ConfigParser.h"
 #include "RtlSdrSource.h"
+#include "ThreadPolicy.h"
 #include "Utility.h"
 
 RtlSdrSource *RtlSdrSource::m_this = 0;
@@ -308,7 +309,14 @@ bool RtlSdrSource::stop() {
 void RtlSdrSource::run() {
   IQSampleVector iqsamples;
 
-  while (!m_this->m_stop_flag->load() && get_samples(&iqsamples)) {
+  ThreadPolicy::apply(ThreadPolicy::Role::Source);
+
+  while (!m_this->m_stop_flag->load()) {
+    // Read samples into a block recycled by the consumer.
+    iqsamples = m_this->m_buf->get_block(0);
+    if (!get_samples(&iqsamples)) {
+      break;
+    }
     m_this->m_buf->push(std::move(iqsamples));
   }
 }
@@ -325,7 +333,8 @@ bool RtlSdrSource::get_samples(IQSampleVector *samples) {
     return false;
   }
 
-  std::vector<uint8_t> buf(2 * m_this->m_block_length);
+  std::vector<uint8_t> &buf = m_this->m_bytebuf;
+  buf.resize(2 * m_this->m_block_length);
 
   r = rtlsdr_read_sync(m_this->m_dev, buf.data(), 2 * m_this->m_block_length,
                        &n_read);
@@ -0,0 +1,412 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "ConfigParser.h"
+#include "RtlTcpSource.h"
+#include "ThreadPolicy.h"
+#include "Utility.h"
+
+constexpr const char *RtlTcpSource::default_host;
+
+RtlTcpSource *RtlTcpSource::m_this = 0;
+
+// Constructor
+RtlTcpSource::RtlTcpSource(int dev_index)
+    : m_fd(-1), m_sample_rate(default_sample_rate),
+      m_frequency(default_frequency), m_tuner_gain(INT_MIN), m_ppm(0),
+      m_block_length(default_block_length), m_agcmode(false),
+      m_tuner_type(0), m_gain_count(0), m_thread(0) {
+  m_devname = "rtl_tcp";
+  m_this = this;
+}
+
+// Destructor
+RtlTcpSource::~RtlTcpSource() {
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+
+  m_this = 0;
+}
+
+bool RtlTcpSource::configure(std::string configurationStr) {
+  std::string host(default_host);
+  int port = default_port;
+  std::string unix_path;
+  uint32_t sample_rate = default_sample_rate;
+  uint32_t frequency = default_frequency;
+  int tuner_gain = INT_MIN;
+  int ppm = 0;
+  int block_length = default_block_length;
+  bool agcmode = false;
+  bool antbias = false;
+
+  ConfigParser cp;
+  ConfigParser::map_type m;
+
+  cp.parse_config_string(configurationStr, m);
+  if (m.find("host") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: host: " << m["host"] << std::endl;
+    host = m["host"];
+  }
+
+  if (m.find("port") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: port: " << m["port"] << std::endl;
+    port = atoi(m["port"].c_str());
+    if (port <= 0 || port > 65535) {
+      m_error = "Invalid port";
+      return false;
+    }
+  }
+
+  if (m.find("unix") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: unix: " << m["unix"] << std::endl;
+    unix_path = m["unix"];
+  }
+
+  if (m.find("srate") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: srate: " << m["srate"] << std::endl;
+    sample_rate = atoi(m["srate"].c_str());
+    if (sample_rate == 0) {
+      m_error = "Invalid sample rate";
+      return false;
+    }
+  }
+
+  if (m.find("freq") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: freq: " << m["freq"] << std::endl;
+    frequency = atoi(m["freq"].c_str());
+  }
+
+  if (m.find("gain") != m.end()) {
+    std::string gain_str = m["gain"];
+    std::cerr << "RtlTcpSource::configure: gain: " << gain_str << std::endl;
+
+    if (strcasecmp(gain_str.c_str(), "auto") == 0) {
+      tuner_gain = INT_MIN;
+    } else {
+      double tmpgain;
+      if (!Utility::parse_dbl(gain_str.c_str(), tmpgain) ||
+          std::fabs(tmpgain) > 1000) {
+        m_error = "Invalid gain";
+        return false;
+      }
+      tuner_gain = lrint(tmpgain * 10);
+    }
+  }
+
+  if (m.find("ppm") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: ppm: " << m["ppm"] << std::endl;
+    ppm = atoi(m["ppm"].c_str());
+  }
+
+  if (m.find("blklen") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: blklen: " << m["blklen"]
+              << std::endl;
+    block_length = atoi(m["blklen"].c_str());
+    if (block_length <= 0) {
+      m_error = "Invalid block length";
+      return false;
+    }
+  }
+
+  if (m.find("agc") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: agc" << std::endl;
+    agcmode = true;
+  }
+
+  if (m.find("antbias") != m.end()) {
+    std::cerr << "RtlTcpSource::configure: antbias" << std::endl;
+    antbias = true;
+  }
+
+  // Intentionally tune at a higher frequency to avoid DC offset.
+  m_confFreq = frequency;
+  uint32_t tuner_freq = frequency - sample_rate / 4;
+
+  return configure(host, port, unix_path, sample_rate, tuner_freq, tuner_gain,
+                   ppm, block_length, agcmode, antbias);
+}
+
+// Connect to the server and configure the tuner.
+bool RtlTcpSource::configure(const std::string &host, int port,
+                             const std::string &unix_path,
+                             std::uint32_t sample_rate,
+                             std::uint32_t frequency, int tuner_gain, int ppm,
+                             int block_length, bool agcmode, bool antbias) {
+  m_sample_rate = sample_rate;
+  m_frequency = frequency;
+  m_tuner_gain = tuner_gain;
+  m_ppm = ppm;
+  m_block_length = block_length;
+  m_agcmode = agcmode;
+  m_bytebuf.resize(2 * m_block_length);
+
+  if (!unix_path.empty()) {
+    // Connect to the Unix domain socket.
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (unix_path.size() >= sizeof(addr.sun_path)) {
+      m_error = "Unix socket path too long";
+      return false;
+    }
+    strncpy(addr.sun_path, unix_path.c_str(), sizeof(addr.sun_path) - 1);
+    m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_fd < 0 ||
+        connect(m_fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof(addr)) < 0) {
+      m_error = "Failed to connect to " + unix_path + " : " + strerror(errno);
+      return false;
+    }
+    m_devname = "rtl_tcp unix:" + unix_path;
+  } else {
+    // Connect to the TCP server.
+    struct addrinfo hints;
+    struct addrinfo *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string port_str = std::to_string(port);
+    int r = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &res);
+    if (r != 0) {
+      m_error = "Failed to resolve " + host + " : " + gai_strerror(r);
+      return false;
+    }
+    for (struct addrinfo *ai = res; ai != nullptr; ai = ai->ai_next) {
+      m_fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (m_fd < 0) {
+        continue;
+      }
+      // Set the receive buffer size before connecting
+      // for the TCP window scaling.
+      int bufsize = socket_buffer_size;
+      setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+      if (connect(m_fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+        break;
+      }
+      close(m_fd);
+      m_fd = -1;
+    }
+    freeaddrinfo(res);
+    if (m_fd < 0) {
+      m_error = "Failed to connect to " + host + ":" + port_str;
+      return false;
+    }
+    // Commands are small and must not be delayed.
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    m_devname = "rtl_tcp " + host + ":" + port_str;
+  }
+
+  // Read the dongle information header.
+  // magic "RTL0", tuner type, and tuner gain count (big endian)
+  std::uint8_t header[12];
+  ssize_t done = 0;
+  while (done < 12) {
+    ssize_t len = recv(m_fd, header + done, 12 - done, 0);
+    if (len <= 0) {
+      m_error = "Failed to receive rtl_tcp header";
+      return false;
+    }
+    done += len;
+  }
+  if (memcmp(header, "RTL0", 4) != 0) {
+    m_error = "Invalid rtl_tcp header";
+    return false;
+  }
+  m_tuner_type = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) |
+                 header[7];
+  m_gain_count = (header[8] << 24) | (header[9] << 16) | (header[10] << 8) |
+                 header[11];
+
+  // Configure the tuner.
+  if (!send_command(Command::SetSampleRate, m_sample_rate) ||
+      !send_command(Command::SetFrequency, m_frequency) ||
+      !send_command(Command::SetFreqCorrection, std::uint32_t(m_ppm)) ||
+      !send_command(Command::SetAgcMode, m_agcmode ? 1 : 0) ||
+      !send_command(Command::SetBiasTee, antbias ? 1 : 0)) {
+    return false;
+  }
+  if (m_tuner_gain == INT_MIN) {
+    if (!send_command(Command::SetGainMode, 0)) {
+      return false;
+    }
+  } else {
+    if (!send_command(Command::SetGainMode, 1) ||
+        !send_command(Command::SetGain, std::uint32_t(m_tuner_gain))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Send a command.
+bool RtlTcpSource::send_command(Command cmd, std::uint32_t param) {
+  std::uint8_t buf[5];
+  buf[0] = static_cast<std::uint8_t>(cmd);
+  buf[1] = (param >> 24) & 0xff;
+  buf[2] = (param >> 16) & 0xff;
+  buf[3] = (param >> 8) & 0xff;
+  buf[4] = param & 0xff;
+  if (send(m_fd, buf, sizeof(buf), MSG_NOSIGNAL) != sizeof(buf)) {
+    m_error = "Failed to send rtl_tcp command";
+    return false;
+  }
+  return true;
+}
+
+std::uint32_t RtlTcpSource::get_sample_rate() { return m_sample_rate; }
+
+std::uint32_t RtlTcpSource::get_frequency() { return m_frequency; }
+
+bool RtlTcpSource::is_low_if() { return false; }
+
+void RtlTcpSource::print_specific_parms() {
+  fprintf(stderr, "Tuner type:        %u\n", m_tuner_type);
+  if (m_tuner_gain == INT_MIN) {
+    fprintf(stderr, "LNA gain:          auto\n");
+  } else {
+    fprintf(stderr, "LNA gain:          %.1f dB\n", 0.1 * m_tuner_gain);
+  }
+  fprintf(stderr, "RTL AGC mode:      %s\n",
+          m_agcmode ? "enabled" : "disabled");
+}
+
+// Return a list of supported device.
+void RtlTcpSource::get_device_names(std::vector<std::string> &devices) {
+  devices.push_back("RtlTcpSource");
+}
+
+bool RtlTcpSource::start(DataBuffer<IQSample> *buf,
+                         std::atomic_bool *stop_flag) {
+  m_buf = buf;
+  m_stop_flag = stop_flag;
+
+  // Start thread.
+  if (m_thread == 0) {
+    m_thread = new std::thread(run);
+    return true;
+  } else {
+    m_error = "Source thread already started";
+    return false;
+  }
+}
+
+bool RtlTcpSource::stop() {
+  // Terminate thread.
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+  }
+
+  return true;
+}
+
+// Receive exactly size bytes.
+bool RtlTcpSource::recv_fully(std::uint8_t *buf, std::size_t size) {
+  std::size_t done = 0;
+
+  while (done < size) {
+    if (m_this->m_stop_flag->load()) {
+      return false;
+    }
+
+    // Wait with timeout so that the stop flag is checked periodically.
+    struct pollfd pfd;
+    pfd.fd = m_this->m_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ret = poll(&pfd, 1, poll_timeout_ms);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "RtlTcpSource: poll: " << strerror(errno) << std::endl;
+      return false;
+    } else if (ret == 0) {
+      continue;
+    }
+
+    ssize_t len = recv(m_this->m_fd, buf + done, size - done, 0);
+    if (len < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      std::cerr << "RtlTcpSource: recv: " << strerror(errno) << std::endl;
+      return false;
+    } else if (len == 0) {
+      std::cerr << "RtlTcpSource: connection closed" << std::endl;
+      return false;
+    }
+    done += len;
+  }
+
+  return true;
+}
+
+// Thread to receive IQSample from the server.
+void RtlTcpSource::run() {
+  const std::size_t block_length = m_this->m_block_length;
+  std::uint8_t *in = m_this->m_bytebuf.data();
+
+  ThreadPolicy::apply(ThreadPolicy::Role::Source);
+
+  while (!m_this->m_stop_flag->load()) {
+    if (!recv_fully(in, 2 * block_length)) {
+      break;
+    }
+
+    // Convert unsigned 8-bit samples to float.
+    // Offset binary to two's complement: (u - 128) == (int8_t)(u ^ 0x80)
+    // Reuse a block recycled by the consumer.
+    IQSampleVector iqsamples = m_this->m_buf->get_block(block_length);
+    for (std::size_t i = 0; i < 2 * block_length; i++) {
+      in[i] ^= 0x80;
+    }
+    volk_8i_s32f_convert_32f(reinterpret_cast<float *>(iqsamples.data()),
+                             reinterpret_cast<const std::int8_t *>(in),
+                             128.0f, 2 * block_length);
+
+    // Push samples.
+    m_this->m_buf->push(std::move(iqsamples));
+  }
+
+  // Push end.
+  m_this->m_buf->push_end();
+}
+
+/* end */
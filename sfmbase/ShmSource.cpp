@@ -0,0 +1,231 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "ConfigParser.h"
+#include "ShmSource.h"
+#include "ThreadPolicy.h"
+
+constexpr const char *ShmSource::default_name;
+
+ShmSource *ShmSource::m_this = 0;
+
+// Constructor
+ShmSource::ShmSource(int dev_index)
+    : m_block_length(default_block_length), m_size(0), m_header(nullptr),
+      m_ring(nullptr), m_lost_samples(0), m_thread(0) {
+  m_this = this;
+}
+
+// Destructor
+ShmSource::~ShmSource() {
+  // Detach from the bus.
+  if (m_header) {
+    munmap(const_cast<IqShmHeader *>(m_header), m_size);
+    m_header = nullptr;
+  }
+
+  m_this = 0;
+}
+
+bool ShmSource::configure(std::string configurationStr) {
+  std::string name(default_name);
+  int block_length = default_block_length;
+
+  ConfigParser cp;
+  ConfigParser::map_type m;
+
+  // name
+  cp.parse_config_string(configurationStr, m);
+  if (m.find("name") != m.end()) {
+    std::cerr << "ShmSource::configure: name: " << m["name"] << std::endl;
+    name = m["name"];
+  }
+
+  // blklen
+  if (m.find("blklen") != m.end()) {
+    std::cerr << "ShmSource::configure: blklen: " << m["blklen"] << std::endl;
+    block_length = atoi(m["blklen"].c_str());
+  }
+
+  // configure
+  return configure(name, block_length);
+}
+
+bool ShmSource::configure(std::string name, int block_length) {
+  m_devname = name;
+  m_block_length = std::max(1, block_length);
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    m_error = "Failed to open shared memory " + name + " : " + strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || std::size_t(st.st_size) < sizeof(IqShmHeader)) {
+    m_error = "Invalid shared memory size " + name;
+    close(fd);
+    return false;
+  }
+  m_size = st.st_size;
+
+  void *addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    m_error = "Failed to map shared memory " + name + " : " + strerror(errno);
+    return false;
+  }
+  m_header = static_cast<const IqShmHeader *>(addr);
+  m_ring = reinterpret_cast<const IQSample *>(
+      static_cast<const char *>(addr) + sizeof(IqShmHeader));
+
+  // Check header.
+  if (m_header->magic != IqShmHeader::magic_value ||
+      m_header->version != IqShmHeader::version_value) {
+    m_error = "Invalid IQ bus header " + name;
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (m_size < IqShmPublisher::shm_size(m_header->capacity)) {
+    m_error = "Invalid IQ bus capacity " + name;
+    return false;
+  }
+
+  m_confFreq = m_header->configured_frequency;
+
+  return true;
+}
+
+std::uint32_t ShmSource::get_sample_rate() { return m_header->sample_rate; }
+
+std::uint32_t ShmSource::get_frequency() { return m_header->frequency; }
+
+bool ShmSource::is_low_if() { return m_header->low_if != 0; }
+
+void ShmSource::print_specific_parms() {
+  fprintf(stderr, "IQ bus capacity:   %.9g [s]\n",
+          double(m_header->capacity) / m_header->sample_rate);
+}
+
+// Return a list of supported device.
+void ShmSource::get_device_names(std::vector<std::string> &devices) {
+  devices.push_back("ShmSource");
+}
+
+bool ShmSource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag) {
+  m_buf = buf;
+  m_stop_flag = stop_flag;
+
+  // Start thread.
+  if (m_thread == 0) {
+    m_thread = new std::thread(run);
+    return true;
+  } else {
+    m_error = "Source thread already started";
+    return false;
+  }
+}
+
+bool ShmSource::stop() {
+  // Terminate thread.
+  if (m_thread) {
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+  }
+
+  if (m_lost_samples.load() > 0) {
+    std::cerr << "ShmSource: lost samples: " << m_lost_samples.load()
+              << std::endl;
+  }
+
+  return true;
+}
+
+// Thread to read IQSample from the shared-memory IQ bus.
+void ShmSource::run() {
+  const IqShmHeader *header = m_this->m_header;
+  const IQSample *ring = m_this->m_ring;
+  const std::uint64_t capacity = header->capacity;
+  const std::uint64_t block_length = m_this->m_block_length;
+
+  ThreadPolicy::apply(ThreadPolicy::Role::Source);
+
+  // Start from the current position of the publisher.
+  std::uint64_t read_count =
+      header->write_count.load(std::memory_order_acquire);
+
+  while (!m_this->m_stop_flag->load()) {
+    std::uint64_t write_count =
+        header->write_count.load(std::memory_order_acquire);
+
+    if (write_count == read_count) {
+      if (header->closed.load(std::memory_order_acquire)) {
+        // The publisher has stopped.
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    // Skip to the middle of the ring buffer if overrun.
+    if (write_count - read_count > capacity) {
+      std::uint64_t next_count = write_count - capacity / 2;
+      m_this->m_lost_samples += next_count - read_count;
+      read_count = next_count;
+    }
+
+    std::size_t n = std::min(write_count - read_count, block_length);
+    std::size_t pos = read_count % capacity;
+    std::size_t first = std::min<std::size_t>(n, capacity - pos);
+    // Reuse a block recycled by the consumer.
+    IQSampleVector iqsamples = m_this->m_buf->get_block(n);
+    std::copy(ring + pos, ring + pos + first, iqsamples.begin());
+    std::copy(ring, ring + (n - first), iqsamples.begin() + first);
+
+    // Discard the samples overwritten during the copy.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    std::uint64_t write_reserve =
+        header->write_reserve.load(std::memory_order_relaxed);
+    if (write_reserve - read_count > capacity) {
+      m_this->m_lost_samples += n;
+      read_count += n;
+      continue;
+    }
+    read_count += n;
+
+    // Push samples.
+    m_this->m_buf->push(std::move(iqsamples));
+  }
+
+  // Push end.
+  m_this->m_buf->push_end();
+}
+
+/* end */
@@ -0,0 +1,243 @@
+// airspy-fmradion
+// Software decoder for FM broadcast radio with Airspy
+//
+// Copyright (C) 2020 Kenji Rikitake, JJ1BDX
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <strings.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include "ConfigParser.h"
+#include "ThreadPolicy.h"
+
+// Placement of the roles, set before the threads start.
+static ThreadPolicy::Setting settings[ThreadPolicy::roles] = {
+    {{}, SCHED_OTHER, 0, false},
+    {{}, SCHED_OTHER, 0, false},
+    {{}, SCHED_OTHER, 0, false}};
+
+static const char *const role_names[ThreadPolicy::roles] = {"source", "dsp",
+                                                             "output"};
+
+// Parse a non-negative decimal integer.
+static bool parse_uint(const std::string &s, int &v) {
+  char *endp;
+  long t = strtol(s.c_str(), &endp, 10);
+  if (s.empty() || *endp != '\0' || t < 0 || t > 65535) {
+    return false;
+  }
+  v = t;
+  return true;
+}
+
+// Parse CPU numbers joined by '+' or ranges by '-', e.g., "0+2-3".
+static bool parse_cpus(const std::string &text, std::vector<int> &cpus) {
+  cpus.clear();
+  if (strcasecmp(text.c_str(), "any") == 0) {
+    return true;
+  }
+  std::string::size_type begin = 0;
+  while (begin <= text.size()) {
+    std::string::size_type end = text.find('+', begin);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    std::string item = text.substr(begin, end - begin);
+    std::string::size_type dash = item.find('-');
+    int first, last;
+    if (dash == std::string::npos) {
+      if (!parse_uint(item, first)) {
+        return false;
+      }
+      last = first;
+    } else if (!parse_uint(item.substr(0, dash), first) ||
+               !parse_uint(item.substr(dash + 1), last) || last < first) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+// Parse "cpus[:policy[:priority]]".
+static bool parse_setting(const std::string &text,
+                          ThreadPolicy::Setting &setting) {
+  std::vector<std::string> fields;
+  std::string::size_type begin = 0;
+  while (true) {
+    std::string::size_type end = text.find(':', begin);
+    fields.push_back(text.substr(begin, end - begin));
+    if (end == std::string::npos) {
+      break;
+    }
+    begin = end + 1;
+  }
+  if (fields.size() > 3 || !parse_cpus(fields[0], setting.cpus)) {
+    return false;
+  }
+
+  setting.policy = SCHED_OTHER;
+  if (fields.size() >= 2) {
+    const char *policy = fields[1].c_str();
+    if (strcasecmp(policy, "other") == 0) {
+      setting.policy = SCHED_OTHER;
+    } else if (strcasecmp(policy, "fifo") == 0) {
+      setting.policy = SCHED_FIFO;
+    } else if (strcasecmp(policy, "rr") == 0) {
+      setting.policy = SCHED_RR;
+    } else {
+      return false;
+    }
+  }
+
+  if (setting.policy == SCHED_OTHER) {
+    setting.priority = 0;
+    return fields.size() < 3;
+  }
+  int min_priority = sched_get_priority_min(setting.policy);
+  int max_priority = sched_get_priority_max(setting.policy);
+  if (fields.size() < 3) {
+    setting.priority = min_priority;
+    return true;
+  }
+  return parse_uint(fields[2], setting.priority) &&
+         setting.priority >= min_priority && setting.priority <= max_priority;
+}
+
+bool ThreadPolicy::configure(const std::string &text, std::string &error) {
+  ConfigParser cp;
+  ConfigParser::map_type parsed_map;
+  cp.parse_config_string(text, parsed_map);
+
+  for (const auto &pair : parsed_map) {
+    unsigned int index = roles;
+    for (unsigned int i = 0; i < roles; i++) {
+      if (strcasecmp(pair.first.c_str(), role_names[i]) == 0) {
+        index = i;
+      }
+    }
+    if (index == roles) {
+      error = "unknown thread role: " + pair.first;
+      return false;
+    }
+    Setting setting;
+    if (!parse_setting(pair.second, setting)) {
+      error = "invalid placement for " + pair.first + ": " + pair.second;
+      return false;
+    }
+#ifndef __linux__
+    if (!setting.cpus.empty()) {
+      error = "CPU affinity is not supported on this platform";
+      return false;
+    }
+#endif
+    setting.configured = true;
+    settings[index] = setting;
+  }
+  return true;
+}
+
+bool ThreadPolicy::apply(Role role) {
+  const Setting &setting = get_setting(role);
+  if (!setting.configured) {
+    return true;
+  }
+  bool ok = true;
+
+#ifdef __linux__
+  if (!setting.cpus.empty()) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu : setting.cpus) {
+      if (cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &cpuset);
+      }
+    }
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (rc != 0) {
+      fprintf(stderr, "WARNING: can not set CPU affinity of %s thread (%s)\n",
+              role_name(role), strerror(rc));
+      ok = false;
+    }
+  }
+#endif
+
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = setting.priority;
+  int rc = pthread_setschedparam(pthread_self(), setting.policy, &param);
+  if (rc != 0) {
+    fprintf(stderr, "WARNING: can not set scheduling of %s thread (%s)\n",
+            role_name(role), strerror(rc));
+    ok = false;
+  }
+  return ok;
+}
+
+const ThreadPolicy::Setting &ThreadPolicy::get_setting(Role role) {
+  return settings[static_cast<unsigned int>(role)];
+}
+
+const char *ThreadPolicy::role_name(Role role) {
+  return role_names[static_cast<unsigned int>(role)];
+}
+
+std::string ThreadPolicy::describe(Role role) {
+  const Setting &setting = get_setting(role);
+  std::string text("CPU ");
+  if (setting.cpus.empty()) {
+    text += "any";
+  } else {
+    for (unsigned int i = 0; i < setting.cpus.size(); i++) {
+      if (i > 0) {
+        text += "+";
+      }
+      text += std::to_string(setting.cpus[i]);
+    }
+  }
+  switch (setting.policy) {
+  case SCHED_FIFO:
+    text += ", SCHED_FIFO priority " + std::to_string(setting.priority);
+    break;
+  case SCHED_RR:
+    text += ", SCHED_RR priority " + std::to_string(setting.priority);
+    break;
+  default:
+    text += ", SCHED_OTHER";
+    break;
+  }
+  return text;
+}
+
+long ThreadPolicy::involuntary_switches() {
+#ifdef RUSAGE_THREAD
+  struct rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+    return usage.ru_nivcsw;
+  }
+#endif
+  return -1;
+}
+
+/* end */